@@ -2,16 +2,49 @@
 
 #include <stdint.h>
 #include <stdarg.h>
+#include <string.h>
 
 #include <hal/adc_hal.h>
 #include <driver/periph_ctrl.h>
 #ifdef FADC_CAL_USE
 #include <esp_adc_cal.h>
+#include <nvs.h>
 #endif
 
 #ifdef FADC_CAL_USE
-// Calibration table
-static uint16_t adc_cal_tab[(1 << FADC_CAL_SIZE) + 1];
+#define FADC_CAL_POINTS ((1 << FADC_CAL_SIZE) + 2)
+#define FADC_NVS_NAMESPACE "fadc"
+#define FADC_NVS_VERSION 1
+
+// Calibration table per attenuation, the extra last entry repeats the end point so fadcApplyBatch can clamp without a branch.
+// Two of each: a rebuild fills the one not in use and then swaps the pointer, so the sampler task and ISRs reading
+// the tables never see one half written
+static uint16_t adc_cal_tabs[FADC_ATTEN_COUNT][2][FADC_CAL_POINTS];
+static uint16_t *adc_cal_active[FADC_ATTEN_COUNT] = {
+  adc_cal_tabs[0][0], adc_cal_tabs[1][0], adc_cal_tabs[2][0], adc_cal_tabs[3][0]
+};
+
+static inline const uint16_t *fadc_table(uint8_t atten) {
+  return __atomic_load_n(&adc_cal_active[atten < FADC_ATTEN_COUNT ? atten : FADC_ATTEN], __ATOMIC_ACQUIRE);
+}
+
+static void fadc_publish(uint8_t atten, const uint16_t *table) {
+  uint16_t *spare = adc_cal_active[atten] == adc_cal_tabs[atten][0] ? adc_cal_tabs[atten][1] : adc_cal_tabs[atten][0];
+  memcpy(spare, table, sizeof(adc_cal_tabs[atten][0]));
+  __atomic_store_n(&adc_cal_active[atten], spare, __ATOMIC_RELEASE);
+}
+
+// What's cached in NVS per attenuation, rebuilt if the eFuse characterisation doesn't match
+typedef struct {
+  uint32_t version;
+  uint32_t coeff_a;
+  uint32_t coeff_b;
+  int32_t  gain_q16;                                          //User two-point correction, 65536 and 0 when uncorrected
+  int32_t  offset_mv;
+  uint16_t table[FADC_CAL_POINTS];
+} fadc_cal_blob_t;
+
+static fadc_cal_blob_t adc_cal_blobs[FADC_ATTEN_COUNT];
 
 typedef struct {
   uint64_t v_cali_input;                                      //Input to calculate the error
@@ -83,12 +116,132 @@ static uint32_t myesp_adc_cal_raw_to_voltage(uint32_t adc_reading, const esp_adc
 }
 
 uint16_t fadcApply(uint32_t v) {
+  const uint16_t *adc_cal_tab = fadc_table(FADC_ATTEN);
   if(v <= 0) return adc_cal_tab[0];
   if(v >= (1 << FADC_CAL_RESOLUTION)) return adc_cal_tab[(1 << FADC_CAL_SIZE)];
   uint32_t i = (v >> (FADC_CAL_RESOLUTION - FADC_CAL_SIZE));
   uint32_t f = v & ((1 << (FADC_CAL_RESOLUTION - FADC_CAL_SIZE)) - 1);
   return (uint16_t)(((uint32_t)adc_cal_tab[i] * ((1 << (FADC_CAL_RESOLUTION - FADC_CAL_SIZE)) - f) + (uint32_t)adc_cal_tab[i + 1] * f) >> (FADC_CAL_RESOLUTION - FADC_CAL_SIZE));
 }
+
+void fadcApplyBatchAtten(uint8_t atten, const uint16_t* in, uint16_t* out, uint32_t count) {
+  const uint16_t *tab = fadc_table(atten);
+  const uint32_t step = FADC_CAL_RESOLUTION - FADC_CAL_SIZE;
+  const uint32_t top = 1 << FADC_CAL_RESOLUTION;
+  // Same result as fadcApply, v == top lands on the padding entry with f == 0
+  for (uint32_t n = 0; n < count; n++) {
+    uint32_t v = (uint32_t)in[n] << FADC_SHIFT;
+    v = v < top ? v : top;
+    uint32_t i = v >> step;
+    uint32_t f = v & ((1 << step) - 1);
+    out[n] = (uint16_t)(((uint32_t)tab[i] * ((1 << step) - f) + (uint32_t)tab[i + 1] * f) >> step);
+  }
+}
+
+void fadcApplyBatch(const uint16_t* in, uint16_t* out, uint32_t count) {
+  fadcApplyBatchAtten(FADC_ATTEN, in, out, count);
+}
+
+uint16_t fadcApplyAtten(uint8_t atten, uint32_t v) {
+  uint16_t raw = v >> FADC_SHIFT;
+  uint16_t result;
+  fadcApplyBatchAtten(atten, &raw, &result, 1);
+  return result;
+}
+
+static void fadc_build_table(fadc_cal_blob_t *blob, const esp_adc_cal_characteristics_t *chars) {
+  for(uint16_t n = 0; n <= (1 << FADC_CAL_SIZE); n++) {
+    int32_t mv = myesp_adc_cal_raw_to_voltage(n << (FADC_RESOLUTION - FADC_CAL_SIZE), chars);
+    mv = (int32_t)(((int64_t)mv * blob->gain_q16) >> 16) + blob->offset_mv;
+    blob->table[n] = mv < 0 ? 0 : (mv > 0xFFFF ? 0xFFFF : mv);
+  }
+  blob->table[(1 << FADC_CAL_SIZE) + 1] = blob->table[1 << FADC_CAL_SIZE];
+}
+
+static void fadc_store(uint8_t atten) {
+  nvs_handle_t handle;
+  if (nvs_open(FADC_NVS_NAMESPACE, NVS_READWRITE, &handle) != ESP_OK) {
+    return;
+  }
+  char key[] = "cal0";
+  key[3] += atten;
+  nvs_set_blob(handle, key, &adc_cal_blobs[atten], sizeof(fadc_cal_blob_t));
+  nvs_commit(handle);
+  nvs_close(handle);
+}
+
+static void fadc_characterize(uint8_t atten, esp_adc_cal_characteristics_t *chars) {
+  esp_adc_cal_characterize((adc_unit_t)1, (adc_atten_t)atten, (adc_bits_width_t)(FADC_RESOLUTION - 9), 1100, chars);
+}
+
+// Rebuilds the table from eFuse with the blob's correction, and caches it
+static void fadc_rebuild(uint8_t atten, const esp_adc_cal_characteristics_t *chars) {
+  fadc_cal_blob_t *blob = &adc_cal_blobs[atten];
+  blob->version = FADC_NVS_VERSION;
+  blob->coeff_a = chars->coeff_a;
+  blob->coeff_b = chars->coeff_b;
+  fadc_build_table(blob, chars);
+  fadc_publish(atten, blob->table);
+  fadc_store(atten);
+}
+
+bool fadcCalibrate(uint8_t atten) {
+  if (atten >= FADC_ATTEN_COUNT) return false;
+
+  // Reading the eFuse characterisation is cheap, evaluating the error polynomial for every point isn't
+  esp_adc_cal_characteristics_t chars = {};
+  fadc_characterize(atten, &chars);
+
+  fadc_cal_blob_t *blob = &adc_cal_blobs[atten];
+  bool cached = false;
+  nvs_handle_t handle;
+  if (nvs_open(FADC_NVS_NAMESPACE, NVS_READONLY, &handle) == ESP_OK) {
+    char key[] = "cal0";
+    key[3] += atten;
+    size_t length = sizeof(fadc_cal_blob_t);
+    cached = nvs_get_blob(handle, key, blob, &length) == ESP_OK && length == sizeof(fadc_cal_blob_t)
+      && blob->version == FADC_NVS_VERSION;
+    nvs_close(handle);
+  }
+  if (!cached) {
+    blob->gain_q16 = 65536;
+    blob->offset_mv = 0;
+  }
+  if (cached && blob->coeff_a == chars.coeff_a && blob->coeff_b == chars.coeff_b) {
+    fadc_publish(atten, blob->table);
+    return true;
+  }
+
+  // A stored user correction is kept across the rebuild
+  fadc_rebuild(atten, &chars);
+  return false;
+}
+
+void fadcSetCorrection(uint8_t atten, uint16_t measured1, uint16_t actual1, uint16_t measured2, uint16_t actual2) {
+  if (atten >= FADC_ATTEN_COUNT || measured1 == measured2) return;
+  if (adc_cal_blobs[atten].version != FADC_NVS_VERSION) fadcCalibrate(atten);
+
+  // Measured values are what the current table reports, so compose with the correction already in it
+  fadc_cal_blob_t *blob = &adc_cal_blobs[atten];
+  int64_t gain_q16 = ((int64_t)(actual2 - actual1) << 16) / (measured2 - measured1);
+  int64_t offset_mv = actual1 - ((gain_q16 * measured1) >> 16);
+  blob->offset_mv = (int32_t)(((gain_q16 * blob->offset_mv) >> 16) + offset_mv);
+  blob->gain_q16 = (int32_t)((gain_q16 * blob->gain_q16) >> 16);
+
+  esp_adc_cal_characteristics_t chars = {};
+  fadc_characterize(atten, &chars);
+  fadc_rebuild(atten, &chars);
+}
+
+void fadcClearCorrection(uint8_t atten) {
+  if (atten >= FADC_ATTEN_COUNT) return;
+  adc_cal_blobs[atten].gain_q16 = 65536;
+  adc_cal_blobs[atten].offset_mv = 0;
+
+  esp_adc_cal_characteristics_t chars = {};
+  fadc_characterize(atten, &chars);
+  fadc_rebuild(atten, &chars);
+}
 #endif
 
 void fadcInit(uint8_t pins, ...) {
@@ -108,14 +261,8 @@ void fadcInit(uint8_t pins, ...) {
   va_end(args);
 
 #ifdef FADC_CAL_USE
-  // Get ADC characteristings from EFUSE
-  // Note: Assumes 11dB attenuation and 12 bit resolution
-  esp_adc_cal_characteristics_t chars = {};
-  esp_adc_cal_value_t val_type = esp_adc_cal_characterize((adc_unit_t)1, (adc_atten_t)FADC_ATTEN, (adc_bits_width_t)(FADC_RESOLUTION - 9), 1100, &chars);
-  // Generate calibration table
-  for(uint16_t n = 0; n <= (1 << FADC_CAL_SIZE); n++) {
-    adc_cal_tab[n] = myesp_adc_cal_raw_to_voltage(n << (FADC_RESOLUTION - FADC_CAL_SIZE), &chars);
-  }
+  // Calibration for the default attenuation, loaded from NVS unless the eFuse characterisation changed
+  fadcCalibrate(FADC_ATTEN);
 #endif
 
   // Enable ADC
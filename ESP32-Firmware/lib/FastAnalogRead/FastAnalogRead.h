@@ -29,6 +29,23 @@ extern "C" {
  * fadcApply(<value>)
  * Apply calibration and conversion to millivolts
  * Takes a value in the range 0-2**FADC_CAL_RESOLUTION (typically 0-4095)
+ * 
+ * fadcApplyBatch(<in>, <out>, <count>)
+ * Same as fadcApply over a whole buffer of raw fadcResult/DMA values (shifted by FADC_SHIFT internally)
+ * Branchless fixed-point loop with no call per sample, the native build's adc-batch scenario compares the two
+ * 
+ * fadcCalibrate(<atten>)
+ * Load the calibration table for an attenuation from NVS, or build and store it if the eFuse characterisation
+ * doesn't match what was cached. fadcInit does this for FADC_ATTEN. Returns true if it came from NVS
+ * 
+ * fadcApplyAtten(<atten>, <value>), fadcApplyBatchAtten(<atten>, <in>, <out>, <count>)
+ * fadcApply/fadcApplyBatch for a channel sampled at another attenuation, calibrate it first
+ * 
+ * fadcSetCorrection(<atten>, <measured1>, <actual1>, <measured2>, <actual2>)
+ * User two-point correction on top of the eFuse calibration, in millivolts as currently reported vs as measured
+ * with a meter. Stored in NVS with the table. fadcClearCorrection(<atten>) removes it
+ * The new table replaces the old one in a single pointer swap, safe while other tasks and ISRs convert. Anything
+ * derived from the old table (OCD's raw threshold) has to be worked out again
  */
 
 #include <stdint.h>
@@ -46,6 +63,7 @@ extern "C" {
 
 // Number of bits to shift left by to make fadcResult suitable for fadcApply
 #define FADC_SHIFT (FADC_CAL_RESOLUTION - FADC_RESOLUTION)
+#define FADC_ATTEN_COUNT           4 // ADC_0db to ADC_11db
 #endif
 
 // Library functions
@@ -54,6 +72,12 @@ void fadcInit(uint8_t pins, ...);
 
 #ifdef FADC_CAL_USE
 uint16_t fadcApply(uint32_t v);
+void fadcApplyBatch(const uint16_t* in, uint16_t* out, uint32_t count);
+bool fadcCalibrate(uint8_t atten);
+uint16_t fadcApplyAtten(uint8_t atten, uint32_t v);
+void fadcApplyBatchAtten(uint8_t atten, const uint16_t* in, uint16_t* out, uint32_t count);
+void fadcSetCorrection(uint8_t atten, uint16_t measured1, uint16_t actual1, uint16_t measured2, uint16_t actual2);
+void fadcClearCorrection(uint8_t atten);
 #endif
 
 static inline void  __attribute__((always_inline)) fadcStart(uint8_t channel) {
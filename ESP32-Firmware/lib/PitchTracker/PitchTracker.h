@@ -0,0 +1,105 @@
+#ifndef PITCHTRACKER_H
+#define PITCHTRACKER_H
+
+#include <stdint.h>
+#include <math.h>
+
+// Monophonic YIN pitch detector in fixed point (de Cheveigne & Kawahara 2002).
+// The difference function is the only heavy part, windowSize x maxLag integer multiply-adds per frame,
+// about 41k at the defaults. Plain C++ so host tools can check it against known tones.
+class PitchTracker {
+public:
+    static const uint16_t windowSize = 256;
+    static const uint16_t maxLag = 160; // 50 Hz at 8 kHz
+    static const uint16_t bufferSize = windowSize + maxLag;
+
+    struct Result {
+        float frequencyHz;  // 0 when unvoiced
+        uint16_t aperiodicityQ15; // Normalized difference at the chosen lag, lower is more periodic
+        uint16_t rms;       // Envelope of the window
+    };
+
+    PitchTracker(uint32_t sampleRateHz, uint16_t minFrequencyHz, uint16_t maxFrequencyHz)
+        : _sampleRateHz(sampleRateHz) {
+        _minLag = sampleRateHz / maxFrequencyHz;
+        if (_minLag < 2) {
+            _minLag = 2;
+        }
+        uint32_t lag = sampleRateHz / minFrequencyHz;
+        _maxLag = lag < maxLag ? lag : maxLag - 1;
+    }
+
+    // Below this the dip counts as a pitch, YIN's usual 0.1 to 0.15
+    void setThreshold(float threshold) {
+        _thresholdQ15 = (uint32_t)(threshold * 32768.0f);
+    }
+
+    // bufferSize samples, oldest first
+    Result analyse(const int16_t* samples) {
+        Result result = { 0.0f, 32768, 0 };
+
+        // Scaled to 13 bits so a squared difference shifted down by 6 sums over the window without overflowing
+        uint64_t energy = 0;
+        for (uint16_t j = 0; j < bufferSize; j++) {
+            _scaled[j] = samples[j] >> 3;
+            if (j < windowSize) {
+                energy += (int32_t)samples[j] * samples[j];
+            }
+        }
+        result.rms = (uint16_t)sqrtf((float)(energy / windowSize));
+
+        // Difference function, then the cumulative mean normalized difference in place
+        uint64_t runningSum = 0;
+        for (uint16_t tau = 1; tau <= _maxLag; tau++) {
+            uint32_t d = 0;
+            const int16_t* a = _scaled;
+            const int16_t* b = _scaled + tau;
+            for (uint16_t j = 0; j < windowSize; j++) {
+                int32_t delta = a[j] - b[j];
+                d += (uint32_t)(delta * delta) >> 6;
+            }
+            runningSum += d;
+            _difference[tau] = runningSum == 0 ? 32768 : (uint32_t)(((uint64_t)d * tau << 15) / runningSum);
+        }
+
+        // First dip under the threshold, followed down to its minimum
+        uint16_t best = 0;
+        for (uint16_t tau = _minLag; tau <= _maxLag; tau++) {
+            if (_difference[tau] < _thresholdQ15) {
+                while (tau + 1 <= _maxLag && _difference[tau + 1] < _difference[tau]) {
+                    tau++;
+                }
+                best = tau;
+                break;
+            }
+        }
+        if (best == 0) {
+            return result;
+        }
+
+        // Parabolic interpolation for a fractional lag
+        float lag = best;
+        if (best > 1 && best < _maxLag) {
+            float left = _difference[best - 1];
+            float middle = _difference[best];
+            float right = _difference[best + 1];
+            float denominator = left - 2.0f * middle + right;
+            if (denominator > 0.0f) {
+                lag += 0.5f * (left - right) / denominator;
+            }
+        }
+        result.frequencyHz = _sampleRateHz / lag;
+        result.aperiodicityQ15 = _difference[best] > 32768 ? 32768 : _difference[best];
+        return result;
+    }
+
+private:
+    uint32_t _sampleRateHz;
+    uint16_t _minLag;
+    uint16_t _maxLag;
+    uint32_t _thresholdQ15 = 4915; // 0.15
+    int16_t _scaled[bufferSize];
+    uint32_t _difference[maxLag];
+};
+
+#endif
@@ -0,0 +1,48 @@
+#ifndef PULSEMODULATOR_H
+#define PULSEMODULATOR_H
+
+#include <stdint.h>
+
+// First order sigma-delta on the positive half of the waveform. The pulse density follows the signal so the spark
+// reproduces it, and silence makes no pulses at all.
+// Plain C++ so host tools can render exactly the pulse train the coil would play.
+class PulseModulator {
+public:
+    // Pulse rate at full scale, capped at one pulse per sample
+    void setMaxPulseRate(uint32_t pulsesPerSecond, uint32_t sampleRateHz) {
+        uint64_t density = ((uint64_t)pulsesPerSecond << 16) / sampleRateHz;
+        _densityQ16 = density > unity ? unity : (uint32_t)density;
+    }
+
+    // Samples at or below this are treated as silence, keeps hiss from ticking the coil
+    void setGate(int16_t gate) {
+        _gate = gate;
+    }
+
+    void reset() {
+        _accumulator = 0;
+    }
+
+    // One sample in, true when a pulse should fire
+    bool step(int16_t sample) {
+        if (sample <= _gate) {
+            return false;
+        }
+
+        // The positive half spans the full density range
+        _accumulator += ((uint32_t)sample * 2 * _densityQ16) >> 16;
+        if (_accumulator < unity) {
+            return false;
+        }
+        _accumulator -= unity;
+        return true;
+    }
+
+private:
+    static const uint32_t unity = 1 << 16;
+    uint32_t _densityQ16 = 0;
+    uint32_t _accumulator = 0;
+    int16_t _gate = 0;
+};
+
+#endif
@@ -59,6 +59,9 @@ inline void ps_free_impl(void* ptr) {
 
 #else
 // Non-ESP32 platform: use regular malloc
+#include <cstddef>
+#include <cstdlib>
+
 inline void* ps_malloc_impl(size_t size) {
     return malloc(size);
 }
@@ -0,0 +1,201 @@
+#include "Fakes.h"
+#include "Plant.h"
+#include "AdcEngine.h"
+#include "AudioStream.h"
+#include "Metrics.h"
+#include "Scope.h"
+#include "Sequence.h"
+#include "Telemetry.h"
+#include "Thermal.h"
+#include "VBus.h"
+
+namespace {
+    // Same defaults as the firmware
+    BleControl::ControlState controlState { false, 100, 2, 90, 110, false, false, 0, false, 0, 20 };
+    std::vector<Fakes::SweepPoint> points;
+    bool ended = false;
+    uint32_t bursts = 0;
+    uint64_t onMicros = 0;
+}
+
+namespace Fakes {
+    BleControl::ControlState& state() {
+        return controlState;
+    }
+
+    const std::vector<SweepPoint>& sweepPoints() {
+        return points;
+    }
+
+    bool sweepEnded() {
+        return ended;
+    }
+
+    uint32_t thermalBursts() {
+        return bursts;
+    }
+
+    uint64_t thermalOnMicros() {
+        return onMicros;
+    }
+}
+
+namespace BleControl {
+    ControlState getState() {
+        return controlState;
+    }
+
+    void setBps(uint16_t newBps) {
+        controlState.bps = newBps;
+    }
+
+    void setBurstEnabled(bool newBurstEnabled) {
+        controlState.burstEnabled = newBurstEnabled;
+    }
+
+    void setPhaseLead(uint16_t newPhaseLead) {
+        controlState.phaseLead = newPhaseLead;
+    }
+
+    void setBurstLength(uint16_t newBurstLength) {
+        controlState.burstLength = newBurstLength;
+    }
+
+    void resetStartFrequencySweep() {
+        controlState.startFrequencySweep = false;
+    }
+
+    bool queueFrequencySweepData(uint32_t frequencyHz, uint16_t ctMilliVolts, int16_t errorHz) {
+        points.push_back({ frequencyHz, ctMilliVolts, errorHz });
+        return true;
+    }
+
+    bool endFrequencySweepData() {
+        ended = true;
+        return true;
+    }
+}
+
+// Only the CT peak detector is wired to the plant, the other pins read zero
+namespace AdcEngine {
+    bool running = true;
+
+    // Only what the sampler task would have received by now
+    uint16_t latestRaw(uint8_t pin) {
+        uint16_t raw = 0;
+        Plant::adcSample(Plant::adcDeliveredCount() - 1, raw);
+        return raw;
+    }
+
+    uint32_t getSampleCount(uint8_t pin) {
+        return Plant::adcDeliveredCount();
+    }
+
+    // The firmware's anchor is late by the shortest delivery time, so it maps times to indices that early
+    uint32_t sampleIndexAt(uint8_t pin, uint32_t timeMicros) {
+        const Plant::Config& config = Plant::getConfig();
+        uint64_t nanos = (uint64_t)timeMicros * 1000;
+        nanos = nanos > config.adcDeliveryNanos ? nanos - config.adcDeliveryNanos : 0;
+        return (uint32_t)((nanos + config.adcSamplePeriodNanos - 1) / config.adcSamplePeriodNanos);
+    }
+
+    bool sampleAt(uint8_t pin, uint32_t index, uint16_t& raw) {
+        return index < Plant::adcDeliveredCount() && Plant::adcSample(index, raw);
+    }
+
+    uint16_t toMilliVolts(uint8_t pin, uint16_t raw) {
+        return (uint16_t)Plant::rawToMilliVolts(raw);
+    }
+
+    uint16_t maxMilliVolts(uint8_t pin, uint8_t samples) {
+        uint16_t peak = 0;
+        uint32_t newest = Plant::adcDeliveredCount() - 1;
+        for (uint8_t i = 0; i < samples; i++) {
+            uint16_t raw;
+            if (Plant::adcSample(newest - i, raw)) {
+                peak = max(peak, raw);
+            }
+        }
+        return toMilliVolts(pin, peak);
+    }
+
+    uint32_t getSamplePeriodNanos() {
+        return Plant::getConfig().adcSamplePeriodNanos;
+    }
+}
+
+namespace Thermal {
+    volatile uint16_t maxDutyPermille = 100; // The firmware's cap while the thermistors can't be read
+
+    void addBurst(uint16_t burstLengthMicros, uint16_t peakCurrent) {
+        bursts++;
+        onMicros += burstLengthMicros;
+    }
+
+    uint16_t getMaxDutyPermille() {
+        return maxDutyPermille;
+    }
+}
+
+namespace VBus {
+    void update() {
+    }
+
+    uint16_t compensateBurstLength(uint16_t burstLength) {
+        return burstLength;
+    }
+}
+
+namespace Scope {
+    void trigger(uint16_t burstLength) {
+    }
+
+    void recordEdge(uint32_t cycles) {
+    }
+
+    void burstEnd() {
+    }
+
+    void process() {
+    }
+}
+
+namespace AudioStream {
+    bool isActive() {
+        return false;
+    }
+
+    bool isPulsing() {
+        return false;
+    }
+}
+
+namespace Sequence {
+    bool isMuted() {
+        return false;
+    }
+}
+
+namespace Metrics {
+    void recordZcdEdge(uint32_t gapCycles) {
+    }
+
+    void recordOcdInterrupt() {
+    }
+
+    void recordBurst(bool cutShort) {
+    }
+
+    void recordSkippedBurst() {
+    }
+
+    void recordLateness(uint32_t micros) {
+    }
+}
+
+namespace Telemetry {
+    volatile uint8_t enabledStreams = 0;
+
+    void push(uint8_t stream, uint16_t value) {
+    }
+}
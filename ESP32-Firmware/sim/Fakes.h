@@ -0,0 +1,25 @@
+#ifndef SIM_FAKES_H
+#define SIM_FAKES_H
+
+#include "BleControl.h"
+#include <vector>
+
+// Stand-ins for the modules around the control core: BLE holds the state the scenarios set,
+// the ADC samples the plant's peak detector, the rest are no-ops that never hold a burst back
+namespace Fakes {
+    struct SweepPoint {
+        uint32_t frequencyHz;
+        uint16_t ctMilliVolts;
+        int16_t errorHz;
+    };
+
+    BleControl::ControlState& state();
+    const std::vector<SweepPoint>& sweepPoints();
+    bool sweepEnded();
+
+    // Bursts Thermal was told about, and their total on-time
+    uint32_t thermalBursts();
+    uint64_t thermalOnMicros();
+}
+
+#endif
@@ -0,0 +1,431 @@
+#include "Hal.h"
+#include "Plant.h"
+#include <driver/mcpwm.h>
+#include <driver/periph_ctrl.h>
+#include <hal/adc_hal.h>
+#include <esp32-hal-adc.h>
+#include <esp_adc_cal.h>
+#include <nvs.h>
+#include <esp_timer.h>
+#include <stdarg.h>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+SimEsp ESP;
+SimSerial Serial;
+
+struct SimTask {
+    const char* name;
+    TaskFunction_t function;
+    void* parameters;
+    UBaseType_t priority;
+    uint64_t wakeNanos;
+    uint64_t lastRun;
+    bool finished;
+    bool killed;
+    std::condition_variable wake;
+};
+
+namespace {
+    const uint8_t pinCount = 49;
+
+    struct TaskKilled {};
+
+    struct Interrupt {
+        void (*handler)(void);
+        int mode;
+        bool pending;
+    };
+
+    // Pins
+    uint8_t pinModes[pinCount];
+    bool pinLevels[pinCount];
+    Interrupt interrupts[pinCount];
+    bool inIsr = false;
+
+    // MCPWM unit 0 timer 0, a square wave on 0A and its complement on 0B
+    struct Pwm {
+        bool running;
+        uint32_t frequencyHz;
+        uint64_t startNanos;
+        uint32_t deadTimeNanos;
+        unsigned long groupResolutionHz;
+        int pins[2];
+    };
+    Pwm pwm = { false, 100000, 0, 0, 160000000, { -1, -1 } };
+
+    // Tasks, the main thread is loopTask
+    std::mutex taskMutex;
+    SimTask loopTask = { "loopTask", nullptr, nullptr, 1, 0, 0, false, false, {} };
+    std::vector<SimTask*> tasks = { &loopTask };
+    SimTask* current = &loopTask;
+    uint64_t switches = 0;
+
+    void onPinChange(uint8_t pin, bool level) {
+        Interrupt& interrupt = interrupts[pin];
+        if (interrupt.handler == nullptr) {
+            return;
+        }
+        if ((interrupt.mode == RISING && !level) || (interrupt.mode == FALLING && level)) {
+            return;
+        }
+        // The GPIO status bit latches one edge per pin while the dispatcher is busy, it serves them before returning
+        interrupt.pending = true;
+        if (inIsr) {
+            return;
+        }
+        inIsr = true;
+        bool served = true;
+        while (served) {
+            served = false;
+            for (Interrupt& next : interrupts) {
+                if (next.pending && next.handler != nullptr) {
+                    next.pending = false;
+                    Hal::advance(Hal::isrLatencyNanos);
+                    next.handler();
+                    served = true;
+                }
+            }
+        }
+        inIsr = false;
+    }
+
+    // Runs the unfinished task that wakes first (highest priority on a tie, then the one that waited longest).
+    // Call with the lock held, returns once the caller has the CPU back
+    void schedule(std::unique_lock<std::mutex>& lock, SimTask* self) {
+        SimTask* next = nullptr;
+        for (SimTask* task : tasks) {
+            if (task->finished) {
+                continue;
+            }
+            if (next == nullptr || task->wakeNanos < next->wakeNanos
+                || (task->wakeNanos == next->wakeNanos && (task->priority > next->priority
+                    || (task->priority == next->priority && task->lastRun < next->lastRun)))) {
+                next = task;
+            }
+        }
+        if (next->wakeNanos > Plant::nowNanos()) {
+            lock.unlock();
+            Hal::advance(next->wakeNanos - Plant::nowNanos());
+            lock.lock();
+        }
+        next->lastRun = ++switches;
+        if (next == self) {
+            return;
+        }
+        current = next;
+        next->wake.notify_one();
+        if (self->finished) {
+            return;
+        }
+        self->wake.wait(lock, [self] { return current == self; });
+        if (self->killed) {
+            throw TaskKilled();
+        }
+    }
+
+    void block(uint64_t wakeNanos) {
+        std::unique_lock<std::mutex> lock(taskMutex);
+        current->wakeNanos = wakeNanos;
+        schedule(lock, current);
+    }
+
+    void taskThread(SimTask* task) {
+        {
+            std::unique_lock<std::mutex> lock(taskMutex);
+            task->wake.wait(lock, [task] { return current == task; });
+        }
+        try {
+            if (!task->killed) {
+                task->function(task->parameters);
+            }
+        } catch (const TaskKilled&) {
+        }
+        std::unique_lock<std::mutex> lock(taskMutex);
+        task->finished = true;
+        schedule(lock, task);
+    }
+}
+
+namespace Hal {
+    uint64_t nanos() {
+        return Plant::nowNanos();
+    }
+
+    void advance(uint64_t nanos) {
+        Plant::advanceTo(Plant::nowNanos() + nanos, onPinChange);
+    }
+
+    bool outputLevel(uint8_t pin, uint64_t atNanos) {
+        if (pwm.running && (pin == pwm.pins[0] || pin == pwm.pins[1])) {
+            uint64_t periodNanos = 1000000000ULL / pwm.frequencyHz;
+            uint64_t phase = (atNanos - pwm.startNanos) % periodNanos;
+            uint64_t half = periodNanos / 2;
+            // Both rising edges held off by the dead time
+            if (pin == pwm.pins[0]) {
+                return phase >= pwm.deadTimeNanos && phase < half;
+            }
+            return phase >= half + pwm.deadTimeNanos;
+        }
+        return pin < pinCount && pinModes[pin] == OUTPUT && pinLevels[pin];
+    }
+
+    bool pwmRunning() {
+        return pwm.running && (pwm.pins[0] >= 0 || pwm.pins[1] >= 0);
+    }
+
+    uint8_t taskCount() {
+        std::unique_lock<std::mutex> lock(taskMutex);
+        uint8_t count = 0;
+        for (SimTask* task : tasks) {
+            if (!task->finished && task != current) {
+                count++;
+            }
+        }
+        return count;
+    }
+}
+
+// Arduino
+void pinMode(uint8_t pin, uint8_t mode) {
+    if (pin < pinCount) {
+        pinModes[pin] = mode;
+    }
+}
+
+void digitalWrite(uint8_t pin, uint8_t value) {
+    Hal::advance(Hal::pinWriteNanos);
+    if (pin < pinCount) {
+        pinLevels[pin] = value != 0;
+    }
+}
+
+int digitalRead(uint8_t pin) {
+    if (pin < pinCount && pinModes[pin] == OUTPUT) {
+        return pinLevels[pin];
+    }
+    return Plant::pinLevel(pin);
+}
+
+void attachInterrupt(uint8_t pin, void (*handler)(void), int mode) {
+    if (pin < pinCount) {
+        interrupts[pin] = { handler, mode, false };
+    }
+}
+
+void detachInterrupt(uint8_t pin) {
+    if (pin < pinCount) {
+        interrupts[pin] = { nullptr, 0, false };
+    }
+}
+
+void pinMatrixOutDetach(uint8_t pin, bool invertOut, bool invertEnable) {
+    for (int& pwmPin : pwm.pins) {
+        if (pwmPin == pin) {
+            pwmPin = -1;
+        }
+    }
+}
+
+unsigned long millis() {
+    Hal::advance(Hal::timeReadNanos);
+    return (unsigned long)(Plant::nowNanos() / 1000000);
+}
+
+unsigned long micros() {
+    Hal::advance(Hal::timeReadNanos);
+    return (unsigned long)(uint32_t)(Plant::nowNanos() / 1000);
+}
+
+void delay(uint32_t ms) {
+    block(Plant::nowNanos() + (uint64_t)ms * 1000000);
+}
+
+void delayMicroseconds(uint32_t us) {
+    // A busy-wait on the coil too, nothing else gets to run
+    Hal::advance((uint64_t)us * 1000);
+}
+
+int64_t esp_timer_get_time() {
+    Hal::advance(Hal::timeReadNanos);
+    return (int64_t)(Plant::nowNanos() / 1000);
+}
+
+uint32_t getCpuFrequencyMhz() {
+    return Hal::cpuFrequencyMHz;
+}
+
+uint32_t SimEsp::getCycleCount() {
+    Hal::advance(Hal::cycleReadNanos);
+    return (uint32_t)(Plant::nowNanos() * Hal::cpuFrequencyMHz / 1000);
+}
+
+size_t SimSerial::write(const uint8_t* data, size_t length) {
+    return fwrite(data, 1, length, stdout);
+}
+
+int SimSerial::printf(const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    int length = vprintf(format, args);
+    va_end(args);
+    return length;
+}
+
+// FreeRTOS
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t function, const char* name, uint32_t stackDepth, void* parameters, UBaseType_t priority, TaskHandle_t* handle, BaseType_t core) {
+    SimTask* task = new SimTask();
+    task->name = name;
+    task->function = function;
+    task->parameters = parameters;
+    task->priority = priority;
+    task->wakeNanos = Plant::nowNanos();
+    {
+        std::unique_lock<std::mutex> lock(taskMutex);
+        tasks.push_back(task);
+    }
+    std::thread(taskThread, task).detach();
+    if (handle != nullptr) {
+        *handle = task;
+    }
+    return pdPASS;
+}
+
+BaseType_t xTaskCreate(TaskFunction_t function, const char* name, uint32_t stackDepth, void* parameters, UBaseType_t priority, TaskHandle_t* handle) {
+    return xTaskCreatePinnedToCore(function, name, stackDepth, parameters, priority, handle, 0);
+}
+
+void vTaskDelete(TaskHandle_t task) {
+    std::unique_lock<std::mutex> lock(taskMutex);
+    if (task == nullptr || task == current) {
+        current->killed = true;
+        lock.unlock();
+        throw TaskKilled();
+    }
+    bool known = false;
+    for (SimTask* candidate : tasks) {
+        known |= candidate == task;
+    }
+    if (!known || task->finished) {
+        return;
+    }
+    // Woken straight away so it unwinds out of its delay, the deleter carries on after it
+    task->killed = true;
+    task->wakeNanos = 0;
+    current->wakeNanos = Plant::nowNanos();
+    schedule(lock, current);
+}
+
+void vTaskDelay(TickType_t ticks) {
+    block(Plant::nowNanos() + (uint64_t)ticks * portTICK_PERIOD_MS * 1000000);
+}
+
+TickType_t xTaskGetTickCountFromISR() {
+    return (TickType_t)(Plant::nowNanos() / (portTICK_PERIOD_MS * 1000000));
+}
+
+// MCPWM
+esp_err_t mcpwm_group_set_resolution(mcpwm_unit_t unit, unsigned long resolution) {
+    pwm.groupResolutionHz = resolution;
+    return ESP_OK;
+}
+
+esp_err_t mcpwm_timer_set_resolution(mcpwm_unit_t unit, mcpwm_timer_t timer, unsigned long resolution) {
+    return ESP_OK;
+}
+
+esp_err_t mcpwm_init(mcpwm_unit_t unit, mcpwm_timer_t timer, const mcpwm_config_t* config) {
+    pwm.frequencyHz = config->frequency;
+    pwm.startNanos = Plant::nowNanos();
+    pwm.running = true;
+    return ESP_OK;
+}
+
+esp_err_t mcpwm_start(mcpwm_unit_t unit, mcpwm_timer_t timer) {
+    pwm.startNanos = Plant::nowNanos();
+    pwm.running = true;
+    return ESP_OK;
+}
+
+esp_err_t mcpwm_stop(mcpwm_unit_t unit, mcpwm_timer_t timer) {
+    pwm.running = false;
+    return ESP_OK;
+}
+
+esp_err_t mcpwm_set_frequency(mcpwm_unit_t unit, mcpwm_timer_t timer, uint32_t frequency) {
+    pwm.frequencyHz = frequency;
+    return ESP_OK;
+}
+
+esp_err_t mcpwm_set_duty(mcpwm_unit_t unit, mcpwm_timer_t timer, mcpwm_generator_t generator, float duty) {
+    return ESP_OK;
+}
+
+esp_err_t mcpwm_set_duty_type(mcpwm_unit_t unit, mcpwm_timer_t timer, mcpwm_generator_t generator, mcpwm_duty_type_t type) {
+    return ESP_OK;
+}
+
+esp_err_t mcpwm_gpio_init(mcpwm_unit_t unit, mcpwm_io_signals_t signal, int gpio) {
+    pwm.pins[signal == MCPWM0A ? 0 : 1] = gpio;
+    return ESP_OK;
+}
+
+esp_err_t mcpwm_deadtime_enable(mcpwm_unit_t unit, mcpwm_timer_t timer, mcpwm_deadtime_type_t type, uint32_t redTicks, uint32_t fedTicks) {
+    pwm.deadTimeNanos = (uint64_t)redTicks * 1000000000ULL / pwm.groupResolutionHz;
+    return ESP_OK;
+}
+
+// ADC, only FastAnalogRead's calibration path runs on the host
+sens_dev_t SENS;
+
+void adc_power_acquire(void) {
+}
+
+void periph_module_enable(periph_module_t module) {
+}
+
+void analogReadResolution(uint8_t bits) {
+}
+
+void analogSetAttenuation(adc_attenuation_t attenuation) {
+}
+
+void analogSetPinAttenuation(uint8_t pin, adc_attenuation_t attenuation) {
+}
+
+uint16_t analogRead(uint8_t pin) {
+    return 0;
+}
+
+esp_adc_cal_value_t esp_adc_cal_characterize(adc_unit_t unit, adc_atten_t atten, adc_bits_width_t width,
+    uint32_t defaultVref, esp_adc_cal_characteristics_t* chars) {
+    // A plausible 11 dB fit, the calibration table only needs a realistic shape
+    chars->adc_num = unit;
+    chars->atten = atten;
+    chars->bit_width = width;
+    chars->coeff_a = 800000;
+    chars->coeff_b = 0;
+    chars->vref = defaultVref;
+    return ESP_ADC_CAL_VAL_EFUSE_TP_FIT;
+}
+
+esp_err_t nvs_open(const char* name, nvs_open_mode_t mode, nvs_handle_t* handle) {
+    return ESP_ERR_NVS_NOT_FOUND;
+}
+
+esp_err_t nvs_get_blob(nvs_handle_t handle, const char* key, void* value, size_t* length) {
+    return ESP_ERR_NVS_NOT_FOUND;
+}
+
+esp_err_t nvs_set_blob(nvs_handle_t handle, const char* key, const void* value, size_t length) {
+    return ESP_OK;
+}
+
+esp_err_t nvs_commit(nvs_handle_t handle) {
+    return ESP_OK;
+}
+
+void nvs_close(nvs_handle_t handle) {
+}
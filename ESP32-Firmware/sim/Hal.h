@@ -0,0 +1,31 @@
+#ifndef SIM_HAL_H
+#define SIM_HAL_H
+
+#include <Arduino.h>
+
+// Simulator side of sim/hal/Arduino.h: one virtual clock shared by the plant and the firmware's tasks.
+// Tasks are threads that take turns, one runs at a time and the others wait in delay() or vTaskDelay().
+// There is no preemption: a task that busy-waits keeps the CPU, as the burst does on the coil, and a newly
+// created or woken task runs at the next blocking call. Pin interrupts run inline on whichever task moved the clock.
+namespace Hal {
+    // What reading the clock, a cycle count and writing a pin cost, so busy-waits make progress
+    const uint32_t timeReadNanos = 100;
+    const uint32_t cycleReadNanos = 25;
+    const uint32_t pinWriteNanos = 30;
+    // GPIO interrupt dispatch to the handler's first line
+    const uint32_t isrLatencyNanos = 700;
+    const uint32_t cpuFrequencyMHz = 240;
+
+    uint64_t nanos();
+    // Burns time on the running task, the plant and interrupts keep going
+    void advance(uint64_t nanos);
+
+    // Level the firmware drives on a pin at a time, whether from GPIO or the MCPWM
+    bool outputLevel(uint8_t pin, uint64_t atNanos);
+    bool pwmRunning();
+
+    // Tasks still alive besides the caller
+    uint8_t taskCount();
+}
+
+#endif
@@ -0,0 +1,282 @@
+#include "Plant.h"
+#include "Hal.h"
+#include <math.h>
+#include <string.h>
+
+namespace Plant {
+    namespace {
+        const float idleAmps = 1e-3f;
+        const float idleSecondaryAmps = 1e-4f;
+        const float idleSecondaryVolts = 1.0f; // About the same energy, the secondary current passes zero at its peak voltage
+        const uint8_t adcHistory = 64;
+        const uint8_t maxPendingEdges = 16;
+        const uint64_t burstGapNanos = 1000; // Gates off on an empty tank for this long ends a burst
+
+        struct Edge {
+            uint64_t nanos;
+            bool level;
+        };
+
+        Config config;
+        uint64_t now = 0;
+        // Tank state
+        float primaryCurrent = 0.0f;
+        float primaryCapVolts = 0.0f;
+        float secondaryCurrent = 0.0f;
+        float secondaryCapVolts = 0.0f;
+        float mutualInductance = 0.0f;
+        float determinant = 1.0f;
+        // Sensing
+        float peakDetectorVolts = 0.0f;
+        bool comparatorLevel = false;
+        bool zcdLevel = false;
+        bool ocdLevel = false;
+        Edge pendingEdges[maxPendingEdges];
+        uint8_t pendingCount = 0;
+        uint16_t adcRaw[adcHistory];
+        uint32_t adcCount = 0;
+        // Metrics
+        Stats stats;
+        Burst burstLog[maxBurstLog];
+        uint8_t burstHead = 0;
+        uint8_t burstCount = 0;
+        bool inBurst = false;
+        uint64_t quietSince = 0;
+        Burst currentBurst;
+
+        uint16_t toRaw(float volts) {
+            float raw = volts * 1000.0f / config.adcFullScaleMilliVolts * 4095.0f;
+            return (uint16_t)(raw < 0.0f ? 0.0f : (raw > 4095.0f ? 4095.0f : raw));
+        }
+
+        void recordBurst() {
+            burstLog[burstHead] = currentBurst;
+            burstHead = (burstHead + 1) % maxBurstLog;
+            if (burstCount < maxBurstLog) {
+                burstCount++;
+            }
+            stats.bursts++;
+        }
+
+        void step(float dt) {
+            bool gateA = Hal::outputLevel(config.gateAPin, now);
+            bool gateB = Hal::outputLevel(config.gateBPin, now);
+            bool driving = gateA != gateB;
+            if (gateA && gateB) {
+                stats.shootThroughNanos += stepNanos;
+            }
+
+            // Both gates off, the body diodes return the current to the bus until it reaches zero
+            float bridgeVolts = 0.0f;
+            bool primaryOpen = false;
+            if (driving) {
+                bridgeVolts = gateA ? config.busVolts : -config.busVolts;
+            } else if (fabsf(primaryCurrent) > idleAmps) {
+                bridgeVolts = primaryCurrent > 0.0f ? -config.busVolts : config.busVolts;
+            } else {
+                primaryOpen = true;
+                primaryCapVolts -= primaryCapVolts / (config.primaryBleedOhms * config.primaryCapacitance) * dt;
+            }
+
+            // Lp dIp + M dIs = Vp, M dIp + Ls dIs = Vs
+            float primaryVolts = bridgeVolts - primaryCapVolts - config.primaryResistance * primaryCurrent;
+            float secondaryVolts = -secondaryCapVolts - config.secondaryResistance * secondaryCurrent;
+            float dIp;
+            float dIs;
+            if (primaryOpen) {
+                dIp = 0.0f;
+                dIs = secondaryVolts / config.secondaryInductance;
+            } else {
+                dIp = (config.secondaryInductance * primaryVolts - mutualInductance * secondaryVolts) / determinant;
+                dIs = (config.primaryInductance * secondaryVolts - mutualInductance * primaryVolts) / determinant;
+            }
+            float previousCurrent = primaryCurrent;
+            primaryCurrent += dIp * dt;
+            secondaryCurrent += dIs * dt;
+            // Freewheeling stops at the zero crossing, the diodes don't conduct backwards
+            if (!driving && !primaryOpen && (previousCurrent > 0.0f) != (primaryCurrent > 0.0f)) {
+                primaryCurrent = 0.0f;
+            }
+            // Semi-implicit, the capacitors see the updated currents
+            primaryCapVolts += primaryCurrent / config.primaryCapacitance * dt;
+            secondaryCapVolts += secondaryCurrent / config.secondaryCapacitance * dt;
+
+            float amps = fabsf(primaryCurrent);
+            stats.peakAmps = fmaxf(stats.peakAmps, amps);
+            stats.peakSecondaryVolts = fmaxf(stats.peakSecondaryVolts, fabsf(secondaryCapVolts));
+
+            // CT into the burden, the peak detector only charges on the positive half
+            float ctVolts = primaryCurrent / config.ctTurnsRatio * config.ctBurdenOhms;
+            if (Hal::outputLevel(config.ctResetPin, now)) {
+                peakDetectorVolts = 0.0f;
+            } else if (ctVolts > peakDetectorVolts) {
+                peakDetectorVolts = ctVolts;
+            }
+            ocdLevel = config.ocdComparatorAmps > 0.0f && amps >= config.ocdComparatorAmps;
+
+            // The comparator switches now, the pin follows after the input path delay
+            bool level = primaryCurrent > 0.0f;
+            if (level != comparatorLevel && !primaryOpen) {
+                comparatorLevel = level;
+                if (pendingCount < maxPendingEdges) {
+                    pendingEdges[pendingCount++] = { now + config.zcdDelayNanos, level };
+                }
+                if (inBurst) {
+                    currentBurst.zcdEdges++;
+                }
+            }
+
+            // A burst runs from the first gate on to the tank current dying out with the gates off
+            bool gateOn = gateA || gateB;
+            if (gateOn && !inBurst) {
+                inBurst = true;
+                currentBurst = { now, now, 0.0f, 0, 0 };
+            }
+            if (inBurst) {
+                currentBurst.peakAmps = fmaxf(currentBurst.peakAmps, amps);
+                if (config.limitAmps > 0.0f && amps > config.limitAmps && currentBurst.overLimitNanos == 0) {
+                    currentBurst.overLimitNanos = now;
+                }
+                if (gateOn || !primaryOpen) {
+                    quietSince = now;
+                    if (gateOn) {
+                        currentBurst.endNanos = now;
+                    }
+                } else if (now - quietSince >= burstGapNanos) {
+                    inBurst = false;
+                    recordBurst();
+                }
+            }
+        }
+
+        bool idle() {
+            return !inBurst && !Hal::pwmRunning() && !Hal::outputLevel(config.gateAPin, now) && !Hal::outputLevel(config.gateBPin, now)
+                && fabsf(primaryCurrent) <= idleAmps && fabsf(secondaryCurrent) < idleSecondaryAmps
+                && fabsf(secondaryCapVolts) < idleSecondaryVolts && pendingCount == 0;
+        }
+    }
+
+    void configure(const Config& newConfig) {
+        config = newConfig;
+        reset();
+    }
+
+    const Config& getConfig() {
+        return config;
+    }
+
+    void reset() {
+        now = 0;
+        primaryCurrent = primaryCapVolts = secondaryCurrent = secondaryCapVolts = 0.0f;
+        mutualInductance = config.coupling * sqrtf(config.primaryInductance * config.secondaryInductance);
+        determinant = config.primaryInductance * config.secondaryInductance - mutualInductance * mutualInductance;
+        peakDetectorVolts = 0.0f;
+        comparatorLevel = zcdLevel = ocdLevel = false;
+        pendingCount = 0;
+        adcCount = 0;
+        memset(&stats, 0, sizeof(stats));
+        clearBursts();
+        inBurst = false;
+    }
+
+    void advanceTo(uint64_t nanos, void (*onPinChange)(uint8_t pin, bool level)) {
+        while (now < nanos) {
+            // Next ADC conversion, the sampled value is the peak detector at that instant
+            uint64_t nextSample = (uint64_t)adcCount * config.adcSamplePeriodNanos;
+            if (now >= nextSample) {
+                adcRaw[adcCount % adcHistory] = toRaw(peakDetectorVolts);
+                adcCount++;
+                continue;
+            }
+
+            // Nothing moves in an idle tank, skip to whatever happens next
+            if (idle()) {
+                // The peak detector's reset and the bleeders don't need the tank stepped
+                if (Hal::outputLevel(config.ctResetPin, now)) {
+                    peakDetectorVolts = 0.0f;
+                }
+                uint64_t until = nextSample < nanos ? nextSample : nanos;
+                primaryCapVolts *= expf(-(float)(until - now) * 1e-9f / (config.primaryBleedOhms * config.primaryCapacitance));
+                now = until;
+                continue;
+            }
+
+            bool ocdBefore = ocdLevel;
+            step(stepNanos * 1e-9f);
+            now += stepNanos;
+            if (ocdLevel != ocdBefore && config.ocdPin != 0) {
+                onPinChange(config.ocdPin, ocdLevel);
+            }
+            while (pendingCount > 0 && pendingEdges[0].nanos <= now) {
+                zcdLevel = pendingEdges[0].level;
+                memmove(&pendingEdges[0], &pendingEdges[1], (pendingCount - 1) * sizeof(Edge));
+                pendingCount--;
+                onPinChange(config.zcdPin, zcdLevel);
+            }
+        }
+    }
+
+    bool pinLevel(uint8_t pin) {
+        if (pin == config.zcdPin) {
+            return zcdLevel;
+        }
+        if (pin == config.ocdPin && config.ocdPin != 0) {
+            return ocdLevel;
+        }
+        return false;
+    }
+
+    uint32_t adcSampleCount() {
+        return adcCount;
+    }
+
+    uint32_t adcDeliveredCount() {
+        if (now < config.adcDeliveryNanos) {
+            return 0;
+        }
+        uint32_t taken = (uint32_t)((now - config.adcDeliveryNanos) / config.adcSamplePeriodNanos) + 1;
+        taken = taken < adcCount ? taken : adcCount;
+        return taken - taken % config.adcFrameSamples;
+    }
+
+    bool adcSample(uint32_t index, uint16_t& raw) {
+        if ((int32_t)(adcCount - index) <= 0 || adcCount - index > adcHistory) {
+            return false;
+        }
+        raw = adcRaw[index % adcHistory];
+        return true;
+    }
+
+    float rawToMilliVolts(uint16_t raw) {
+        return raw * config.adcFullScaleMilliVolts / 4095.0f;
+    }
+
+    uint64_t nowNanos() {
+        return now;
+    }
+
+    float primaryAmps() {
+        return primaryCurrent;
+    }
+
+    Stats getStats() {
+        return stats;
+    }
+
+    uint8_t getBursts(const Burst*& bursts) {
+        // Unrolled into order so callers can walk it front to back
+        static Burst ordered[maxBurstLog];
+        uint8_t start = (burstHead + maxBurstLog - burstCount) % maxBurstLog;
+        for (uint8_t i = 0; i < burstCount; i++) {
+            ordered[i] = burstLog[(start + i) % maxBurstLog];
+        }
+        bursts = ordered;
+        return burstCount;
+    }
+
+    void clearBursts() {
+        burstHead = 0;
+        burstCount = 0;
+        stats.bursts = 0;
+    }
+}
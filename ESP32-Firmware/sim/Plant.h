@@ -0,0 +1,78 @@
+#ifndef SIM_PLANT_H
+#define SIM_PLANT_H
+
+#include <stdint.h>
+
+// Discrete-time DRSSTC: a half/full bridge into the series primary tank, loosely coupled to the secondary,
+// with the primary current feeding the ZCD comparator and, through the CT, the peak detector the ADC samples.
+namespace Plant {
+    struct Config {
+        float busVolts = 170.0f;
+        float primaryInductance = 6e-6f;
+        float primaryCapacitance = 47e-9f;   // ~300 kHz with the inductance above
+        float primaryResistance = 0.05f;
+        float primaryBleedOhms = 100e3f;     // Bleeders across the MMC, it holds its charge between bursts otherwise
+        float secondaryInductance = 30e-3f;
+        float secondaryCapacitance = 9.4e-12f; // Tuned to the primary
+        float secondaryResistance = 400.0f;    // Winding loss plus streamer loading
+        float coupling = 0.15f;
+        float ctTurnsRatio = 512.0f;
+        float ctBurdenOhms = 3.3f;
+        float adcFullScaleMilliVolts = 3100.0f;
+        uint32_t zcdDelayNanos = 80;          // Comparator and GPIO input path
+        uint32_t adcSamplePeriodNanos = 50000; // Per pin, 20 kHz like the firmware's round robin
+        uint32_t adcFrameSamples = 2;          // Per pin, the firmware's 8 conversion DMA frames over four pins
+        uint32_t adcDeliveryNanos = 20000;     // From a frame's last conversion to the sampler task having it, within AdcEngine::maxAnchorLateMicros
+        float ocdComparatorAmps = 0.0f;        // 0 when the comparator isn't fitted
+        float limitAmps = 0.0f;                // Bursts note when they first pass this, 0 for never
+        // Gate pins: A high drives the bridge positive, B high negative
+        uint8_t gateAPin = 13;
+        uint8_t gateBPin = 14;
+        uint8_t zcdPin = 21;
+        uint8_t ctResetPin = 45;
+        uint8_t ocdPin = 0;
+    };
+
+    struct Burst {
+        uint64_t startNanos;
+        uint64_t endNanos;
+        float peakAmps;
+        uint32_t zcdEdges;
+        uint64_t overLimitNanos; // First past Config::limitAmps, 0 if it never was
+    };
+
+    struct Stats {
+        uint32_t bursts;
+        uint64_t shootThroughNanos; // Both gates on at once
+        float peakAmps;
+        float peakSecondaryVolts;
+    };
+
+    const uint32_t stepNanos = 5;
+    const uint8_t maxBurstLog = 255;
+
+    void configure(const Config& config);
+    const Config& getConfig();
+    void reset();
+
+    uint64_t nowNanos();
+    // Moves the plant to the given time, calls onPinChange for every comparator edge once it reaches its pin.
+    // Safe to re-enter from onPinChange, an ISR that burns time moves the plant on with it
+    void advanceTo(uint64_t nanos, void (*onPinChange)(uint8_t pin, bool level));
+
+    bool pinLevel(uint8_t pin);
+    // ADC samples of the peak detector, in raw counts, numbered from time zero
+    uint32_t adcSampleCount();
+    bool adcSample(uint32_t index, uint16_t& raw);
+    // Samples the firmware has received, whole frames only and each a delivery time after its last conversion
+    uint32_t adcDeliveredCount();
+    float rawToMilliVolts(uint16_t raw);
+
+    float primaryAmps();
+    Stats getStats();
+    // Oldest first, returns how many are logged (the newest maxBurstLog)
+    uint8_t getBursts(const Burst*& bursts);
+    void clearBursts();
+}
+
+#endif
@@ -0,0 +1,4 @@
+# C++ only flags for the native build. In build_flags -std=gnu++17 also reaches lib/FastAnalogRead's C and warns there
+Import("env")
+
+env.Append(CXXFLAGS=["-std=gnu++17"])
@@ -0,0 +1,106 @@
+#ifndef SIM_ARDUINO_H
+#define SIM_ARDUINO_H
+
+// The slice of the Arduino core and FreeRTOS the control modules use, backed by the simulator (sim/Hal.cpp).
+// Time is virtual: anything that reads the clock advances it a little, so busy-waits make progress,
+// and the plant steps (firing pin interrupts) whenever it moves.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+
+using std::min;
+using std::max;
+
+#define IRAM_ATTR
+#define DRAM_ATTR
+#define RTC_NOINIT_ATTR
+
+#define LOW 0
+#define HIGH 1
+#define INPUT 0x01
+#define OUTPUT 0x03
+#define RISING 0x01
+#define FALLING 0x02
+#define CHANGE 0x03
+
+#define constrain(amt, low, high) ((amt) < (low) ? (low) : ((amt) > (high) ? (high) : (amt)))
+#define digitalPinToInterrupt(pin) (pin)
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t value);
+int digitalRead(uint8_t pin);
+void attachInterrupt(uint8_t pin, void (*handler)(void), int mode);
+void detachInterrupt(uint8_t pin);
+void pinMatrixOutDetach(uint8_t pin, bool invertOut, bool invertEnable);
+
+unsigned long millis();
+unsigned long micros();
+void delay(uint32_t ms);
+void delayMicroseconds(uint32_t us);
+uint32_t getCpuFrequencyMhz();
+
+class SimEsp {
+public:
+    uint32_t getCycleCount();
+    uint32_t getCpuFreqMHz() { return getCpuFrequencyMhz(); }
+    uint32_t getFreeHeap() { return 320 * 1024; }
+    uint32_t getFreePsram() { return 2 * 1024 * 1024; }
+};
+extern SimEsp ESP;
+
+class SimSerial {
+public:
+    void begin(unsigned long) {}
+    int available() { return 0; }
+    int read() { return -1; }
+    size_t write(const uint8_t* data, size_t length);
+    int printf(const char* format, ...) __attribute__((format(printf, 2, 3)));
+    void print(const char* text) { printf("%s", text); }
+    void print(char c) { printf("%c", c); }
+    void print(int value) { printf("%d", value); }
+    void print(unsigned int value) { printf("%u", value); }
+    void print(long value) { printf("%ld", value); }
+    void print(unsigned long value) { printf("%lu", value); }
+    void print(double value, int digits = 2) { printf("%.*f", digits, value); }
+    template <typename T> void println(T value) { print(value); printf("\n"); }
+    void println(double value, int digits) { print(value, digits); printf("\n"); }
+    void println() { printf("\n"); }
+};
+extern SimSerial Serial;
+
+// FreeRTOS
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef uint32_t TickType_t;
+typedef struct SimTask* TaskHandle_t;
+typedef void (*TaskFunction_t)(void*);
+typedef int portMUX_TYPE;
+
+#define pdTRUE 1
+#define pdFALSE 0
+#define pdPASS 1
+#define portTICK_PERIOD_MS 1
+#define pdMS_TO_TICKS(ms) ((TickType_t)(ms))
+#define portMUX_INITIALIZER_UNLOCKED 0
+#define portNUM_PROCESSORS 1
+// One simulated core runs at a time, so there is nothing to lock
+#define portENTER_CRITICAL(mux) ((void)(mux))
+#define portEXIT_CRITICAL(mux) ((void)(mux))
+#define portENTER_CRITICAL_ISR(mux) ((void)(mux))
+#define portEXIT_CRITICAL_ISR(mux) ((void)(mux))
+#define portSET_INTERRUPT_MASK_FROM_ISR() 0
+#define portCLEAR_INTERRUPT_MASK_FROM_ISR(state) ((void)(state))
+
+BaseType_t xTaskCreate(TaskFunction_t function, const char* name, uint32_t stackDepth, void* parameters, UBaseType_t priority, TaskHandle_t* handle);
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t function, const char* name, uint32_t stackDepth, void* parameters, UBaseType_t priority, TaskHandle_t* handle, BaseType_t core);
+void vTaskDelete(TaskHandle_t task);
+void vTaskDelay(TickType_t ticks);
+TickType_t xTaskGetTickCountFromISR();
+inline BaseType_t xPortGetCoreID() { return 0; }
+
+#endif
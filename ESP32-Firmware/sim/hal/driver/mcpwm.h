@@ -0,0 +1,37 @@
+#ifndef SIM_DRIVER_MCPWM_H
+#define SIM_DRIVER_MCPWM_H
+
+// The calls GateDrive makes, driving the simulated bridge with a 50% square wave and its dead-timed complement
+#include <stdint.h>
+
+typedef int esp_err_t;
+#define ESP_OK 0
+
+typedef enum { MCPWM_UNIT_0 = 0, MCPWM_UNIT_1 } mcpwm_unit_t;
+typedef enum { MCPWM_TIMER_0 = 0, MCPWM_TIMER_1, MCPWM_TIMER_2 } mcpwm_timer_t;
+typedef enum { MCPWM_GEN_A = 0, MCPWM_GEN_B } mcpwm_generator_t;
+typedef enum { MCPWM0A = 0, MCPWM0B } mcpwm_io_signals_t;
+typedef enum { MCPWM_DUTY_MODE_0 = 0, MCPWM_DUTY_MODE_1 } mcpwm_duty_type_t;
+typedef enum { MCPWM_UP_COUNTER = 1 } mcpwm_counter_type_t;
+typedef enum { MCPWM_ACTIVE_HIGH_COMPLIMENT_MODE = 3 } mcpwm_deadtime_type_t;
+
+typedef struct {
+    uint32_t frequency;
+    float cmpr_a;
+    float cmpr_b;
+    mcpwm_duty_type_t duty_mode;
+    mcpwm_counter_type_t counter_mode;
+} mcpwm_config_t;
+
+esp_err_t mcpwm_group_set_resolution(mcpwm_unit_t unit, unsigned long resolution);
+esp_err_t mcpwm_timer_set_resolution(mcpwm_unit_t unit, mcpwm_timer_t timer, unsigned long resolution);
+esp_err_t mcpwm_init(mcpwm_unit_t unit, mcpwm_timer_t timer, const mcpwm_config_t* config);
+esp_err_t mcpwm_start(mcpwm_unit_t unit, mcpwm_timer_t timer);
+esp_err_t mcpwm_stop(mcpwm_unit_t unit, mcpwm_timer_t timer);
+esp_err_t mcpwm_set_frequency(mcpwm_unit_t unit, mcpwm_timer_t timer, uint32_t frequency);
+esp_err_t mcpwm_set_duty(mcpwm_unit_t unit, mcpwm_timer_t timer, mcpwm_generator_t generator, float duty);
+esp_err_t mcpwm_set_duty_type(mcpwm_unit_t unit, mcpwm_timer_t timer, mcpwm_generator_t generator, mcpwm_duty_type_t type);
+esp_err_t mcpwm_gpio_init(mcpwm_unit_t unit, mcpwm_io_signals_t signal, int gpio);
+esp_err_t mcpwm_deadtime_enable(mcpwm_unit_t unit, mcpwm_timer_t timer, mcpwm_deadtime_type_t type, uint32_t redTicks, uint32_t fedTicks);
+
+#endif
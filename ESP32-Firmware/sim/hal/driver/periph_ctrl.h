@@ -0,0 +1,16 @@
+#ifndef SIM_DRIVER_PERIPH_CTRL_H
+#define SIM_DRIVER_PERIPH_CTRL_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum { PERIPH_SARADC_MODULE = 0 } periph_module_t;
+
+void periph_module_enable(periph_module_t module);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
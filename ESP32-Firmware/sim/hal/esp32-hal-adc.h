@@ -0,0 +1,22 @@
+#ifndef SIM_ESP32_HAL_ADC_H
+#define SIM_ESP32_HAL_ADC_H
+
+// The Arduino ADC calls fadcInit makes, they do nothing on the host
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum { ADC_0db = 0, ADC_2_5db, ADC_6db, ADC_11db } adc_attenuation_t;
+
+void analogReadResolution(uint8_t bits);
+void analogSetAttenuation(adc_attenuation_t attenuation);
+void analogSetPinAttenuation(uint8_t pin, adc_attenuation_t attenuation);
+uint16_t analogRead(uint8_t pin);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,16 @@
+#ifndef SIM_ESP_IPC_H
+#define SIM_ESP_IPC_H
+
+#include <stdint.h>
+
+typedef int esp_err_t;
+#define ESP_OK 0
+typedef void (*esp_ipc_func_t)(void* arg);
+
+// There is only the one simulated core, so the call runs in place
+inline esp_err_t esp_ipc_call_blocking(uint32_t core, esp_ipc_func_t function, void* arg) {
+    function(arg);
+    return ESP_OK;
+}
+
+#endif
@@ -0,0 +1,30 @@
+#ifndef SIM_HAL_ADC_HAL_H
+#define SIM_HAL_ADC_HAL_H
+
+// Just enough of the SAR ADC registers for FastAnalogRead's inline one-shot reads to compile, nothing converts
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+    struct {
+        uint32_t sar1_en_pad;
+        uint32_t meas1_start_sar;
+        uint32_t meas1_done_sar;
+        uint32_t meas1_data_sar;
+    } sar_meas1_ctrl2;
+} sens_dev_t;
+
+extern sens_dev_t SENS;
+
+#define HAL_FORCE_READ_U32_REG_FIELD(reg, field) ((reg).field)
+
+void adc_power_acquire(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
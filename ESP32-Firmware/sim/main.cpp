@@ -0,0 +1,644 @@
+// Host build of the control core against the simulated coil: pio run -e native && .pio/build/native/program [scenario...]
+// Each scenario runs in its own process so the firmware's globals start fresh, and prints its measurements
+// next to the limits it checks. The exit status is the number of scenarios that failed.
+// program bench <song.mid>... plays each song through MidiControl and prints PulseBench's log, for tools/pulse_bench.py
+// program trace fires a few bursts and prints Trace's dump, for trying tools/trace_json.py without a coil
+// program track and program render <max pulses/s> run lib/PitchTracker and lib/PulseModulator on 8 kHz mono 16 bit
+// samples from stdin, for tools/audio_stream.py. track prints every frame, quiet ones too, with its time per frame
+// adc-batch is a benchmark more than a scenario, fadcApplyBatch's samples/s against the fadcApply loop on the host
+#include <Arduino.h>
+#include "Hal.h"
+#include "Plant.h"
+#include "Fakes.h"
+#include "Burst.h"
+#include "ZCD.h"
+#include "GateDrive.h"
+#include "OCD.h"
+#include "CurrentTransformer.h"
+#include "FrequencySweep.h"
+#include "MidiControl.h"
+#include "PulseBench.h"
+#include "Trace.h"
+#include "MidiFile.h"
+#include "AdcEngine.h"
+#include "FastAnalogRead.h"
+#include "AudioStream.h"
+#include "PitchTracker.h"
+#include "PulseModulator.h"
+#include <chrono>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace {
+    // Same wiring and limits as src/main.cpp
+    const uint8_t GD1APin = 13;
+    const uint8_t GD1BPin = 14;
+    const uint8_t GD2APin = 15;
+    const uint8_t GD2BPin = 16;
+    const uint8_t ZCDInterruptPin = 21;
+    const uint8_t CTPeakResetPin = 45;
+    const uint8_t CTPeakPin = 9;
+    const uint8_t OCDComparatorPin = 47; // Only wired up by the comparator scenario
+    const uint16_t ocdCurrent = 400;
+    const uint16_t ctTurnsRatio = 512;
+    const uint32_t ctBurdenMiliohms = 3300;
+    const uint32_t loopPeriodMs = 10;
+    const unsigned long maxSongMs = 600000;
+    const unsigned long songTailMs = 500;
+    const size_t midiChunkSize = 20; // What the app sends per BLE write
+    const float offPitchCents = 50.0f; // A quarter tone, clearly the wrong note
+    const uint32_t adcBenchWindows = 1000000; // Of AdcEngine::windowSize samples, each way
+    // Same as src/AudioStream.cpp
+    const uint16_t pitchHop = 128;
+    const uint16_t minPitchHz = 50;
+    const uint16_t maxPitchHz = 1000;
+    const uint16_t voiceOnRms = 1000;
+    const int16_t noiseGate = 600;
+    const uint32_t toneSamples = AudioStream::sampleRateHz / 4;
+
+    struct BurstSummary {
+        uint32_t count;
+        float ratePerSecond;
+        float jitterMicros;  // Worst deviation of a burst interval from the mean
+        float onMicros;      // Average gate on-time
+        float peakAmps;      // Average of each burst's peak
+        float maxAmps;
+    };
+
+    bool check(const char* what, bool ok) {
+        printf("  %-44s %s\n", what, ok ? "ok" : "FAIL");
+        return ok;
+    }
+
+    void setUp(uint8_t ocdPin = 0) {
+        GateDrive::begin(GD1APin, GD1BPin, GD2APin, GD2BPin);
+        ZCD::begin(ZCDInterruptPin, GD1APin, GD1BPin);
+        CurrentTransformer::begin(CTPeakPin, CTPeakResetPin);
+        FrequencySweep::begin(GD1APin, GD1BPin);
+        OCD::begin(ocdCurrent, ctTurnsRatio, ctBurdenMiliohms, ocdPin, CTPeakPin);
+        Fakes::state().enabled = true;
+    }
+
+    // What loop() does for the modules under test
+    void runFor(uint32_t ms) {
+        unsigned long started = millis();
+        while (millis() - started < ms) {
+            FrequencySweep::handle();
+            Burst::handle();
+            delay(loopPeriodMs);
+        }
+    }
+
+    void setBursts(bool enabled) {
+        Fakes::state().burstEnabled = enabled;
+        Burst::handle();
+    }
+
+    BurstSummary summarizeBursts() {
+        const Plant::Burst* bursts;
+        uint8_t count = Plant::getBursts(bursts);
+        BurstSummary summary = { count, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f };
+        if (count == 0) {
+            return summary;
+        }
+        for (uint8_t i = 0; i < count; i++) {
+            summary.onMicros += (bursts[i].endNanos - bursts[i].startNanos) / 1000.0f / count;
+            summary.peakAmps += bursts[i].peakAmps / count;
+            summary.maxAmps = fmaxf(summary.maxAmps, bursts[i].peakAmps);
+        }
+        if (count > 1) {
+            float meanNanos = (float)(bursts[count - 1].startNanos - bursts[0].startNanos) / (count - 1);
+            summary.ratePerSecond = 1e9f / meanNanos;
+            for (uint8_t i = 1; i < count; i++) {
+                float deviation = fabsf((float)(bursts[i].startNanos - bursts[i - 1].startNanos) - meanNanos);
+                summary.jitterMicros = fmaxf(summary.jitterMicros, deviation / 1000.0f);
+            }
+        }
+        return summary;
+    }
+
+    // Bursts at a fixed rate: the scheduler's timing and the ZCD loop ringing the tank up
+    bool interrupter() {
+        Plant::configure(Plant::Config());
+        setUp();
+        BleControl::ControlState& state = Fakes::state();
+        state.bps = 100;
+        state.burstLength = 100;
+        setBursts(true);
+        runFor(100);
+        Plant::clearBursts();
+        runFor(2000);
+        setBursts(false);
+
+        BurstSummary summary = summarizeBursts();
+        Plant::Stats stats = Plant::getStats();
+        printf("  %u bursts, %.1f bps (set %u), interval jitter %.0fus\n", summary.count, summary.ratePerSecond, state.bps, summary.jitterMicros);
+        printf("  gates on %.1fus (set %uus), primary peak %.0fA average, %.0fA max\n", summary.onMicros, state.burstLength, summary.peakAmps, summary.maxAmps);
+        printf("  both gates on for %.0fns in total\n", (double)stats.shootThroughNanos);
+        bool ok = check("rate within 5% of bps", fabsf(summary.ratePerSecond - state.bps) <= state.bps * 0.05f);
+        ok &= check("interval jitter under 1.5ms", summary.jitterMicros < 1500.0f);
+        ok &= check("on-time within 10us of burst length", fabsf(summary.onMicros - state.burstLength) <= 10.0f);
+        ok &= check("tank rings up past 50A", summary.peakAmps > 50.0f);
+        ok &= check("burst task stopped", Hal::taskCount() == 0);
+        return ok;
+    }
+
+    // Primary current against phase lead and bridge polarity, the numbers tuning would go by
+    bool phase() {
+        Plant::configure(Plant::Config());
+        setUp();
+        BleControl::ControlState& state = Fakes::state();
+        state.bps = 100;
+        state.burstLength = 60;
+        float best = 0.0f;
+        printf("  phase lead   normal   reversed\n");
+        for (uint16_t phaseLead = 0; phaseLead <= 1250; phaseLead += 250) {
+            float amps[2];
+            for (uint8_t reverse = 0; reverse < 2; reverse++) {
+                state.phaseLead = phaseLead;
+                state.reverseBurstPhase = reverse;
+                setBursts(true);
+                Plant::clearBursts();
+                runFor(100);
+                setBursts(false);
+                amps[reverse] = summarizeBursts().peakAmps;
+                best = fmaxf(best, amps[reverse]);
+            }
+            printf("  %6uns  %7.0fA  %8.0fA\n", phaseLead, amps[0], amps[1]);
+        }
+        return check("some setting rings up past 50A", best > 50.0f);
+    }
+
+    // Long bursts on a stiff bus run the tank past the limit. The comparator has to cut them short within a few
+    // cycles. Without it the ADC sees the peak detector a DMA frame (100us) late, a sample period and the frame's
+    // delivery on top, so the burst goes on that much longer, and the burst after each one is skipped
+    bool ocd(bool comparator) {
+        Plant::Config config;
+        config.busVolts = 340.0f;
+        config.limitAmps = ocdCurrent;
+        config.ocdComparatorAmps = comparator ? ocdCurrent : 0.0f;
+        config.ocdPin = comparator ? OCDComparatorPin : 0;
+        Plant::configure(config);
+        setUp(config.ocdPin);
+        BleControl::ControlState& state = Fakes::state();
+        state.bps = 20;
+        state.burstLength = 400;
+        setBursts(true);
+        runFor(1000);
+        setBursts(false);
+
+        BurstSummary summary = summarizeBursts();
+        OCD::Trip trips[OCD::maxTrips];
+        uint8_t tripCount = OCD::getTrips(trips, OCD::maxTrips);
+        float tripAfter = 0.0f;
+        for (uint8_t i = 0; i < tripCount; i++) {
+            tripAfter += (float)trips[i].tripAfterMicros / tripCount;
+        }
+        // Bursts that reached the limit, how long their gates stayed on and whether the next one was skipped
+        const Plant::Burst* bursts;
+        uint8_t count = Plant::getBursts(bursts);
+        uint64_t periodNanos = 1000000000ULL / state.bps;
+        uint8_t overLimit = 0;
+        uint8_t followed = 0;
+        uint8_t skipped = 0;
+        float overLimitOnMicros = 0.0f;
+        float stoppedAfterMicros = 0.0f; // Worst time from passing the limit to the gates going off
+        for (uint8_t i = 0; i < count; i++) {
+            if (bursts[i].peakAmps < ocdCurrent) {
+                continue;
+            }
+            overLimit++;
+            overLimitOnMicros = fmaxf(overLimitOnMicros, (bursts[i].endNanos - bursts[i].startNanos) / 1000.0f);
+            stoppedAfterMicros = fmaxf(stoppedAfterMicros, (float)(int64_t)(bursts[i].endNanos - bursts[i].overLimitNanos) / 1000.0f);
+            if (i + 1 < count) {
+                followed++;
+                skipped += bursts[i + 1].startNanos - bursts[i].startNanos > periodNanos * 3 / 2;
+            }
+        }
+        printf("  %u bursts, %u trips, tripped %.0fus into the burst on average\n", summary.count, tripCount, tripAfter);
+        printf("  gates on %.1fus (set %uus), primary peak %.0fA average, %.0fA max (limit %uA)\n", summary.onMicros, state.burstLength, summary.peakAmps, summary.maxAmps, ocdCurrent);
+        printf("  %u bursts over the limit, on for up to %.0fus, %.0fus past the limit, %u of %u followed by a skipped burst\n",
+            overLimit, overLimitOnMicros, stoppedAfterMicros, skipped, followed);
+        bool ok = check("trips logged", tripCount > 0);
+        if (comparator) {
+            ok &= check("over-limit bursts stopped within 100us", overLimit > 0 && overLimitOnMicros < 100.0f);
+            ok &= check("overshoot under 10%", summary.maxAmps < ocdCurrent * 1.1f);
+        } else {
+            // No half cycle bound without the comparator, the frame, a sample period and the delivery are the bound
+            ok &= check("stopped within 200us of passing the limit", overLimit > 0 && stoppedAfterMicros < 200.0f);
+            ok &= check("overshoot under 75%", summary.maxAmps < ocdCurrent * 1.75f);
+            ok &= check("burst after each over-limit one skipped", followed > 0 && skipped == followed);
+        }
+        return ok;
+    }
+
+    bool ocdAdc() {
+        return ocd(false);
+    }
+
+    bool ocdComparator() {
+        return ocd(true);
+    }
+
+    // Notes through MidiControl::playNote, the burst rate is the pitch. The burst task waits whole milliseconds, so
+    // high notes can't land on pitch. This only checks the scheduler holds that grid, the notes off pitch are printed
+    bool midi() {
+        Plant::configure(Plant::Config());
+        setUp();
+        BleControl::ControlState& state = Fakes::state();
+        state.burstLength = 50;
+        setBursts(true);
+        const uint8_t notes[] = { 33, 45, 57, 64, 69, 76, 81 };
+        float worstCents = 0.0f;
+        float worstExcessCents = 0.0f;
+        uint8_t offPitch = 0;
+        printf("  note   target    played    cents\n");
+        for (uint8_t note : notes) {
+            MidiControl::playNote(note);
+            runFor(100);
+            Plant::clearBursts();
+            runFor(500);
+            float target = 440.0f * powf(2.0f, (note - 69) / 12.0f);
+            float played = summarizeBursts().ratePerSecond;
+            float cents = played > 0.0f ? 1200.0f * log2f(played / target) : -9999.0f;
+            // The burst task waits a whole number of milliseconds between bursts, about the best it can do
+            uint16_t bps = Fakes::state().bps;
+            float quantizedHz = 1000.0f / ((10000 / bps + 9) / 10);
+            float quantizedCents = 1200.0f * log2f(quantizedHz / target);
+            bool onPitch = fabsf(cents) <= offPitchCents;
+            offPitch += !onPitch;
+            printf("  %4u  %7.1fHz %7.1fHz %+8.1f  (%+.1f in whole ms)%s\n", note, target, played, cents, quantizedCents, onPitch ? "" : "  OFF PITCH");
+            worstCents = fmaxf(worstCents, fabsf(cents));
+            worstExcessCents = fmaxf(worstExcessCents, fabsf(cents) - fabsf(quantizedCents));
+        }
+        MidiControl::stopNote();
+        setBursts(false);
+        printf("  worst %.0f cents, %.0f beyond the millisecond grid\n", worstCents, worstExcessCents);
+        printf("  %u of %u notes more than %.0f cents off target pitch, the millisecond grid can't play them\n", offPitch, (unsigned)sizeof(notes), offPitchCents);
+        return check("scheduler within 15 cents of its whole ms grid", worstExcessCents < 15.0f);
+    }
+
+    // Runs one sweep to completion, returns how long it took in simulated milliseconds
+    unsigned long runSweep(FrequencySweep::Mode mode) {
+        FrequencySweep::Config config = FrequencySweep::getConfig();
+        config.mode = mode;
+        FrequencySweep::setConfig(config);
+        Fakes::state().startFrequencySweep = true;
+        unsigned long started = millis();
+        runFor(loopPeriodMs);
+        while (FrequencySweep::isRunning() && millis() - started < 60000) {
+            delay(loopPeriodMs);
+        }
+        return millis() - started;
+    }
+
+    // Worst distance of any of the first two peaks from the tank resonance nearest it, as a fraction of it.
+    // Two peaks on one resonance leave the other missed
+    float worstResonanceError(const FrequencySweep::Point* peaks, uint8_t count, const float* resonancesHz) {
+        if (count < 2) {
+            return 1.0f;
+        }
+        float worst = 0.0f;
+        bool found[2] = { false, false };
+        for (uint8_t i = 0; i < 2; i++) {
+            uint8_t nearest = fabsf(peaks[i].frequencyHz - resonancesHz[0]) < fabsf(peaks[i].frequencyHz - resonancesHz[1]) ? 0 : 1;
+            found[nearest] = true;
+            worst = fmaxf(worst, fabsf(peaks[i].frequencyHz - resonancesHz[nearest]) / resonancesHz[nearest]);
+            printf("  peak %.2fkHz %umV, %+.1f%% from the %.1fkHz resonance\n", peaks[i].frequencyHz / 1000.0f, peaks[i].milliVolts,
+                (peaks[i].frequencyHz / resonancesHz[nearest] - 1.0f) * 100.0f, resonancesHz[nearest] / 1000.0f);
+        }
+        return found[0] && found[1] ? worst : 1.0f;
+    }
+
+    // Both sweeps should find the coupled tank's two resonances, the adaptive one in a fraction of the points.
+    // Ten cycles of drive is a broad, lopsided excitation, so the CT peak lands near a small signal resonance, not on it
+    bool sweep() {
+        Plant::Config config;
+        config.busVolts = 20.0f; // Swept on a variac, at full bus the peak detector clips at every point near resonance
+        Plant::configure(config);
+        setUp();
+        BleControl::ControlState& state = Fakes::state();
+        state.minFrequencySweep = 250;
+        state.maxFrequencySweep = 350;
+
+        float f0 = 1.0f / (2.0f * (float)M_PI * sqrtf(config.primaryInductance * config.primaryCapacitance));
+        float resonancesHz[2] = { f0 / sqrtf(1.0f + config.coupling), f0 / sqrtf(1.0f - config.coupling) };
+        const FrequencySweep::Point* points;
+        const FrequencySweep::Point* peaks;
+
+        unsigned long linearMs = runSweep(FrequencySweep::modeLinear);
+        uint16_t linearPoints = FrequencySweep::getResults(points);
+        printf("  linear %u points in %lums\n", linearPoints, linearMs);
+        float linearError = worstResonanceError(peaks, FrequencySweep::getPeaks(peaks), resonancesHz);
+
+        unsigned long adaptiveMs = runSweep(FrequencySweep::modeAdaptive);
+        uint16_t adaptivePoints = FrequencySweep::getResults(points);
+        printf("  adaptive %u points in %lums\n", adaptivePoints, adaptiveMs);
+        // What the app was sent for the adaptive sweep, the tail of both sweeps' points
+        const std::vector<Fakes::SweepPoint>& sent = Fakes::sweepPoints();
+        bool sentErrors = sent.size() >= adaptivePoints;
+        for (uint16_t i = 0; sentErrors && i < adaptivePoints; i++) {
+            const Fakes::SweepPoint& point = sent[sent.size() - adaptivePoints + i];
+            sentErrors = point.frequencyHz == points[i].frequencyHz && point.errorHz == points[i].errorHz;
+        }
+        float adaptiveError = worstResonanceError(peaks, FrequencySweep::getPeaks(peaks), resonancesHz);
+
+        bool ok = check("sweeps finished", !FrequencySweep::isRunning() && Fakes::sweepEnded());
+        ok &= check("linear peaks within 1.5% of the resonances", linearError < 0.015f);
+        ok &= check("adaptive peaks within 1.5% of the resonances", adaptiveError < 0.015f);
+        ok &= check("adaptive under half the points", adaptivePoints * 2 < linearPoints);
+        ok &= check("each point's frequency error sent to the app", sentErrors);
+        return ok;
+    }
+
+    // Plays a song the way the app does, bursts on and the file sent over in chunks
+    bool playSong(const char* path) {
+        FILE* file = fopen(path, "rb");
+        if (file == nullptr) {
+            fprintf(stderr, "%s: can't open\n", path);
+            return false;
+        }
+        std::vector<uint8_t> data;
+        uint8_t chunk[midiChunkSize];
+        size_t length;
+        while ((length = fread(chunk, 1, sizeof(chunk), file)) > 0) {
+            data.insert(data.end(), chunk, chunk + length);
+        }
+        fclose(file);
+
+        Plant::configure(Plant::Config());
+        setUp();
+        MidiControl::begin();
+        for (size_t offset = 0; offset < data.size(); offset += midiChunkSize) {
+            MidiControl::receiveChunk(&data[offset], min(midiChunkSize, data.size() - offset));
+        }
+        MidiControl::receiveChunk(nullptr, 0);
+        setBursts(true);
+        runFor(100);
+
+        PulseBench::start();
+        MidiControl::setPlaying(true);
+        if (!MidiControl::isPlaying) {
+            fprintf(stderr, "%s: not a MIDI file MidiControl can play\n", path);
+            return false;
+        }
+        // MidiControl stops one event short of the end and never clears isPlaying, so stop it once the song is over
+        smf::MidiFile song;
+        song.read(path);
+        song.doTimeAnalysis();
+        unsigned long songMs = min((unsigned long)(song.getFileDurationInSeconds() * 1000) + songTailMs, maxSongMs);
+        unsigned long started = millis();
+        while (MidiControl::isPlaying && millis() - started < songMs) {
+            Burst::handle();
+            PulseBench::handle();
+            delay(loopPeriodMs);
+        }
+        MidiControl::setPlaying(false);
+        PulseBench::stop();
+        setBursts(false);
+        return true;
+    }
+
+    int bench(int count, char** paths) {
+        int failures = 0;
+        for (int i = 0; i < count; i++) {
+            printf("song,%s\n", paths[i]);
+            fflush(stdout);
+            pid_t child = fork();
+            if (child == 0) {
+                bool ok = playSong(paths[i]);
+                fflush(stdout);
+                _exit(ok ? 0 : 1);
+            }
+            int status = 0;
+            waitpid(child, &status, 0);
+            failures += !(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+        }
+        return failures;
+    }
+
+    int trace() {
+        Plant::configure(Plant::Config());
+        setUp();
+        BleControl::ControlState& state = Fakes::state();
+        state.bps = 100;
+        state.burstLength = 100;
+        Trace::start();
+        setBursts(true);
+        runFor(35);
+        setBursts(false);
+        // Longer than a cycle counter wrap, the second run is placed from an anchor of its own
+        runFor(20000);
+        setBursts(true);
+        runFor(35);
+        setBursts(false);
+        Trace::dump();
+        return 0;
+    }
+
+    // fadcApplyBatch against the per-sample fadcApply loop it replaced, a window at a time like AdcEngine calibrates.
+    // Host rates only rank the two, the S3's are its own. Time stands still here, it's wall clock that's measured
+    bool adcBatch() {
+        fadcCalibrate(ADC_11db);
+        bool identical = true;
+        for (uint32_t raw = 0; raw <= 0xFFFF; raw++) {
+            uint16_t in = raw;
+            uint16_t out;
+            fadcApplyBatch(&in, &out, 1);
+            identical &= out == fadcApply(raw << FADC_SHIFT);
+        }
+
+        uint16_t in[AdcEngine::windowSize];
+        uint16_t out[AdcEngine::windowSize];
+        for (uint8_t i = 0; i < AdcEngine::windowSize; i++) {
+            in[i] = rand() & 0xFFF;
+        }
+        uint32_t checksum = 0;
+        auto started = std::chrono::steady_clock::now();
+        for (uint32_t window = 0; window < adcBenchWindows; window++) {
+            for (uint8_t i = 0; i < AdcEngine::windowSize; i++) {
+                out[i] = fadcApply(in[i] << FADC_SHIFT);
+            }
+            checksum += out[window % AdcEngine::windowSize];
+        }
+        auto looped = std::chrono::steady_clock::now();
+        for (uint32_t window = 0; window < adcBenchWindows; window++) {
+            fadcApplyBatch(in, out, AdcEngine::windowSize);
+            checksum -= out[window % AdcEngine::windowSize];
+        }
+        auto batched = std::chrono::steady_clock::now();
+
+        double samples = (double)adcBenchWindows * AdcEngine::windowSize;
+        double loopRate = samples / std::chrono::duration<double>(looped - started).count();
+        double batchRate = samples / std::chrono::duration<double>(batched - looped).count();
+        printf("  %u-sample windows: fadcApply %.0fM samples/s, fadcApplyBatch %.0fM samples/s, %.1fx\n",
+            AdcEngine::windowSize, loopRate / 1e6, batchRate / 1e6, batchRate / loopRate);
+        return check("batch matches fadcApply on every input", identical && checksum == 0);
+    }
+
+    // A fundamental with falling harmonics well inside full scale, like audio_stream.py's synthetic tones
+    std::vector<int16_t> tone(float frequencyHz) {
+        std::vector<int16_t> samples(toneSamples);
+        for (uint32_t i = 0; i < toneSamples; i++) {
+            float phase = 2.0f * (float)M_PI * frequencyHz * i / AudioStream::sampleRateHz;
+            float value = 0.0f;
+            for (int k = 1; k < 6 && k * frequencyHz < AudioStream::sampleRateHz / 2; k++) {
+                value += sinf(k * phase) / k;
+            }
+            samples[i] = (int16_t)(9000.0f * value);
+        }
+        return samples;
+    }
+
+    // A frame per hop like the pitch task, each one timed
+    std::vector<PitchTracker::Result> trackPitch(const std::vector<int16_t>& samples, double& analyseSeconds) {
+        PitchTracker tracker(AudioStream::sampleRateHz, minPitchHz, maxPitchHz);
+        std::vector<PitchTracker::Result> frames;
+        for (size_t offset = 0; offset + PitchTracker::bufferSize <= samples.size(); offset += pitchHop) {
+            auto started = std::chrono::steady_clock::now();
+            PitchTracker::Result result = tracker.analyse(&samples[offset]);
+            analyseSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+            frames.push_back(result);
+        }
+        return frames;
+    }
+
+    // lib/PitchTracker on A1 to A5 in semitones, the range a coil plays well. Time per frame is the host's,
+    // the S3's comes from the audio serial command
+    bool pitch() {
+        uint32_t frames = 0;
+        uint32_t voiced = 0;
+        uint32_t withinQuarterTone = 0;
+        float worstCents = 0.0f;
+        double analyseSeconds = 0.0;
+        for (int semitone = -12; semitone <= 36; semitone++) {
+            float expectedHz = 110.0f * powf(2.0f, semitone / 12.0f);
+            for (const PitchTracker::Result& frame : trackPitch(tone(expectedHz), analyseSeconds)) {
+                // Only frames loud enough to sound, like the pitch task
+                if (frame.rms < voiceOnRms) {
+                    continue;
+                }
+                frames++;
+                if (frame.frequencyHz <= 0.0f) {
+                    continue;
+                }
+                voiced++;
+                float cents = fabsf(1200.0f * log2f(frame.frequencyHz / expectedHz));
+                withinQuarterTone += cents < offPitchCents;
+                worstCents = max(worstCents, cents);
+            }
+        }
+        printf("  %u frames, %u voiced, worst %.1f cents, %.1fus per frame on the host\n", frames, voiced, worstCents,
+            analyseSeconds / max(frames, 1u) * 1e6);
+        bool ok = check("every tone frame voiced", voiced == frames);
+        return check("voiced frames within a quarter tone", withinQuarterTone == voiced) && ok;
+    }
+
+    std::vector<int16_t> readSamples() {
+        std::vector<int16_t> samples;
+        int16_t buffer[1024];
+        size_t count;
+        while ((count = fread(buffer, sizeof(int16_t), 1024, stdin)) > 0) {
+            samples.insert(samples.end(), buffer, buffer + count);
+        }
+        return samples;
+    }
+
+    int track() {
+        double analyseSeconds = 0.0;
+        std::vector<PitchTracker::Result> frames = trackPitch(readSamples(), analyseSeconds);
+        for (const PitchTracker::Result& frame : frames) {
+            printf("frame,%.3f,%u\n", frame.frequencyHz, frame.rms);
+        }
+        printf("track,%u,%.0f\n", (unsigned)frames.size(), frames.empty() ? 0.0 : analyseSeconds / frames.size() * 1e9);
+        return 0;
+    }
+
+    int render(int count, char** args) {
+        if (count != 1) {
+            fprintf(stderr, "render needs the max pulse rate in pulses/s\n");
+            return 1;
+        }
+        PulseModulator modulator;
+        modulator.setGate(noiseGate);
+        modulator.setMaxPulseRate(strtoul(args[0], nullptr, 10), AudioStream::sampleRateHz);
+        std::vector<int16_t> samples = readSamples();
+        uint32_t pulses = 0;
+        for (size_t i = 0; i < samples.size(); i++) {
+            if (modulator.step(samples[i])) {
+                printf("pulse,%u\n", (unsigned)i);
+                pulses++;
+            }
+        }
+        printf("render,%u,%u\n", (unsigned)samples.size(), pulses);
+        return 0;
+    }
+
+    struct Scenario {
+        const char* name;
+        bool (*run)();
+    };
+
+    const Scenario scenarios[] = {
+        { "interrupter", interrupter },
+        { "phase", phase },
+        { "ocd-adc", ocdAdc },
+        { "ocd-comparator", ocdComparator },
+        { "midi", midi },
+        { "sweep", sweep },
+        { "adc-batch", adcBatch },
+        { "pitch", pitch }
+    };
+
+    bool selected(const char* name, int argc, char** argv) {
+        if (argc < 2) {
+            return true;
+        }
+        for (int i = 1; i < argc; i++) {
+            if (strcmp(argv[i], name) == 0) {
+                return true;
+            }
+        }
+        return false;
+    }
+}
+
+int main(int argc, char** argv) {
+    if (argc > 1 && strcmp(argv[1], "bench") == 0) {
+        return bench(argc - 2, argv + 2);
+    }
+    if (argc > 1 && strcmp(argv[1], "trace") == 0) {
+        return trace();
+    }
+    if (argc > 1 && strcmp(argv[1], "track") == 0) {
+        return track();
+    }
+    if (argc > 1 && strcmp(argv[1], "render") == 0) {
+        return render(argc - 2, argv + 2);
+    }
+
+    int failures = 0;
+    for (const Scenario& scenario : scenarios) {
+        if (!selected(scenario.name, argc, argv)) {
+            continue;
+        }
+        printf("%s\n", scenario.name);
+        fflush(stdout);
+        auto started = std::chrono::steady_clock::now();
+        pid_t child = fork();
+        if (child == 0) {
+            bool ok = scenario.run();
+            printf("  %.2fs simulated", Hal::nanos() / 1e9);
+            fflush(stdout);
+            _exit(ok ? 0 : 1);
+        }
+        int status = 0;
+        waitpid(child, &status, 0);
+        double wallSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+        bool ok = WIFEXITED(status) && WEXITSTATUS(status) == 0;
+        printf(" in %.2fs\n%s\n\n", wallSeconds, ok ? "PASS" : "FAIL");
+        failures += !ok;
+    }
+    return failures;
+}
+
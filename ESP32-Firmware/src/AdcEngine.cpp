@@ -0,0 +1,368 @@
+#include "AdcEngine.h"
+#include "FastAnalogRead.h"
+#include "Telemetry.h"
+#include <atomic>
+#include <driver/adc.h>
+
+namespace AdcEngine {
+    // Constants
+    const uint32_t frameBytes = 32; // 8 conversions per DMA frame, 100us at 80kHz. The ADC OCD check sees the CT this late
+    const uint32_t dmaBufferBytes = 1024;
+    const uint32_t anchorCreepMicros = 1; // Per frame, lets the anchor follow the sample clock running slow
+
+    struct Channel {
+        uint8_t pin;
+        uint8_t atten;
+        uint16_t history[windowSize];
+        std::atomic<uint32_t> count;
+        // When the newest sample was taken and the count at that point, published under a sequence lock
+        std::atomic<uint32_t> anchorSequence;
+        uint32_t anchorMicros;
+        uint32_t anchorCount;
+        int8_t telemetryStream; // -1 when not streamed
+        uint32_t telemetryCount; // Samples already pushed
+    };
+
+    // Variables
+    bool running = false;
+    Channel channels[maxChannels];
+    uint8_t channelCount = 0;
+    uint32_t samplePeriodNanos = 0; // Per channel
+    uint32_t conversionPeriodNanos = 0;
+    int8_t slotForAdcChannel[SOC_ADC_MAX_CHANNEL_NUM];
+    TaskHandle_t samplerTaskHandle = NULL;
+
+    int8_t IRAM_ATTR getSlot(uint8_t pin) {
+        for (uint8_t i = 0; i < channelCount; i++) {
+            if (channels[i].pin == pin) {
+                return i;
+            }
+        }
+        return -1;
+    }
+
+    // Copies the newest samples out, retrying if the sampler lapped the part being read
+    uint8_t readWindow(uint8_t pin, uint8_t samples, uint16_t* out) {
+        int8_t slot = getSlot(pin);
+        if (slot < 0 || samples == 0) {
+            return 0;
+        }
+
+        Channel& channel = channels[slot];
+        samples = min(samples, windowSize);
+        while (true) {
+            uint32_t count = channel.count.load(std::memory_order_acquire);
+            uint8_t available = min((uint32_t)samples, count);
+            for (uint8_t i = 0; i < available; i++) {
+                out[i] = channel.history[(count - 1 - i) & (windowSize - 1)];
+            }
+            if (channel.count.load(std::memory_order_acquire) - count <= (uint32_t)(windowSize - available)) {
+                return available;
+            }
+        }
+    }
+
+    // Only the newest windowSize samples are still there to push, older ones are dropped
+    void pushTelemetry(Channel& channel, uint32_t anchorMicros) {
+        uint32_t count = channel.count.load(std::memory_order_relaxed);
+        int8_t stream = channel.telemetryStream;
+        if (stream < 0 || !(Telemetry::enabledStreams & (1 << stream))) {
+            channel.telemetryCount = count;
+            return;
+        }
+
+        uint8_t samples = min(count - channel.telemetryCount, (uint32_t)windowSize);
+        channel.telemetryCount = count;
+        uint16_t window[windowSize];
+        for (uint8_t i = 0; i < samples; i++) {
+            window[i] = channel.history[(count - samples + i) & (windowSize - 1)];
+        }
+        fadcApplyBatchAtten(channel.atten, window, window, samples);
+        // The newest one was taken at the anchor, the rest a sample period apart before it
+        for (uint8_t i = 0; i < samples; i++) {
+            uint32_t ageMicros = (samples - 1 - i) * samplePeriodNanos / 1000;
+            Telemetry::pushAt(stream, anchorMicros - ageMicros, window[i]);
+        }
+    }
+
+    // A frame reaches the task some time after its last conversion: the DMA interrupt, the task waking up and any
+    // frames queued behind it. The sample clock is steady, so the anchor follows the sample count and only moves
+    // back when a frame turns up earlier than that predicts, leaving the shortest delivery time seen as the error.
+    void updateAnchor(Channel& channel, uint32_t newestMicros, bool resync) {
+        uint32_t count = channel.count.load(std::memory_order_relaxed);
+        uint32_t predictedMicros = channel.anchorMicros + (count - channel.anchorCount) * samplePeriodNanos / 1000;
+        int32_t lateMicros = (int32_t)(newestMicros - predictedMicros);
+        uint32_t anchorMicros = newestMicros;
+        if (!resync && channel.anchorCount != 0 && lateMicros >= 0) {
+            anchorMicros = predictedMicros + min(lateMicros, (int32_t)anchorCreepMicros);
+        }
+
+        uint32_t sequence = channel.anchorSequence.load(std::memory_order_relaxed);
+        channel.anchorSequence.store(sequence + 1, std::memory_order_release);
+        channel.anchorMicros = anchorMicros;
+        channel.anchorCount = count;
+        channel.anchorSequence.store(sequence + 2, std::memory_order_release);
+    }
+
+    void samplerTask(void* arg) {
+        uint8_t frame[frameBytes];
+        while (true) {
+            uint32_t length = 0;
+            // ESP_ERR_INVALID_STATE means the driver's buffer overflowed, the frame is good but samples before it were
+            // lost, so the count no longer tracks time
+            esp_err_t result = adc_digi_read_bytes(frame, frameBytes, &length, portMAX_DELAY);
+            uint32_t now = micros();
+            if (result != ESP_OK && result != ESP_ERR_INVALID_STATE) {
+                continue;
+            }
+
+            // Position in the frame of each channel's newest conversion, -1 when it has none
+            int16_t newestConversion[maxChannels];
+            memset(newestConversion, -1, sizeof(newestConversion));
+            uint16_t conversions = length / SOC_ADC_DIGI_RESULT_BYTES;
+            for (uint32_t i = 0; i + SOC_ADC_DIGI_RESULT_BYTES <= length; i += SOC_ADC_DIGI_RESULT_BYTES) {
+                adc_digi_output_data_t* output = (adc_digi_output_data_t*)&frame[i];
+                if (output->type2.unit != 0 || output->type2.channel >= SOC_ADC_MAX_CHANNEL_NUM) {
+                    continue;
+                }
+                int8_t slot = slotForAdcChannel[output->type2.channel];
+                if (slot < 0) {
+                    continue;
+                }
+
+                Channel& channel = channels[slot];
+                uint32_t count = channel.count.load(std::memory_order_relaxed);
+                channel.history[count & (windowSize - 1)] = output->type2.data;
+                channel.count.store(count + 1, std::memory_order_release);
+                newestConversion[slot] = i / SOC_ADC_DIGI_RESULT_BYTES;
+            }
+
+            // The frame's last conversion finished no later than now, each channel's newest one before that
+            for (uint8_t i = 0; i < channelCount; i++) {
+                if (newestConversion[i] < 0) {
+                    continue;
+                }
+                Channel& channel = channels[i];
+                uint32_t ageNanos = (conversions - 1 - newestConversion[i]) * conversionPeriodNanos;
+                updateAnchor(channel, now - ageNanos / 1000, result == ESP_ERR_INVALID_STATE);
+                pushTelemetry(channel, channel.anchorMicros);
+            }
+        }
+    }
+
+    bool begin(uint32_t sampleRateHz, uint8_t pinCount, const uint8_t* pins, const uint8_t* attenuations) {
+        if (running || pinCount == 0 || pinCount > maxChannels) {
+            return false;
+        }
+
+        memset(slotForAdcChannel, -1, sizeof(slotForAdcChannel));
+        adc_digi_pattern_config_t pattern[maxChannels] = {};
+        uint16_t channelMask = 0;
+        channelCount = 0;
+        for (uint8_t i = 0; i < pinCount; i++) {
+            int8_t adcChannel = digitalPinToAnalogChannel(pins[i]);
+            // Only ADC1 works with DMA on the S3
+            if (adcChannel < 0 || adcChannel >= SOC_ADC_MAX_CHANNEL_NUM) {
+                Serial.print("AdcEngine: pin is not on ADC1: ");
+                Serial.println(pins[i]);
+                return false;
+            }
+
+            Channel& channel = channels[channelCount];
+            channel.pin = pins[i];
+            channel.atten = attenuations == nullptr ? FADC_ATTEN : attenuations[i];
+            if (channel.atten >= FADC_ATTEN_COUNT) {
+                Serial.print("AdcEngine: bad attenuation for pin ");
+                Serial.println(pins[i]);
+                return false;
+            }
+            // Cached in NVS, only rebuilt when the chip's eFuse calibration changes
+            fadcCalibrate(channel.atten);
+            channel.count.store(0, std::memory_order_relaxed);
+            channel.anchorSequence.store(0, std::memory_order_relaxed);
+            channel.anchorMicros = micros();
+            channel.anchorCount = 0;
+            channel.telemetryStream = -1;
+            channel.telemetryCount = 0;
+            slotForAdcChannel[adcChannel] = channelCount;
+            channelMask |= 1 << adcChannel;
+
+            pattern[channelCount].atten = channel.atten;
+            pattern[channelCount].channel = adcChannel;
+            pattern[channelCount].unit = 0;
+            pattern[channelCount].bit_width = SOC_ADC_DIGI_MAX_BITWIDTH;
+            channelCount++;
+        }
+
+        adc_digi_init_config_t initConfig = {};
+        initConfig.max_store_buf_size = dmaBufferBytes;
+        initConfig.conv_num_each_intr = frameBytes;
+        initConfig.adc1_chan_mask = channelMask;
+        initConfig.adc2_chan_mask = 0;
+        if (adc_digi_initialize(&initConfig) != ESP_OK) {
+            Serial.println("AdcEngine: adc_digi_initialize failed");
+            return false;
+        }
+
+        adc_digi_configuration_t config = {};
+        config.conv_limit_en = false;
+        config.conv_limit_num = 250;
+        config.pattern_num = channelCount;
+        config.adc_pattern = pattern;
+        config.sample_freq_hz = constrain(sampleRateHz, SOC_ADC_SAMPLE_FREQ_THRES_LOW, SOC_ADC_SAMPLE_FREQ_THRES_HIGH);
+        config.conv_mode = ADC_CONV_SINGLE_UNIT_1;
+        config.format = ADC_DIGI_OUTPUT_FORMAT_TYPE2;
+        if (adc_digi_controller_configure(&config) != ESP_OK) {
+            Serial.println("AdcEngine: adc_digi_controller_configure failed");
+            adc_digi_deinitialize();
+            return false;
+        }
+
+        conversionPeriodNanos = 1000000000UL / config.sample_freq_hz;
+        samplePeriodNanos = (uint32_t)(1000000000ULL * channelCount / config.sample_freq_hz);
+        xTaskCreatePinnedToCore(samplerTask, "adcSamplerTask", 3072, NULL, 5, &samplerTaskHandle, 0);
+        adc_digi_start();
+        running = true;
+        return true;
+    }
+
+    uint16_t IRAM_ATTR latestRaw(uint8_t pin) {
+        int8_t slot = getSlot(pin);
+        if (slot < 0) {
+            return 0;
+        }
+
+        Channel& channel = channels[slot];
+        uint32_t count = channel.count.load(std::memory_order_acquire);
+        return count == 0 ? 0 : channel.history[(count - 1) & (windowSize - 1)];
+    }
+
+    uint16_t latestMilliVolts(uint8_t pin) {
+        return toMilliVolts(pin, latestRaw(pin));
+    }
+
+    uint8_t readMilliVolts(uint8_t pin, uint8_t samples, uint16_t* out) {
+        uint16_t window[windowSize];
+        uint8_t available = readWindow(pin, samples, window);
+        toMilliVolts(pin, window, out, available);
+        return available;
+    }
+
+    uint16_t averageMilliVolts(uint8_t pin, uint8_t samples) {
+        uint16_t window[windowSize];
+        uint8_t available = readMilliVolts(pin, samples, window);
+        if (available == 0) {
+            return 0;
+        }
+
+        // Calibrate before averaging, the curve bends at both ends of the range
+        uint32_t sum = 0;
+        for (uint8_t i = 0; i < available; i++) {
+            sum += window[i];
+        }
+        return (sum + available / 2) / available;
+    }
+
+    uint16_t maxMilliVolts(uint8_t pin, uint8_t samples) {
+        uint16_t window[windowSize];
+        uint8_t available = readWindow(pin, samples, window);
+        uint16_t maxRaw = 0;
+        for (uint8_t i = 0; i < available; i++) {
+            maxRaw = max(maxRaw, window[i]);
+        }
+        return available == 0 ? 0 : toMilliVolts(pin, maxRaw);
+    }
+
+    uint32_t IRAM_ATTR getSampleCount(uint8_t pin) {
+        int8_t slot = getSlot(pin);
+        return slot < 0 ? 0 : channels[slot].count.load(std::memory_order_acquire);
+    }
+
+    uint32_t IRAM_ATTR sampleIndexAt(uint8_t pin, uint32_t timeMicros) {
+        int8_t slot = getSlot(pin);
+        if (slot < 0 || samplePeriodNanos == 0) {
+            return 0;
+        }
+
+        Channel& channel = channels[slot];
+        uint32_t sequence;
+        uint32_t anchorMicros;
+        uint32_t anchorCount;
+        do {
+            sequence = channel.anchorSequence.load(std::memory_order_acquire);
+            anchorMicros = channel.anchorMicros;
+            anchorCount = channel.anchorCount;
+        } while ((sequence & 1) || channel.anchorSequence.load(std::memory_order_acquire) != sequence);
+
+        // anchorCount - 1 is the sample taken at anchorMicros
+        int32_t elapsedNanos = (int32_t)(timeMicros - anchorMicros) * 1000;
+        if (elapsedNanos <= 0) {
+            return anchorCount - 1 - (uint32_t)(-elapsedNanos / (int32_t)samplePeriodNanos);
+        }
+        return anchorCount - 1 + (elapsedNanos + samplePeriodNanos - 1) / samplePeriodNanos;
+    }
+
+    bool IRAM_ATTR sampleAt(uint8_t pin, uint32_t index, uint16_t& raw) {
+        int8_t slot = getSlot(pin);
+        if (slot < 0) {
+            return false;
+        }
+
+        Channel& channel = channels[slot];
+        uint32_t count = channel.count.load(std::memory_order_acquire);
+        if ((int32_t)(count - index) <= 0 || count - index > windowSize) {
+            return false;
+        }
+        raw = channel.history[index & (windowSize - 1)];
+        // Check it wasn't overwritten while reading
+        return channel.count.load(std::memory_order_acquire) - index <= windowSize;
+    }
+
+    uint16_t toMilliVolts(uint8_t pin, uint16_t raw) {
+        uint16_t milliVolts;
+        toMilliVolts(pin, &raw, &milliVolts, 1);
+        return milliVolts;
+    }
+
+    void toMilliVolts(uint8_t pin, const uint16_t* raw, uint16_t* milliVolts, uint8_t count) {
+        int8_t slot = getSlot(pin);
+        fadcApplyBatchAtten(slot < 0 ? FADC_ATTEN : channels[slot].atten, raw, milliVolts, count);
+    }
+
+    float measureEnob(uint8_t pin) {
+        uint16_t window[windowSize];
+        uint8_t available = readWindow(pin, windowSize, window);
+        if (available < 2) {
+            return 0.0f;
+        }
+
+        float mean = 0.0f;
+        for (uint8_t i = 0; i < available; i++) {
+            mean += window[i];
+        }
+        mean /= available;
+        float variance = 0.0f;
+        for (uint8_t i = 0; i < available; i++) {
+            variance += (window[i] - mean) * (window[i] - mean);
+        }
+        variance /= available - 1;
+
+        // An ideal converter's only noise is quantisation, 1/sqrt(12) LSB rms
+        float noiseLsb = sqrtf(variance * 12.0f);
+        if (noiseLsb <= 1.0f) {
+            return SOC_ADC_DIGI_MAX_BITWIDTH;
+        }
+        return SOC_ADC_DIGI_MAX_BITWIDTH - log2f(noiseLsb);
+    }
+
+    uint32_t getSamplePeriodNanos() {
+        return samplePeriodNanos;
+    }
+
+    void streamTelemetry(uint8_t pin, uint8_t stream) {
+        int8_t slot = getSlot(pin);
+        if (slot >= 0 && stream < Telemetry::streamCount) {
+            channels[slot].telemetryStream = stream;
+        }
+    }
+}
@@ -0,0 +1,58 @@
+#ifndef ADCENGINE_H
+#define ADCENGINE_H
+
+#include <Arduino.h>
+
+// Continuous ADC1 sampling through the S3's digital controller and DMA.
+// A background task unpacks DMA frames into a per-channel ring, so readers never start or wait on a conversion.
+// Accessors are lock-free and safe from any task or ISR. Don't use FastAnalogRead's fadcStart/analogReadFast
+// once this is running, the RTC and digital controllers can't share ADC1.
+namespace AdcEngine {
+    const uint8_t maxChannels = 4;
+    const uint8_t windowSize = 64; // Samples kept per channel, must be a power of two
+
+    // Samples every pin round robin, sampleRateHz is the total across all pins.
+    // attenuations is one adc_attenuation_t per pin, FADC_ATTEN for all of them when null
+    bool begin(uint32_t sampleRateHz, uint8_t pinCount, const uint8_t* pins, const uint8_t* attenuations = nullptr);
+
+    uint16_t IRAM_ATTR latestRaw(uint8_t pin);
+    uint16_t latestMilliVolts(uint8_t pin);
+
+    // Newest samples, newest first, calibrated in one batch. Returns how many were copied (at most windowSize)
+    uint8_t readMilliVolts(uint8_t pin, uint8_t samples, uint16_t* out);
+
+    // Over the newest samples (at most windowSize)
+    uint16_t averageMilliVolts(uint8_t pin, uint8_t samples);
+    uint16_t maxMilliVolts(uint8_t pin, uint8_t samples);
+
+    // Conversions received for a pin since begin, wraps
+    uint32_t IRAM_ATTR getSampleCount(uint8_t pin);
+
+    // Index (in getSampleCount terms) of the first sample taken at or after timeMicros, may be in the future.
+    // Comes out early by as much as the anchor runs late, see maxAnchorLateMicros
+    uint32_t IRAM_ATTR sampleIndexAt(uint8_t pin, uint32_t timeMicros);
+    // The anchor only ever runs late: by the sampler's shortest frame delivery time seen (DMA interrupt and task wake
+    // up, 20us in the sim's model) plus 2us of micros() rounding. Asking for timeMicros plus this always gives a
+    // sample taken after timeMicros, at most this and a sample period after it
+    const uint32_t maxAnchorLateMicros = 30;
+
+    // False if the sample hasn't arrived yet or has already been overwritten
+    bool IRAM_ATTR sampleAt(uint8_t pin, uint32_t index, uint16_t& raw);
+
+    // Calibrated for the pin's attenuation
+    uint16_t toMilliVolts(uint8_t pin, uint16_t raw);
+    void toMilliVolts(uint8_t pin, const uint16_t* raw, uint16_t* milliVolts, uint8_t count);
+
+    // Effective number of bits from the noise over the window, only meaningful with a steady input on the pin
+    float measureEnob(uint8_t pin);
+
+    // Time between two samples of the same pin
+    uint32_t getSamplePeriodNanos();
+
+    // Pushes every sample of the pin, in millivolts, to a Telemetry stream while somebody is subscribed to it
+    void streamTelemetry(uint8_t pin, uint8_t stream);
+
+    extern bool running;
+}
+
+#endif
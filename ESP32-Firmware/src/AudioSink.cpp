@@ -0,0 +1,92 @@
+#include "AudioSink.h"
+#include "AudioStream.h"
+
+bool AudioSink::begin() {
+    _phase = 0;
+    _previous = 0;
+    _partialLength = 0;
+    _chunkLength = 0;
+    return true;
+}
+
+size_t AudioSink::write(const uint8_t* data, size_t len) {
+    if (!_active) {
+        return len;
+    }
+
+    size_t frameBytes = 2 * _channels;
+    size_t taken = 0;
+    // Finish a frame split across writes
+    if (_partialLength > 0) {
+        while (_partialLength < frameBytes && taken < len) {
+            _partial[_partialLength++] = data[taken++];
+        }
+        if (_partialLength < frameBytes) {
+            return taken;
+        }
+        pushFrame(_partial);
+        _partialLength = 0;
+    }
+
+    for (; taken + frameBytes <= len; taken += frameBytes) {
+        pushFrame(&data[taken]);
+    }
+    while (taken < len) {
+        _partial[_partialLength++] = data[taken++];
+    }
+    flush();
+    return taken;
+}
+
+void AudioSink::end() {
+    flush();
+    _partialLength = 0;
+}
+
+void AudioSink::set_sample_rate(int rate) {
+    _sampleRate = constrain(rate, 1000, 96000);
+    _step = ((uint64_t)_sampleRate << 16) / AudioStream::sampleRateHz;
+    _phase = 0;
+}
+
+void AudioSink::set_output_active(bool active) {
+    _active = active;
+    if (!active) {
+        begin();
+    }
+}
+
+void AudioSink::set_channels(uint8_t channels) {
+    _channels = constrain(channels, 1, maxChannels);
+    _partialLength = 0;
+}
+
+// One input frame in, as many output samples as fall before it out. Linear interpolation, which is plenty
+// for a modulator that only keeps the envelope and rough shape
+void AudioSink::pushFrame(const uint8_t* frame) {
+    int32_t sum = 0;
+    for (uint8_t channel = 0; channel < _channels; channel++) {
+        int16_t sample;
+        memcpy(&sample, &frame[2 * channel], sizeof(sample)); // The transport may leave it unaligned
+        sum += sample;
+    }
+    int16_t current = sum / _channels;
+
+    while (_phase < (1 << 16)) {
+        _chunk[_chunkLength++] = _previous + (((int32_t)(current - _previous) * (int32_t)_phase) >> 16);
+        if (_chunkLength == chunkSamples) {
+            flush();
+        }
+        _phase += _step;
+    }
+    _phase -= 1 << 16;
+    _previous = current;
+}
+
+void AudioSink::flush() {
+    if (_chunkLength > 0) {
+        // What the ring can't take is dropped and counted there, the chunk is done with either way
+        AudioStream::write(_chunk, _chunkLength);
+        _chunkLength = 0;
+    }
+}
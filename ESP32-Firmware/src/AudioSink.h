@@ -0,0 +1,43 @@
+#ifndef AUDIOSINK_H
+#define AUDIOSINK_H
+
+#include <Arduino.h>
+
+// PCM output that plays on the coil instead of a DAC. Same methods as the A2DP library's BluetoothA2DPOutput
+// (lib/BluetoothA2DPSink), so anything written against that interface can feed the coil: interleaved 16 bit PCM
+// at any rate and channel count is mixed down, resampled to AudioStream::sampleRateHz and written straight into
+// AudioStream's ring, with no I2S and no second queue in between. That header refuses to build on the S3, which
+// has no Classic Bluetooth, so this mirrors it rather than deriving from it.
+class AudioSink {
+public:
+    bool begin();
+    // Always takes all len bytes, a partial sample frame is kept for the next call. There's no backpressure: like a
+    // DAC it plays live, so samples the ring has no room for (or all of them while inactive) are dropped, and those
+    // only show in AudioStream's overrun count
+    size_t write(const uint8_t* data, size_t len);
+    void end();
+    void set_sample_rate(int rate);
+    void set_output_active(bool active);
+    void set_channels(uint8_t channels);
+
+private:
+    static const size_t chunkSamples = 64;
+    static const uint8_t maxChannels = 8;
+
+    uint32_t _sampleRate = 8000;
+    uint8_t _channels = 1;
+    bool _active = true;
+    // Resampler position between the previous and current input sample, Q16
+    uint32_t _step = 1 << 16;
+    uint32_t _phase = 0;
+    int16_t _previous = 0;
+    uint8_t _partial[2 * maxChannels];
+    size_t _partialLength = 0;
+    int16_t _chunk[chunkSamples];
+    size_t _chunkLength = 0;
+
+    void pushFrame(const uint8_t* frame);
+    void flush();
+};
+
+#endif
@@ -0,0 +1,376 @@
+#include "AudioStream.h"
+#include "BleControl.h"
+#include "Burst.h"
+#include "CurrentTransformer.h"
+#include "FrequencySweep.h"
+#include "MidiControl.h"
+#include "OCD.h"
+#include "Thermal.h"
+#include "ZCD.h"
+#include "Sequence.h"
+#include "PulseModulator.h"
+#include "PitchTracker.h"
+#include "SpscRing.h"
+
+namespace AudioStream {
+    // Constants
+    const size_t ringCapacity = 4096; // ~0.5s at 8 kHz
+    const size_t prefetchSamples = ringCapacity * 25 / 100; // ~128ms, enough to ride out Wi-Fi jitter
+    const uint32_t maxPulseRateHz = 4000; // Lower in practice, pulses due while the last CT capture is pending are skipped
+    const uint16_t maxBurstLength = 100; // In microseconds, audio wants short clicks
+    const int16_t noiseGate = 600; // ~2% of full scale
+    const unsigned long idleTimeoutMs = 500; // A stream with no samples for this long has ended
+    const uint8_t timerNumber = 0;
+    const uint16_t timerDivider = 80; // 1 MHz ticks from the 80 MHz APB clock
+    const uint16_t pitchHop = 128; // A frame every 16ms
+    const uint16_t minPitchHz = 50;
+    const uint16_t maxPitchHz = 1000;
+    const uint16_t voiceOnRms = 1000; // Envelope gate, with hysteresis so a decaying note doesn't flutter
+    const uint16_t voiceOffRms = 600;
+    const float noteHysteresis = 0.7f; // In semitones, a held note only moves once the pitch is clearly past the next one
+
+    // Where a write's last sample will sit in the played count, and when it arrived
+    struct LatencyMarker {
+        uint32_t sampleIndex;
+        uint32_t writtenMicros;
+    };
+
+    // Variables
+    SpscRing<int16_t, ringCapacity> ring;
+    SpscRing<LatencyMarker, 32> latencyMarkers;
+    // Totals on either side of the ring, the ISR times a marker once playback passes its index
+    uint32_t samplesWritten = 0;
+    uint32_t samplesPlayed = 0;
+    LatencyMarker pendingMarker;
+    bool markerPending = false;
+    PulseModulator modulator;
+    // Played samples for the pitch task, a few hops deep
+    SpscRing<int16_t, 1024> pitchRing;
+    PitchTracker tracker(sampleRateHz, minPitchHz, maxPitchHz);
+    int16_t analysisBuffer[PitchTracker::bufferSize];
+    volatile Voice voice = voicePulses;
+    Voice activeVoice = voicePulses;
+    uint16_t samplesSinceHop = 0;
+    volatile float pitchHz = 0.0f;
+    volatile Mode mode = modePrefetching;
+    volatile bool active = false;
+    bool initialized = false;
+    Stats stats = { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 };
+    // The ISR counts pulses due, the audio task counts pulses handled
+    volatile uint32_t pulsesRequested = 0;
+    uint32_t pulsesHandled = 0;
+    volatile uint16_t burstLength = 20;
+    volatile unsigned long lastWriteMillis = 0;
+    uint16_t expectedSequence = 0;
+    bool sequenceValid = false;
+    TaskHandle_t audioTaskHandle = NULL;
+    hw_timer_t* sampleTimer = NULL;
+
+    void IRAM_ATTR onSample() {
+        if (mode == modePrefetching) {
+            return;
+        }
+
+        int16_t sample;
+        if (!ring.pop(sample)) {
+            stats.underruns++;
+            mode = modePrefetching;
+            return;
+        }
+
+        samplesPlayed++;
+        if (!markerPending) {
+            markerPending = latencyMarkers.pop(pendingMarker);
+        }
+        if (markerPending && (int32_t)(samplesPlayed - pendingMarker.sampleIndex) >= 0) {
+            markerPending = false;
+            uint32_t latency = micros() - pendingMarker.writtenMicros;
+            stats.latencyMicros = stats.latencyMicros == 0 ? latency : (stats.latencyMicros * 15 + latency) / 16;
+            stats.maxLatencyMicros = max(stats.maxLatencyMicros, latency);
+        }
+
+        if (activeVoice == voicePitch) {
+            if (!pitchRing.push(sample)) {
+                stats.overruns++;
+            }
+            if (++samplesSinceHop >= pitchHop) {
+                samplesSinceHop = 0;
+                BaseType_t woken = pdFALSE;
+                vTaskNotifyGiveFromISR(audioTaskHandle, &woken);
+                if (woken) {
+                    portYIELD_FROM_ISR();
+                }
+            }
+            return;
+        }
+
+        if (modulator.step(sample)) {
+            pulsesRequested++;
+            BaseType_t woken = pdFALSE;
+            vTaskNotifyGiveFromISR(audioTaskHandle, &woken);
+            if (woken) {
+                portYIELD_FROM_ISR();
+            }
+        }
+    }
+
+    void audioTask(void* arg) {
+        while (active) {
+            ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(10));
+
+            // Same bookkeeping as the burst task, OCD and the thermal model run off the captured peaks
+            if (CurrentTransformer::processCaptures()) {
+                OCD::checkOCD();
+                CurrentTransformer::BurstPeak burstPeak = CurrentTransformer::getLastBurstPeak();
+                Thermal::addBurst(burstPeak.burstLength, ((uint32_t)burstPeak.endPeakMilliVolts * OCD::turnsRatio) / OCD::burdenMiliohms);
+            } else if (OCD::latched && !CurrentTransformer::capturePending()) {
+                OCD::checkOCD();
+            }
+
+            // A late pulse sounds worse than a missing one, so a backlog collapses into one burst
+            uint32_t requested = pulsesRequested;
+            if (requested == pulsesHandled || !active) {
+                continue;
+            }
+            // Like the burst task, nothing fires until the last burst's capture is in, arming again would throw it
+            // away. At high pulse rates that drops pulses, but OCD and the thermal model see every burst that fires
+            if (CurrentTransformer::capturePending()) {
+                stats.skippedPulses += requested - pulsesHandled;
+                pulsesHandled = requested;
+                continue;
+            }
+            stats.skippedPulses += requested - pulsesHandled - 1;
+            pulsesHandled = requested;
+            stats.pulses++;
+            Burst::singleBurst(burstLength);
+        }
+
+        // Only once no burst can be in flight, the ZCD interrupt ends it
+        ZCD::disableInterrupt();
+        audioTaskHandle = NULL;
+        vTaskDelete(NULL);
+    }
+
+    // Nearest note, held until the pitch moves most of a semitone past it
+    uint8_t pitchToNote(float frequencyHz, uint8_t currentNote) {
+        float note = 69.0f + 12.0f * log2f(frequencyHz / 440.0f);
+        if (currentNote != 0 && fabsf(note - currentNote) < noteHysteresis) {
+            return currentNote;
+        }
+        return constrain(lroundf(note), 1, 127);
+    }
+
+    // Plays through the burst task, so this only picks the note. OCD and the thermal model stay with the burst task
+    void pitchTask(void* arg) {
+        uint8_t currentNote = 0;
+        bool voiced = false;
+        while (active) {
+            ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(50));
+            if (pitchRing.size() < pitchHop || !active) {
+                continue;
+            }
+
+            // Slide the window along by a hop
+            memmove(analysisBuffer, &analysisBuffer[pitchHop], (PitchTracker::bufferSize - pitchHop) * sizeof(int16_t));
+            for (uint16_t i = PitchTracker::bufferSize - pitchHop; i < PitchTracker::bufferSize; i++) {
+                pitchRing.pop(analysisBuffer[i]);
+            }
+
+            uint32_t cyclesStarted = ESP.getCycleCount();
+            PitchTracker::Result result = tracker.analyse(analysisBuffer);
+            uint32_t cycles = ESP.getCycleCount() - cyclesStarted;
+            stats.pitchFrames++;
+            stats.averageFrameCycles = stats.averageFrameCycles == 0 ? cycles : (stats.averageFrameCycles * 7 + cycles) / 8;
+            stats.maxFrameCycles = max(stats.maxFrameCycles, cycles);
+            pitchHz = result.frequencyHz;
+
+            voiced = result.rms >= (voiced ? voiceOffRms : voiceOnRms);
+            if (voiced && result.frequencyHz > 0.0f) {
+                uint8_t note = pitchToNote(result.frequencyHz, currentNote);
+                if (note != currentNote) {
+                    currentNote = note;
+                    MidiControl::playNote(note);
+                }
+            } else if (!voiced && currentNote != 0) {
+                // Unvoiced frames inside a loud passage keep the last note, only the envelope ends it
+                currentNote = 0;
+                MidiControl::stopNote();
+            }
+        }
+
+        if (currentNote != 0) {
+            MidiControl::stopNote();
+        }
+        pitchHz = 0.0f;
+        audioTaskHandle = NULL;
+        vTaskDelete(NULL);
+    }
+
+    void start() {
+        // Nothing is consuming yet, so stale samples can be dropped from this side
+        int16_t discard;
+        while (ring.pop(discard)) {}
+        LatencyMarker discardMarker;
+        while (latencyMarkers.pop(discardMarker)) {}
+        markerPending = false;
+        samplesPlayed = samplesWritten;
+        stats.latencyMicros = 0;
+        stats.maxLatencyMicros = 0;
+        mode = modePrefetching;
+        modulator.reset();
+        modulator.setGate(noiseGate);
+        pulsesRequested = 0;
+        pulsesHandled = 0;
+        pitchRing.clear();
+        memset(analysisBuffer, 0, sizeof(analysisBuffer));
+        samplesSinceHop = 0;
+        activeVoice = voice;
+        active = true;
+
+        if (activeVoice == voicePitch) {
+            xTaskCreatePinnedToCore(pitchTask, "pitchTask", 3072, NULL, 3, &audioTaskHandle, 1);
+        } else {
+            ZCD::enableInterrupt();
+            xTaskCreatePinnedToCore(audioTask, "audioTask", 3072, NULL, 3, &audioTaskHandle, 1);
+        }
+        sampleTimer = timerBegin(timerNumber, timerDivider, true);
+        timerAttachInterrupt(sampleTimer, onSample, true);
+        timerAlarmWrite(sampleTimer, 1000000 / sampleRateHz, true);
+        timerAlarmEnable(sampleTimer);
+        Serial.println("Audio stream started");
+    }
+
+    void stop() {
+        timerAlarmDisable(sampleTimer);
+        timerDetachInterrupt(sampleTimer);
+        timerEnd(sampleTimer);
+        sampleTimer = NULL;
+
+        // The task finishes its burst and cleans up after itself
+        active = false;
+        if (audioTaskHandle != NULL) {
+            xTaskNotifyGive(audioTaskHandle);
+        }
+        if (activeVoice == voicePitch) {
+            Serial.printf("Audio stream stopped, %lu pitch frames at %lu cycles average, %lu max, %lu underruns\n",
+                (unsigned long)stats.pitchFrames, (unsigned long)stats.averageFrameCycles, (unsigned long)stats.maxFrameCycles,
+                (unsigned long)stats.underruns);
+            return;
+        }
+        Serial.printf("Audio stream stopped, %lu pulses, %lu underruns, %lu samples dropped, latency %lu us (max %lu)\n",
+            (unsigned long)stats.pulses, (unsigned long)stats.underruns, (unsigned long)stats.overruns,
+            (unsigned long)stats.latencyMicros, (unsigned long)stats.maxLatencyMicros);
+    }
+
+    void begin() {
+        initialized = true;
+    }
+
+    void handle() {
+        if (!initialized) {
+            return;
+        }
+
+        BleControl::ControlState state = BleControl::getState();
+        bool allowed = state.enabled && !MidiControl::isPlaying && !FrequencySweep::running && !Sequence::isPlaying();
+        if (voice == voicePitch) {
+            // The burst task plays the notes
+            allowed = allowed && state.burstEnabled;
+        } else {
+            allowed = allowed && !state.burstEnabled && !Burst::burstEnabled;
+        }
+        bool streaming = millis() - lastWriteMillis < idleTimeoutMs;
+
+        if (!active) {
+            // Wait for the last task to finish before starting another
+            if (allowed && streaming && audioTaskHandle == NULL) {
+                start();
+            }
+            return;
+        }
+        // A voice change restarts the stream in the new voice on the next call
+        if (!allowed || (!streaming && ring.empty()) || voice != activeVoice) {
+            stop();
+            return;
+        }
+        if (activeVoice == voicePitch) {
+            return;
+        }
+
+        // Pulse rate and length follow the thermal duty cap like the burst scheduler does
+        burstLength = constrain(state.burstLength, 10, maxBurstLength);
+        uint32_t maxRate = (1000000 / burstLength) * Thermal::getMaxDutyPermille() / 1000;
+        modulator.setMaxPulseRate(min(maxRate, maxPulseRateHz), sampleRateHz);
+    }
+
+    size_t write(const int16_t* samples, size_t count) {
+        lastWriteMillis = millis();
+
+        size_t buffered = ring.size();
+        if (mode == modeDropping && buffered <= prefetchSamples) {
+            mode = modeProcessing;
+        }
+
+        size_t written = 0;
+        if (mode != modeDropping) {
+            while (written < count && ring.push(samples[written])) {
+                written++;
+            }
+            if (written < count) {
+                mode = modeDropping;
+            }
+        }
+        stats.overruns += count - written;
+
+        if (written > 0) {
+            samplesWritten += written;
+            // Untimed when the marker ring is full, the next write is timed instead
+            latencyMarkers.push({ samplesWritten, (uint32_t)micros() });
+        }
+
+        if (mode == modePrefetching && ring.size() >= prefetchSamples) {
+            mode = modeProcessing;
+        }
+        return written;
+    }
+
+    void countPacket(uint16_t sequence) {
+        if (sequenceValid && sequence != expectedSequence) {
+            stats.lostPackets += (uint16_t)(sequence - expectedSequence);
+        }
+        expectedSequence = sequence + 1;
+        sequenceValid = true;
+    }
+
+    void setVoice(Voice newVoice) {
+        voice = newVoice == voicePitch ? voicePitch : voicePulses;
+    }
+
+    Voice getVoice() {
+        return voice;
+    }
+
+    float getPitchHz() {
+        return pitchHz;
+    }
+
+    bool isActive() {
+        return active;
+    }
+
+    bool isPulsing() {
+        return active && activeVoice == voicePulses;
+    }
+
+    Mode getMode() {
+        return mode;
+    }
+
+    size_t getBufferedSamples() {
+        return ring.size();
+    }
+
+    Stats getStats() {
+        return stats;
+    }
+}
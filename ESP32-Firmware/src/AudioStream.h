@@ -0,0 +1,59 @@
+#ifndef AUDIOSTREAM_H
+#define AUDIOSTREAM_H
+
+#include <Arduino.h>
+
+// Audio mode: 16 bit mono PCM from any producer (the Wi-Fi transport, a local file) goes into a prefetching ring,
+// a sample rate timer feeds it through PulseModulator, and each pulse fires a short burst.
+// Runs while samples keep arriving, the coil is enabled and nothing else (bursts, MIDI, a sweep) is driving it.
+// The pitch voice instead tracks the stream's pitch and plays it through the burst scheduler like a MIDI note.
+namespace AudioStream {
+    const uint32_t sampleRateHz = 8000;
+
+    enum Voice : uint8_t {
+        voicePulses = 0, // Every pulse of the modulated waveform fires a burst
+        voicePitch = 1   // Detected pitch and envelope drive MidiControl::playNote, needs bursts enabled
+    };
+
+    // Same idea as the A2DP sink's ring buffer modes
+    enum Mode : uint8_t {
+        modeProcessing = 0,  // Playing from the ring
+        modePrefetching = 1, // Filling up before playing, at the start and after an underrun
+        modeDropping = 2     // Ring overflowed, incoming samples dropped until it drains to the prefetch level
+    };
+
+    struct Stats {
+        uint32_t underruns;    // Times the ring ran dry mid-stream
+        uint32_t overruns;     // Samples dropped because the ring was full
+        uint32_t lostPackets;  // Gaps in the transport's sequence numbers
+        uint32_t pulses;
+        uint32_t skippedPulses; // Pulses that came due while the last burst was still firing or its CT capture was pending
+        uint32_t pitchFrames;
+        uint32_t averageFrameCycles; // CPU cycles per pitch frame, smoothed
+        uint32_t maxFrameCycles;
+        uint32_t latencyMicros;    // From a write to its last sample playing, smoothed
+        uint32_t maxLatencyMicros;
+    };
+
+    void begin();
+    void handle();
+
+    // Producer side at sampleRateHz, returns how many samples were taken. AudioSink converts other formats
+    size_t write(const int16_t* samples, size_t count);
+    // For transports that number their packets, counts the gaps
+    void countPacket(uint16_t sequence);
+
+    void setVoice(Voice voice);
+    Voice getVoice();
+    // Last detected pitch in the pitch voice, 0 when unvoiced
+    float getPitchHz();
+
+    bool isActive();
+    // Active and firing bursts itself, rather than through the burst task
+    bool isPulsing();
+    Mode getMode();
+    size_t getBufferedSamples();
+    Stats getStats();
+}
+
+#endif
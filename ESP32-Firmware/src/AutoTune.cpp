@@ -0,0 +1,195 @@
+#include "AutoTune.h"
+#include "BleControl.h"
+#include "FrequencySweep.h"
+#include "CurrentTransformer.h"
+#include "Burst.h"
+#include "OCD.h"
+#include "ZCD.h"
+#include <Preferences.h>
+
+namespace AutoTune {
+    // Constants
+    const uint16_t tuneBurstLength = 30; // In microseconds, a few cycles is enough to see the ramp
+    const uint8_t burstsPerCandidate = 4;
+    const uint16_t phaseLeadStep = 125; // In nanoseconds
+    const uint16_t maxPhaseLead = 1250;
+    const uint8_t candidateCount = maxPhaseLead / phaseLeadStep + 1;
+
+    // Variables
+    Preferences preferences;
+    bool initialized = false;
+    Status status = statusIdle;
+    Result result = { statusIdle, 0, 0, 0, 0, 0 };
+    uint32_t resultSequence = 0;
+
+    uint16_t previousPhaseLead = 0;
+    uint8_t candidate = 0;
+    uint8_t burstsFired = 0;
+    uint32_t peakSums[candidateCount];
+
+    void finish(Status newStatus) {
+        if (status == statusTuningPhase) {
+            ZCD::disableInterrupt();
+            if (newStatus != statusDone) {
+                BleControl::setPhaseLead(previousPhaseLead);
+            }
+        }
+        status = newStatus;
+        result.status = newStatus;
+        resultSequence++;
+    }
+
+    // Vertex of the parabola through three equally spaced points, as an offset from the middle one in steps
+    float parabolicOffset(float left, float middle, float right) {
+        float denominator = left - 2.0f * middle + right;
+        if (denominator == 0.0f) {
+            return 0.0f;
+        }
+        return constrain(0.5f * (left - right) / denominator, -0.5f, 0.5f);
+    }
+
+    bool findResonances() {
+        const FrequencySweep::Point* peaks;
+        uint8_t count = FrequencySweep::getPeaks(peaks);
+        if (count == 0) {
+            return false;
+        }
+
+        result.resonanceHz = peaks[0].frequencyHz;
+        result.secondResonanceHz = count > 1 ? peaks[1].frequencyHz : 0;
+        return true;
+    }
+
+    void startPhaseTuning() {
+        memset(peakSums, 0, sizeof(peakSums));
+        previousPhaseLead = BleControl::getState().phaseLead;
+        candidate = 0;
+        burstsFired = 0;
+        BleControl::setPhaseLead(0);
+        ZCD::enableInterrupt();
+        status = statusTuningPhase;
+        result.status = status;
+        resultSequence++;
+    }
+
+    void finishPhaseTuning() {
+        uint8_t bestCandidate = 0;
+        for (uint8_t i = 1; i < candidateCount; i++) {
+            if (peakSums[i] > peakSums[bestCandidate]) {
+                bestCandidate = i;
+            }
+        }
+
+        float offset = 0.0f;
+        if (bestCandidate > 0 && bestCandidate + 1 < candidateCount) {
+            offset = parabolicOffset(peakSums[bestCandidate - 1], peakSums[bestCandidate], peakSums[bestCandidate + 1]);
+        }
+        result.phaseLead = constrain((int32_t)((bestCandidate + offset) * phaseLeadStep), 0, maxPhaseLead);
+        result.peakMilliVolts = peakSums[bestCandidate] / burstsPerCandidate;
+        BleControl::setPhaseLead(result.phaseLead);
+
+        if (initialized) {
+            preferences.putUShort("lead", result.phaseLead);
+            preferences.putULong("freq", result.resonanceHz);
+            preferences.putULong("freq2", result.secondResonanceHz);
+        }
+        finish(statusDone);
+    }
+
+    void begin() {
+        initialized = preferences.begin("autotune", false);
+        if (!initialized || !preferences.isKey("lead")) {
+            return;
+        }
+
+        result.phaseLead = preferences.getUShort("lead", 0);
+        result.resonanceHz = preferences.getULong("freq", 0);
+        result.secondResonanceHz = preferences.getULong("freq2", 0);
+        BleControl::setPhaseLead(result.phaseLead);
+    }
+
+    void start() {
+        BleControl::ControlState state = BleControl::getState();
+        if (status == statusSweeping || status == statusTuningPhase) {
+            return;
+        }
+        if (!state.enabled || state.burstEnabled || Burst::burstEnabled) {
+            finish(statusFailed);
+            return;
+        }
+
+        // Flag first, handle() takes a cleared flag to mean the sweep is over
+        BleControl::startFrequencySweep();
+        status = statusSweeping;
+        result.status = status;
+        resultSequence++;
+    }
+
+    void cancel() {
+        if (status == statusSweeping) {
+            BleControl::resetStartFrequencySweep();
+            FrequencySweep::cancel();
+        }
+        if (status == statusSweeping || status == statusTuningPhase) {
+            finish(statusIdle);
+        }
+    }
+
+    void handle() {
+        if (status == statusSweeping) {
+            // FrequencySweep::handle sets running as it clears the start flag, the sweep task clears it when done
+            if (BleControl::getState().startFrequencySweep || FrequencySweep::running) {
+                return;
+            }
+            if (FrequencySweep::getProgress().state != FrequencySweep::stateDone || !findResonances()) {
+                finish(statusFailed);
+                return;
+            }
+            startPhaseTuning();
+            return;
+        }
+
+        if (status != statusTuningPhase) {
+            return;
+        }
+
+        // Someone turned bursts on or the coil off mid-tune
+        BleControl::ControlState state = BleControl::getState();
+        if (!state.enabled || state.burstEnabled) {
+            finish(statusFailed);
+            return;
+        }
+
+        // One burst per call, the loop's delay keeps the duty cycle tiny
+        if (CurrentTransformer::capturePending()) {
+            if (!CurrentTransformer::processCaptures()) {
+                return;
+            }
+            OCD::checkOCD();
+            peakSums[candidate] += CurrentTransformer::getLastBurstPeak().endPeakMilliVolts;
+            if (++burstsFired >= burstsPerCandidate) {
+                burstsFired = 0;
+                if (++candidate >= candidateCount) {
+                    finishPhaseTuning();
+                    return;
+                }
+                BleControl::setPhaseLead(candidate * phaseLeadStep);
+            }
+        }
+
+        if (OCD::ocdTriggered) {
+            finish(statusFailed);
+            OCD::resetOCDTriggered();
+            return;
+        }
+        Burst::singleBurst(tuneBurstLength);
+    }
+
+    Result getResult() {
+        return result;
+    }
+
+    uint32_t getResultSequence() {
+        return resultSequence;
+    }
+}
@@ -0,0 +1,36 @@
+#ifndef AUTOTUNE_H
+#define AUTOTUNE_H
+
+#include <Arduino.h>
+
+// Finds the resonances from a frequency sweep, then the phase lead that gives the biggest current ramp over a
+// few low power bursts. Results are kept in NVS and the phase lead is applied at boot.
+namespace AutoTune {
+    enum Status : uint8_t {
+        statusIdle = 0,
+        statusSweeping = 1,
+        statusTuningPhase = 2,
+        statusDone = 3,
+        statusFailed = 4 // Coil disabled, bursts running, or no resonance found
+    };
+
+    // Packed for the BLE characteristic, little endian
+    struct Result {
+        uint8_t status;
+        uint8_t reserved;
+        uint16_t phaseLead; // Nanoseconds
+        uint32_t resonanceHz; // Strongest peak
+        uint32_t secondResonanceHz; // 0 if only one was found
+        uint16_t peakMilliVolts; // CT peak of the tuning bursts at the chosen phase lead
+    } __attribute__((packed));
+
+    void begin();
+    void handle();
+    void start();
+    void cancel();
+
+    Result getResult();
+    uint32_t getResultSequence();
+}
+
+#endif
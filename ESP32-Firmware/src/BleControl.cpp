@@ -1,10 +1,20 @@
 #include "BleControl.h"
 #include "MidiControl.h"
+#include "Presets.h"
+#include "OCD.h"
+#include "Scope.h"
+#include "AutoTune.h"
+#include "FrequencySweep.h"
+#include "Sequence.h"
+#include "Trace.h"
+#include "Metrics.h"
 
 #include <BLEDevice.h>
 #include <BLEUtils.h>
 #include <BLEServer.h>
 #include <BLE2902.h>
+#include <esp_gap_ble_api.h>
+#include "SpscRing.h"
 
 namespace {
 	BLE2902* pid2902 = new BLE2902();
@@ -24,12 +34,21 @@ namespace {
 	const char *PLAY_MIDI = "c8160660-e062-460c-8834-06f539975761"; // bool write
 	const char *UUID_MIDI_OCTAVE = "d8160660-e062-460c-8834-06f539975761"; // int8 write
 	const char *UUID_CHORD_SWAP_TIME = "e8160660-e062-460c-8834-06f539975761"; // uint8 write
+	const char *UUID_PARAMETER_BLOCK = "f8160660-e062-460c-8834-06f539975761"; // packed parameter block write
+	const char *UUID_PRESET = "f8160661-e062-460c-8834-06f539975761"; // u8 op, u8 index, name write
+	const char *UUID_LATENCY = "f8160662-e062-460c-8834-06f539975761"; // u32 ping notify, echo write, latency stats read
+	const char *UUID_OCD_TRIPS = "f8160663-e062-460c-8834-06f539975761"; // OCD trip log read, newest trip notify
+	const char *UUID_SCOPE = "f8160664-e062-460c-8834-06f539975761"; // u16 pre, u16 post, u8 count write, capture chunks notify
+	const char *UUID_AUTOTUNE = "f8160665-e062-460c-8834-06f539975761"; // u8 start/cancel write, AutoTune::Result read/notify
+	const char *UUID_SEQUENCE = "f8160666-e062-460c-8834-06f539975761"; // u8 op (Sequence::Op) write, Sequence::Status read/notify
+	const char *UUID_DIAGNOSTICS = "f8160667-e062-460c-8834-06f539975761"; // Metrics::Snapshot read/notify each second, any write resets the counters
 
 	const char* FREQUENCY_SWEEP_SERVICE_UUID =  "08160661-e062-460c-8834-06f539975761"; // insert uuid here
 	const char* UUID_MIN_FREQ_SWEEP = "08160662-e062-460c-8834-06f539975761"; // u16 write
 	const char* UUID_MAX_FREQ_SWEEP = "08160663-e062-460c-8834-06f539975761"; // u16 write
-	const char* UUID_START_FREQ_SWEEP = "08160664-e062-460c-8834-06f539975761"; // bool write
-	const char* UUID_FREQ_SWEEP_DATA = "08160665-e062-460c-8834-06f539975761"; // u32 read
+	const char* UUID_START_FREQ_SWEEP = "08160664-e062-460c-8834-06f539975761"; // u8 command (FrequencySweep::Command), optional config write
+	const char* UUID_FREQ_SWEEP_DATA = "08160665-e062-460c-8834-06f539975761"; // batched sweep results notify
+	const char* UUID_FREQ_SWEEP_PROGRESS = "08160666-e062-460c-8834-06f539975761"; // FrequencySweep::Progress read/notify
 
 	const BLEUUID* serviceBLEUUID = new BLEUUID(SERVICE_UUID);
 
@@ -50,16 +69,444 @@ namespace {
 	BLECharacteristic* chMaxFreqSweep = nullptr;
 	BLECharacteristic* chStartFreqSweep = nullptr;
 	BLECharacteristic* chFreqSweepData = nullptr;
+	BLECharacteristic* chFreqSweepProgress = nullptr;
 	BLECharacteristic* chMidiUpload = nullptr;
 	BLECharacteristic* chPlayMidi = nullptr;
 	BLECharacteristic* chMidiOctave = nullptr;
 	BLECharacteristic* chChordSwapTime = nullptr;
+	BLECharacteristic* chParameterBlock = nullptr;
+	BLECharacteristic* chPreset = nullptr;
+	BLECharacteristic* chLatency = nullptr;
+	BLECharacteristic* chOcdTrips = nullptr;
+	BLECharacteristic* chScope = nullptr;
+	BLECharacteristic* chAutoTune = nullptr;
+	BLECharacteristic* chSequence = nullptr;
+	BLECharacteristic* chDiagnostics = nullptr;
 
 	BleControl::ControlState state { false, 100, 2, 90, 110, false, false, 0, false, 0, 20 };
+	// Guards state so a parameter block is never seen half-applied by the burst task or ZCD ISR
+	portMUX_TYPE stateMux = portMUX_INITIALIZER_UNLOCKED;
+
+	// Connected centrals, e.g. a phone controlling the coil plus a laptop logging it. Written from the BLE stack's
+	// callbacks on the comms core and read from loop(), so only touched under peersMux
+	const uint8_t maxClients = 3;
+	struct Peer {
+		bool connected;
+		uint16_t connId;
+		esp_bd_addr_t address;
+		bool live;
+		uint32_t subscriptions; // Bit per subscribable entry this central enabled notifications on
+	};
+	Peer peers[maxClients] = {};
+	uint8_t connectedCount = 0;
+	portMUX_TYPE peersMux = portMUX_INITIALIZER_UNLOCKED;
+
+	// BLE2902 keeps one CCCD value for all centrals, so each central's own CCCD writes are tracked here instead
+	const uint8_t maxSubscribable = 32;
+	struct Subscribable {
+		BLECharacteristic* characteristic;
+		BLE2902* cccd;
+	};
+	Subscribable subscribable[maxSubscribable];
+	uint8_t subscribableCount = 0;
+	esp_gatt_if_t gattsInterface = ESP_GATT_IF_NONE;
+	// Last central to write a control characteristic, bursts stop if it drops
+	int32_t controllerConnId = -1;
+
+	// State changes are pushed to subscribers at most this often, so fast MIDI bps changes coalesce
+	const unsigned long publishIntervalMs = 50;
+	BleControl::ControlState publishedState;
+	bool publishedPlaying = false;
+	bool statePublished = false;
+	unsigned long lastPublishMillis = 0;
+	uint32_t publishedTripSequence = 0;
+	uint32_t publishedAutoTuneSequence = 0;
+	uint32_t publishedSequenceStatus = 0;
+	uint32_t publishedSweepProgressSequence = 0;
+	uint32_t publishedMetricsSequence = 0;
+
+	// Connection parameters, intervals in 1.25ms units and timeout in 10ms units
+	const uint16_t liveMinInterval = 0x06; // 7.5ms
+	const uint16_t liveMaxInterval = 0x0C; // 15ms
+	const uint16_t liveLatency = 0;
+	const uint16_t idleMinInterval = 0x18; // 30ms
+	const uint16_t idleMaxInterval = 0x30; // 60ms
+	const uint16_t idleLatency = 4;
+	const uint16_t supervisionTimeout = 400; // 4s
+	const unsigned long latencyPingIntervalMs = 2000;
+	const unsigned long latencyPingTimeoutMs = 5000;
+
+
+	// Round-trip latency, in microseconds
+	struct LatencyStats {
+		uint32_t pingToken;
+		uint32_t last;
+		uint32_t min;
+		uint32_t max;
+		uint32_t average;
+	};
+	LatencyStats latencyStats = { 0, 0, 0, 0, 0 };
+	bool pingOutstanding = false;
+	unsigned long lastPingMillis = 0;
+
+	// Takes a copy of the peer, the stack isn't called with peersMux held
+	void requestConnParams(Peer peer, bool live) {
+		if (!peer.connected || server == nullptr) {
+			return;
+		}
+
+		if (live) {
+			server->updateConnParams(peer.address, liveMinInterval, liveMaxInterval, liveLatency, supervisionTimeout);
+#if CONFIG_BT_BLE_50_FEATURES_SUPPORTED
+			esp_ble_gap_set_preferred_phy(peer.address, ESP_BLE_GAP_PHY_OPTIONS_NO_PREF, ESP_BLE_GAP_PHY_2M_PREF_MASK, ESP_BLE_GAP_PHY_2M_PREF_MASK, ESP_BLE_GAP_PHY_OPTIONS_NO_PREF);
+#endif
+		} else {
+			server->updateConnParams(peer.address, idleMinInterval, idleMaxInterval, idleLatency, supervisionTimeout);
+		}
+	}
+
+	void addSubscribable(BLECharacteristic* ch, BLE2902* cccd) {
+		ch->addDescriptor(cccd);
+		if (subscribableCount < maxSubscribable) {
+			subscribable[subscribableCount++] = { ch, cccd };
+		}
+	}
+
+	// Sends the characteristic's value to the centrals that subscribed to it themselves, each cut to its own MTU
+	void notifySubscribers(BLECharacteristic* ch) {
+		uint32_t mask = 0;
+		for (uint8_t i = 0; i < subscribableCount; i++) {
+			if (subscribable[i].characteristic == ch) {
+				mask = 1UL << i;
+				break;
+			}
+		}
+		if (mask == 0 || server == nullptr || gattsInterface == ESP_GATT_IF_NONE) {
+			return;
+		}
+
+		Peer snapshot[maxClients];
+		portENTER_CRITICAL(&peersMux);
+		memcpy(snapshot, peers, sizeof(peers));
+		portEXIT_CRITICAL(&peersMux);
+
+		for (const Peer& peer : snapshot) {
+			if (!peer.connected || !(peer.subscriptions & mask)) {
+				continue;
+			}
+			uint16_t length = min((size_t)ch->getLength(), (size_t)server->getPeerMTU(peer.connId) - 3);
+			if (esp_ble_gatts_send_indicate(gattsInterface, peer.connId, ch->getHandle(), length, ch->getData(), false) == ESP_OK) {
+				Metrics::recordBleNotify(length);
+			}
+		}
+	}
+
+	// Sees every GATT server event after BLEServer has, for the CCCD writes BLE2902 doesn't say the writer of
+	void onGattsEvent(esp_gatts_cb_event_t event, esp_gatt_if_t gattsIf, esp_ble_gatts_cb_param_t* param) {
+		gattsInterface = gattsIf;
+		if (event != ESP_GATTS_WRITE_EVT || param->write.is_prep || param->write.len != 2) {
+			return;
+		}
+
+		for (uint8_t i = 0; i < subscribableCount; i++) {
+			if (subscribable[i].cccd->getHandle() != param->write.handle) {
+				continue;
+			}
+
+			bool notify = (param->write.value[0] & 0x01) != 0;
+			bool subscribed = false;
+			portENTER_CRITICAL(&peersMux);
+			for (Peer& peer : peers) {
+				if (peer.connected && peer.connId == param->write.conn_id) {
+					subscribed = notify && !(peer.subscriptions & (1UL << i));
+					peer.subscriptions = notify ? peer.subscriptions | (1UL << i) : peer.subscriptions & ~(1UL << i);
+				}
+			}
+			portEXIT_CRITICAL(&peersMux);
+			// New subscribers get the full state on the next publish
+			if (subscribed) {
+				statePublished = false;
+			}
+			return;
+		}
+	}
+
+	// Smallest MTU across connected centrals, notifications go to all of them
+	uint16_t getMinPeerMtu() {
+		uint16_t mtu = 0;
+		for (auto& peerDevice : server->getPeerDevices(false)) {
+			if (mtu == 0 || peerDevice.second.mtu < mtu) {
+				mtu = peerDevice.second.mtu;
+			}
+		}
+		return mtu == 0 ? 23 : mtu;
+	}
+
+	void handleLatencyEcho(const std::string& value) {
+		if (!pingOutstanding || value.size() < 4) {
+			return;
+		}
+
+		uint32_t token;
+		memcpy(&token, value.data(), sizeof(uint32_t));
+		if (token != latencyStats.pingToken) {
+			return;
+		}
+
+		uint32_t roundTrip = (uint32_t)micros() - token;
+		pingOutstanding = false;
+		latencyStats.last = roundTrip;
+		if (latencyStats.min == 0 || roundTrip < latencyStats.min) {
+			latencyStats.min = roundTrip;
+		}
+		if (roundTrip > latencyStats.max) {
+			latencyStats.max = roundTrip;
+		}
+		// Exponential moving average with a weight of 1/8
+		latencyStats.average = latencyStats.average == 0 ? roundTrip : latencyStats.average - (latencyStats.average >> 3) + (roundTrip >> 3);
+	}
+
+	void sendLatencyPing() {
+		if (connectedCount == 0 || chLatency == nullptr) {
+			return;
+		}
+
+		unsigned long now = millis();
+		if (pingOutstanding && now - lastPingMillis < latencyPingTimeoutMs) {
+			return;
+		}
+		if (now - lastPingMillis < latencyPingIntervalMs) {
+			return;
+		}
+
+		lastPingMillis = now;
+		latencyStats.pingToken = micros();
+		pingOutstanding = true;
+		chLatency->setValue((uint8_t*)&latencyStats, sizeof(LatencyStats));
+		notifySubscribers(chLatency);
+	}
+
+	uint16_t readU16(const uint8_t* data) {
+		return data[0] | (data[1] << 8);
+	}
+
+	void writeU16(uint8_t* out, uint16_t v) {
+		out[0] = v & 0xFF;
+		out[1] = v >> 8;
+	}
+
+	// Frequency sweep batches: u16 sequence, u8 sample count, u8 flags, then per sample u32 frequency (Hz), u16 CT (mV),
+	// i16 error (Hz, achieved minus requested)
+	struct SweepSample {
+		uint32_t frequencyHz; // 0 marks the end of a sweep
+		uint16_t ctMilliVolts;
+		int16_t errorHz;
+	};
+	const uint16_t requestedMtu = 247;
+	const size_t sweepBatchHeaderSize = 4;
+	const size_t sweepSampleSize = 8;
+	const size_t maxSweepBatchSize = requestedMtu - 3;
+	const uint8_t sweepBatchFlagComplete = 1;
+	const unsigned long notifyTaskIntervalMs = 10;
+
+	SpscRing<SweepSample, 256> sweepRing;
+	uint16_t sweepSequence = 0;
+	TaskHandle_t notifyTaskHandle = NULL;
+
+	void flushFrequencySweepData() {
+		if (chFreqSweepData == nullptr || sweepRing.empty()) {
+			return;
+		}
+
+		// Fill one notification up to the negotiated MTU
+		uint16_t mtu = getMinPeerMtu();
+		size_t batchSize = constrain((size_t)mtu - 3, sweepBatchHeaderSize + sweepSampleSize, maxSweepBatchSize);
+		uint8_t batch[maxSweepBatchSize];
+		size_t length = sweepBatchHeaderSize;
+		uint8_t count = 0;
+		uint8_t flags = 0;
+		SweepSample sample;
+		while (length + sweepSampleSize <= batchSize && sweepRing.pop(sample)) {
+			if (sample.frequencyHz == 0) {
+				flags |= sweepBatchFlagComplete;
+				break;
+			}
+
+			memcpy(&batch[length], &sample.frequencyHz, sizeof(uint32_t));
+			memcpy(&batch[length + 4], &sample.ctMilliVolts, sizeof(uint16_t));
+			memcpy(&batch[length + 6], &sample.errorHz, sizeof(int16_t));
+			length += sweepSampleSize;
+			count++;
+		}
+
+		writeU16(&batch[0], sweepSequence++);
+		batch[2] = count;
+		batch[3] = flags;
+		chFreqSweepData->setValue(batch, length);
+		notifySubscribers(chFreqSweepData);
+
+		if (flags & sweepBatchFlagComplete) {
+			sweepSequence = 0;
+		}
+	}
+
+	void publishU8(BLECharacteristic* ch, uint8_t v) {
+		ch->setValue(&v, 1);
+		notifySubscribers(ch);
+	}
+
+	void publishU16(BLECharacteristic* ch, uint16_t v) {
+		uint8_t value[2];
+		writeU16(value, v);
+		ch->setValue(value, 2);
+		notifySubscribers(ch);
+	}
+
+	// Notify every subscriber of whatever changed since the last publish, whoever changed it
+	void publishState() {
+		unsigned long now = millis();
+		if (connectedCount == 0 || now - lastPublishMillis < publishIntervalMs) {
+			return;
+		}
+
+		BleControl::ControlState s = BleControl::getState();
+		bool playing = MidiControl::isPlaying;
+		bool force = !statePublished;
+		// A show's own parameter changes stay off the air while it plays, the state after it is published as usual
+		if (Sequence::isPlaying() && statePublished) {
+			s = publishedState;
+		}
+		BleControl::ControlState& p = publishedState;
+		bool blockChanged = force;
+		if (force || s.enabled != p.enabled) { publishU8(chToggle, s.enabled); blockChanged = true; }
+		if (force || s.burstLength != p.burstLength) { publishU16(chBurst, s.burstLength); blockChanged = true; }
+		if (force || s.bps != p.bps) { publishU16(chBps, s.bps); blockChanged = true; }
+		if (force || s.burstEnabled != p.burstEnabled) { publishU8(chBurstEnabled, s.burstEnabled); blockChanged = true; }
+		if (force || s.phaseLead != p.phaseLead) { publishU16(chPhaseLead, s.phaseLead); blockChanged = true; }
+		if (force || s.reverseBurstPhase != p.reverseBurstPhase) { publishU8(chReverseBurstPhase, s.reverseBurstPhase); blockChanged = true; }
+		if (force || s.midiOctave != p.midiOctave) { publishU8(chMidiOctave, (uint8_t)s.midiOctave); blockChanged = true; }
+		if (force || s.chordSwapTime != p.chordSwapTime) { publishU8(chChordSwapTime, s.chordSwapTime); blockChanged = true; }
+		if (force || s.minFrequencySweep != p.minFrequencySweep) { publishU16(chMinFreqSweep, s.minFrequencySweep); }
+		if (force || s.maxFrequencySweep != p.maxFrequencySweep) { publishU16(chMaxFreqSweep, s.maxFrequencySweep); }
+		if (force || playing != publishedPlaying) { publishU8(chPlayMidi, playing); }
+		if (blockChanged) {
+			uint8_t block[BleControl::parameterBlockSize];
+			BleControl::encodeParameterBlock(s, block);
+			chParameterBlock->setValue(block, sizeof(block));
+			notifySubscribers(chParameterBlock);
+		}
+
+		// Newest OCD trip, the full log is read on demand
+		uint32_t tripSequence = OCD::getTripSequence();
+		if (tripSequence != publishedTripSequence) {
+			OCD::Trip trips[OCD::maxTrips];
+			uint8_t count = OCD::getTrips(trips, OCD::maxTrips);
+			if (count > 0) {
+				chOcdTrips->setValue((uint8_t*)&trips[count - 1], sizeof(OCD::Trip));
+				notifySubscribers(chOcdTrips);
+			}
+			publishedTripSequence = tripSequence;
+		}
+
+		uint32_t autoTuneSequence = AutoTune::getResultSequence();
+		if (autoTuneSequence != publishedAutoTuneSequence) {
+			AutoTune::Result result = AutoTune::getResult();
+			chAutoTune->setValue((uint8_t*)&result, sizeof(result));
+			notifySubscribers(chAutoTune);
+			publishedAutoTuneSequence = autoTuneSequence;
+		}
+
+		uint32_t sequenceStatus = Sequence::getStatusSequence();
+		if (sequenceStatus != publishedSequenceStatus) {
+			Sequence::Status status = Sequence::getStatus();
+			chSequence->setValue((uint8_t*)&status, sizeof(status));
+			notifySubscribers(chSequence);
+			publishedSequenceStatus = sequenceStatus;
+		}
+
+		// Rate limited along with everything else, the points themselves stream through the sweep data batches
+		uint32_t sweepProgressSequence = FrequencySweep::getProgressSequence();
+		if (sweepProgressSequence != publishedSweepProgressSequence) {
+			FrequencySweep::Progress progress = FrequencySweep::getProgress();
+			chFreqSweepProgress->setValue((uint8_t*)&progress, sizeof(progress));
+			notifySubscribers(chFreqSweepProgress);
+			publishedSweepProgressSequence = sweepProgressSequence;
+		}
+
+		uint32_t metricsSequence = Metrics::getSequence();
+		if (metricsSequence != publishedMetricsSequence) {
+			Metrics::Snapshot snapshot = Metrics::getSnapshot();
+			chDiagnostics->setValue((uint8_t*)&snapshot, sizeof(snapshot));
+			notifySubscribers(chDiagnostics);
+			publishedMetricsSequence = metricsSequence;
+		}
+
+		publishedState = s;
+		publishedPlaying = playing;
+		statePublished = true;
+		lastPublishMillis = now;
+	}
+
+	// Scope captures go out in chunks: u16 capture sequence, u16 offset, u16 total length, then the encoded bytes
+	const size_t scopeChunkHeaderSize = 6;
+	const uint8_t scopeChunksPerTick = 4;
+	uint8_t* scopeCapture = nullptr;
+	size_t scopeCaptureLength = 0;
+	size_t scopeCaptureOffset = 0;
+	uint16_t scopeSequence = 0;
+
+	void flushScope() {
+		if (chScope == nullptr || connectedCount == 0) {
+			return;
+		}
+		if (scopeCapture == nullptr) {
+			scopeCapture = (uint8_t*)malloc(Scope::maxCaptureBytes);
+			if (scopeCapture == nullptr) {
+				return;
+			}
+		}
+
+		for (uint8_t chunk = 0; chunk < scopeChunksPerTick; chunk++) {
+			if (scopeCaptureOffset >= scopeCaptureLength) {
+				scopeCaptureLength = Scope::popCapture(Scope::sinkBle, scopeCapture);
+				scopeCaptureOffset = 0;
+				if (scopeCaptureLength == 0) {
+					return;
+				}
+				scopeSequence++;
+			}
+
+			uint8_t batch[maxSweepBatchSize];
+			size_t chunkSize = min((size_t)getMinPeerMtu() - 3, maxSweepBatchSize) - scopeChunkHeaderSize;
+			chunkSize = min(chunkSize, scopeCaptureLength - scopeCaptureOffset);
+			writeU16(&batch[0], scopeSequence);
+			writeU16(&batch[2], scopeCaptureOffset);
+			writeU16(&batch[4], scopeCaptureLength);
+			memcpy(&batch[scopeChunkHeaderSize], &scopeCapture[scopeCaptureOffset], chunkSize);
+			chScope->setValue(batch, scopeChunkHeaderSize + chunkSize);
+			notifySubscribers(chScope);
+			scopeCaptureOffset += chunkSize;
+		}
+	}
+
+	// Runs on the comms core so the sweep's timing loop never calls into the BLE stack
+	void notifyTask(void* arg) {
+		while (true) {
+			flushFrequencySweepData();
+			flushScope();
+			publishState();
+			delay(notifyTaskIntervalMs);
+		}
+	}
 
 	class ControlCallbacks : public BLECharacteristicCallbacks {
-		void onWrite(BLECharacteristic* characteristic) override {
+		void onWrite(BLECharacteristic* characteristic, esp_ble_gatts_cb_param_t* param) override {
+			uint32_t startCycles = ESP.getCycleCount();
 			std::string value = characteristic->getValue();
+			Trace::record(Trace::bleWrite, value.size());
+			if (characteristic != chLatency && characteristic != chPreset && characteristic != chScope && characteristic != chDiagnostics) {
+				controllerConnId = param->write.conn_id;
+			}
 			// Serial.println("Characteristic was written to:");
 			// Serial.println(characteristic == chStartFreqSweep);
 			// Serial.println(value.size());
@@ -86,7 +533,28 @@ namespace {
 					state.maxFrequencySweep = v;
 				}
 			} else if (characteristic == chStartFreqSweep) {
-				state.startFrequencySweep = (!value.empty() && (uint8_t)value[0] != 0);
+				uint8_t command = value.empty() ? FrequencySweep::commandCancel : (uint8_t)value[0];
+				// Start is optionally followed by the sweep config: mode, coarse step kHz, settle cycles, dwell ms, fine step Hz (u16), peaks
+				if (command == FrequencySweep::commandStart && value.size() >= 8) {
+					FrequencySweep::Config config;
+					config.mode = (uint8_t)value[1] == FrequencySweep::modeLinear ? FrequencySweep::modeLinear : FrequencySweep::modeAdaptive;
+					config.coarseStepKHz = (uint8_t)value[2];
+					config.settleCycles = (uint8_t)value[3];
+					config.dwellMs = (uint8_t)value[4];
+					config.fineStepHz = ((uint8_t)value[5]) | (((uint8_t)value[6]) << 8);
+					config.refinePeaks = (uint8_t)value[7];
+					FrequencySweep::setConfig(config);
+				}
+				if (command == FrequencySweep::commandStart) {
+					state.startFrequencySweep = true;
+				} else if (command == FrequencySweep::commandPause) {
+					FrequencySweep::pause();
+				} else if (command == FrequencySweep::commandResume) {
+					FrequencySweep::resume();
+				} else {
+					state.startFrequencySweep = false;
+					FrequencySweep::cancel();
+				}
 			} else if (characteristic == chBurstEnabled) {
 				state.burstEnabled = (!value.empty() && (uint8_t)value[0] != 0);
 			} else if (characteristic == chPhaseLead) {
@@ -98,10 +566,6 @@ namespace {
 				state.reverseBurstPhase = (!value.empty() && (uint8_t)value[0] != 0);
 			} else if (characteristic == chMidiUpload) {
 				// Forward chunk to MidiControl
-				Serial.println("MidiUpload");
-				Serial.print(value.size());
-				Serial.print(" | ");
-				Serial.println(value.data());
 				if (!value.empty()) {
 					MidiControl::receiveChunk((const uint8_t*)value.data(), value.size());
 				} else {
@@ -121,18 +585,132 @@ namespace {
 					uint8_t chordSwapTime = (uint8_t)value[0];
 					state.chordSwapTime = chordSwapTime;
 				}
+			} else if (characteristic == chParameterBlock) {
+				if (!BleControl::applyParameterBlock((const uint8_t*)value.data(), value.size())) {
+					Serial.println("Parameter block rejected");
+				}
+			} else if (characteristic == chPreset) {
+				Presets::handleCommand((const uint8_t*)value.data(), value.size());
+			} else if (characteristic == chSequence) {
+				Sequence::handleCommand((const uint8_t*)value.data(), value.size());
+			} else if (characteristic == chLatency) {
+				handleLatencyEcho(value);
+			} else if (characteristic == chAutoTune) {
+				if (!value.empty() && value[0] != 0) {
+					AutoTune::start();
+				} else {
+					AutoTune::cancel();
+				}
+			} else if (characteristic == chScope) {
+				// A count of 0 disarms
+				if (value.size() >= 5 && value[4] != 0) {
+					uint16_t preTrigger = ((uint8_t)value[0]) | (((uint8_t)value[1]) << 8);
+					uint16_t postTrigger = ((uint8_t)value[2]) | (((uint8_t)value[3]) << 8);
+					Scope::arm(preTrigger, postTrigger, (uint8_t)value[4], Scope::sinkBle);
+				} else {
+					Scope::disarm();
+				}
+			} else if (characteristic == chDiagnostics) {
+				Metrics::reset();
+			}
+			Metrics::recordBleWrite(value.size(), ESP.getCycleCount() - startCycles);
+		}
+
+		// Only the readings still go through notify(), notifySubscribers counts the rest
+		void onNotify(BLECharacteristic* characteristic) override {
+			Metrics::recordBleNotify(characteristic->getLength());
+		}
+
+		void onRead(BLECharacteristic* characteristic) override {
+			if (characteristic == chParameterBlock) {
+				uint8_t block[BleControl::parameterBlockSize];
+				BleControl::encodeParameterBlock(BleControl::getState(), block);
+				characteristic->setValue(block, sizeof(block));
+			} else if (characteristic == chPreset) {
+				// Every slot's name back to back, empty slots are all zeros
+				uint8_t names[Presets::maxPresets * Presets::maxNameLength] = {};
+				for (uint8_t i = 0; i < Presets::maxPresets; i++) {
+					char name[Presets::maxNameLength + 1];
+					if (Presets::getName(i, name)) {
+						memcpy(&names[i * Presets::maxNameLength], name, strnlen(name, Presets::maxNameLength));
+					}
+				}
+				characteristic->setValue(names, sizeof(names));
+			} else if (characteristic == chLatency) {
+				characteristic->setValue((uint8_t*)&latencyStats, sizeof(LatencyStats));
+			} else if (characteristic == chAutoTune) {
+				AutoTune::Result result = AutoTune::getResult();
+				characteristic->setValue((uint8_t*)&result, sizeof(result));
+			} else if (characteristic == chFreqSweepProgress) {
+				FrequencySweep::Progress progress = FrequencySweep::getProgress();
+				characteristic->setValue((uint8_t*)&progress, sizeof(progress));
+			} else if (characteristic == chSequence) {
+				Sequence::Status status = Sequence::getStatus();
+				characteristic->setValue((uint8_t*)&status, sizeof(status));
+			} else if (characteristic == chScope) {
+				uint8_t status[2] = { Scope::isArmed(), Scope::getPendingCaptures() };
+				characteristic->setValue(status, sizeof(status));
+			} else if (characteristic == chDiagnostics) {
+				Metrics::Snapshot snapshot = Metrics::getSnapshot();
+				characteristic->setValue((uint8_t*)&snapshot, sizeof(snapshot));
+			} else if (characteristic == chOcdTrips) {
+				// Trips oldest first, 16 bytes each
+				OCD::Trip trips[OCD::maxTrips];
+				uint8_t count = OCD::getTrips(trips, OCD::maxTrips);
+				characteristic->setValue((uint8_t*)trips, count * sizeof(OCD::Trip));
 			}
 		}
 	};
 
 	class ServerCallbacks : public BLEServerCallbacks {
-		void onConnect(BLEServer* pServer) override {
-			// Client connected
+		void onConnect(BLEServer* pServer, esp_ble_gatts_cb_param_t* param) override {
+			Peer joined = {};
+			portENTER_CRITICAL(&peersMux);
+			for (uint8_t i = 0; i < maxClients; i++) {
+				Peer& peer = peers[i];
+				if (peer.connected) {
+					continue;
+				}
+
+				// Start relaxed, BleControl::handle tightens the interval once a live-play session starts.
+				// Nothing subscribed until the central writes its CCCDs
+				peer.connected = true;
+				peer.connId = param->connect.conn_id;
+				memcpy(peer.address, param->connect.remote_bda, sizeof(esp_bd_addr_t));
+				peer.live = false;
+				peer.subscriptions = 0;
+				joined = peer;
+				connectedCount++;
+				break;
+			}
+			portEXIT_CRITICAL(&peersMux);
+			requestConnParams(joined, false);
+
+			// Keep advertising so more centrals can join
+			if (connectedCount < maxClients) {
+				BLEDevice::startAdvertising();
+			}
 		}
 
-		void onDisconnect(BLEServer* pServer) override {
-			// Disable burstEnabled when client disconnects
-			state.burstEnabled = false;
+		void onDisconnect(BLEServer* pServer, esp_ble_gatts_cb_param_t* param) override {
+			uint16_t connId = param->disconnect.conn_id;
+			portENTER_CRITICAL(&peersMux);
+			for (uint8_t i = 0; i < maxClients; i++) {
+				Peer& peer = peers[i];
+				if (peer.connected && peer.connId == connId) {
+					peer.connected = false;
+					connectedCount--;
+					break;
+				}
+			}
+			portEXIT_CRITICAL(&peersMux);
+			pingOutstanding = false;
+
+			// Disable burstEnabled when the controlling client disconnects, a logger dropping doesn't matter
+			if (connectedCount == 0 || controllerConnId == connId) {
+				state.burstEnabled = false;
+				controllerConnId = -1;
+			}
 			
 			// Start advertising again to reconnect with the client
 			BLEDevice::startAdvertising();
@@ -143,13 +721,15 @@ namespace {
 namespace BleControl {
 	void begin(const char* deviceName) {
 		BLEDevice::init(deviceName);
+		BLEDevice::setMTU(requestedMtu);
 		server = BLEDevice::createServer();
+		BLEDevice::setCustomGattsHandler(onGattsEvent);
 		
 		static ServerCallbacks serverCb;
 		server->setCallbacks(&serverCb);
 		
-		service = server->createService(*serviceBLEUUID, 45); // Characteristics take 2 handles, descriptors take 1 handle. Default is 15 handles.
-		frequencySweepService = server->createService(FREQUENCY_SWEEP_SERVICE_UUID);
+		service = server->createService(*serviceBLEUUID, 64); // Characteristics take 2 handles, descriptors take 1 handle. Default is 15 handles.
+		frequencySweepService = server->createService(FREQUENCY_SWEEP_SERVICE_UUID, 20);
 
 		// Service characteristics
 		chCt = service->createCharacteristic(
@@ -170,27 +750,27 @@ namespace BleControl {
 		);
 		chToggle = service->createCharacteristic(
 			UUID_TOGGLE,
-			BLECharacteristic::PROPERTY_WRITE | BLECharacteristic::PROPERTY_READ
+			BLECharacteristic::PROPERTY_WRITE | BLECharacteristic::PROPERTY_READ | BLECharacteristic::PROPERTY_NOTIFY
 		);
 		chBurst = service->createCharacteristic(
 			UUID_BURST,
-			BLECharacteristic::PROPERTY_WRITE | BLECharacteristic::PROPERTY_READ
+			BLECharacteristic::PROPERTY_WRITE | BLECharacteristic::PROPERTY_READ | BLECharacteristic::PROPERTY_NOTIFY
 		);
 		chBps = service->createCharacteristic(
 			UUID_BPS,
-			BLECharacteristic::PROPERTY_WRITE | BLECharacteristic::PROPERTY_READ
+			BLECharacteristic::PROPERTY_WRITE | BLECharacteristic::PROPERTY_READ | BLECharacteristic::PROPERTY_NOTIFY
 		);
 		chBurstEnabled = service->createCharacteristic(
 			UUID_BURST_ENABLED,
-			BLECharacteristic::PROPERTY_WRITE | BLECharacteristic::PROPERTY_READ
+			BLECharacteristic::PROPERTY_WRITE | BLECharacteristic::PROPERTY_READ | BLECharacteristic::PROPERTY_NOTIFY
 		);
 		chPhaseLead = service->createCharacteristic(
 			UUID_PHASE_LEAD,
-			BLECharacteristic::PROPERTY_WRITE | BLECharacteristic::PROPERTY_READ
+			BLECharacteristic::PROPERTY_WRITE | BLECharacteristic::PROPERTY_READ | BLECharacteristic::PROPERTY_NOTIFY
 		);
 		chReverseBurstPhase = service->createCharacteristic(
 			UUID_REVERSE_BURST_PHASE,
-			BLECharacteristic::PROPERTY_WRITE | BLECharacteristic::PROPERTY_READ
+			BLECharacteristic::PROPERTY_WRITE | BLECharacteristic::PROPERTY_READ | BLECharacteristic::PROPERTY_NOTIFY
 		);
 		chMidiUpload = service->createCharacteristic(
 			MIDI_UPLOAD,
@@ -198,25 +778,57 @@ namespace BleControl {
 		);
 		chPlayMidi = service->createCharacteristic(
 			PLAY_MIDI,
-			BLECharacteristic::PROPERTY_WRITE | BLECharacteristic::PROPERTY_READ
+			BLECharacteristic::PROPERTY_WRITE | BLECharacteristic::PROPERTY_READ | BLECharacteristic::PROPERTY_NOTIFY
 		);
 		chMidiOctave = service->createCharacteristic(
 			UUID_MIDI_OCTAVE,
-			BLECharacteristic::PROPERTY_WRITE | BLECharacteristic::PROPERTY_READ
+			BLECharacteristic::PROPERTY_WRITE | BLECharacteristic::PROPERTY_READ | BLECharacteristic::PROPERTY_NOTIFY
 		);
 		chChordSwapTime = service->createCharacteristic(
 			UUID_CHORD_SWAP_TIME,
+			BLECharacteristic::PROPERTY_WRITE | BLECharacteristic::PROPERTY_READ | BLECharacteristic::PROPERTY_NOTIFY
+		);
+		chParameterBlock = service->createCharacteristic(
+			UUID_PARAMETER_BLOCK,
+			BLECharacteristic::PROPERTY_WRITE | BLECharacteristic::PROPERTY_READ | BLECharacteristic::PROPERTY_NOTIFY
+		);
+		chPreset = service->createCharacteristic(
+			UUID_PRESET,
 			BLECharacteristic::PROPERTY_WRITE | BLECharacteristic::PROPERTY_READ
 		);
+		chLatency = service->createCharacteristic(
+			UUID_LATENCY,
+			BLECharacteristic::PROPERTY_NOTIFY | BLECharacteristic::PROPERTY_WRITE | BLECharacteristic::PROPERTY_WRITE_NR | BLECharacteristic::PROPERTY_READ
+		);
+		chOcdTrips = service->createCharacteristic(
+			UUID_OCD_TRIPS,
+			BLECharacteristic::PROPERTY_READ | BLECharacteristic::PROPERTY_NOTIFY
+		);
+		chScope = service->createCharacteristic(
+			UUID_SCOPE,
+			BLECharacteristic::PROPERTY_WRITE | BLECharacteristic::PROPERTY_READ | BLECharacteristic::PROPERTY_NOTIFY
+		);
+		chAutoTune = service->createCharacteristic(
+			UUID_AUTOTUNE,
+			BLECharacteristic::PROPERTY_WRITE | BLECharacteristic::PROPERTY_READ | BLECharacteristic::PROPERTY_NOTIFY
+		);
+		chSequence = service->createCharacteristic(
+			UUID_SEQUENCE,
+			BLECharacteristic::PROPERTY_WRITE | BLECharacteristic::PROPERTY_READ | BLECharacteristic::PROPERTY_NOTIFY
+		);
+		chDiagnostics = service->createCharacteristic(
+			UUID_DIAGNOSTICS,
+			BLECharacteristic::PROPERTY_WRITE | BLECharacteristic::PROPERTY_READ | BLECharacteristic::PROPERTY_NOTIFY
+		);
 		
 		// frequencySweepService characteristics
 		chMinFreqSweep = frequencySweepService->createCharacteristic(
 			UUID_MIN_FREQ_SWEEP,
-			BLECharacteristic::PROPERTY_WRITE | BLECharacteristic::PROPERTY_READ
+			BLECharacteristic::PROPERTY_WRITE | BLECharacteristic::PROPERTY_READ | BLECharacteristic::PROPERTY_NOTIFY
 		);
 		chMaxFreqSweep = frequencySweepService->createCharacteristic(
 			UUID_MAX_FREQ_SWEEP,
-			BLECharacteristic::PROPERTY_WRITE | BLECharacteristic::PROPERTY_READ
+			BLECharacteristic::PROPERTY_WRITE | BLECharacteristic::PROPERTY_READ | BLECharacteristic::PROPERTY_NOTIFY
 		);
 		chStartFreqSweep = frequencySweepService->createCharacteristic(
 			UUID_START_FREQ_SWEEP,
@@ -226,6 +838,10 @@ namespace BleControl {
 			UUID_FREQ_SWEEP_DATA,
 			BLECharacteristic::PROPERTY_NOTIFY | BLECharacteristic::PROPERTY_READ
 		);
+		chFreqSweepProgress = frequencySweepService->createCharacteristic(
+			UUID_FREQ_SWEEP_PROGRESS,
+			BLECharacteristic::PROPERTY_NOTIFY | BLECharacteristic::PROPERTY_READ
+		);
 		
 		static ControlCallbacks cb;
 		chToggle->setCallbacks(&cb);
@@ -241,8 +857,41 @@ namespace BleControl {
 		chPlayMidi->setCallbacks(&cb);
 		chMidiOctave->setCallbacks(&cb);
 		chChordSwapTime->setCallbacks(&cb);
+		chParameterBlock->setCallbacks(&cb);
+		chPreset->setCallbacks(&cb);
+		chLatency->setCallbacks(&cb);
+		chOcdTrips->setCallbacks(&cb);
+		chScope->setCallbacks(&cb);
+		chAutoTune->setCallbacks(&cb);
+		chSequence->setCallbacks(&cb);
+		chFreqSweepProgress->setCallbacks(&cb);
+		chDiagnostics->setCallbacks(&cb);
+		// Only there so their notifications are counted
+		chCt->setCallbacks(&cb);
+		chVbus->setCallbacks(&cb);
+		chTherm1->setCallbacks(&cb);
+		chTherm2->setCallbacks(&cb);
 
-		chFreqSweepData->addDescriptor(pid2902);
+		addSubscribable(chFreqSweepData, pid2902);
+		addSubscribable(chLatency, new BLE2902());
+		addSubscribable(chOcdTrips, new BLE2902());
+		addSubscribable(chScope, new BLE2902());
+		addSubscribable(chAutoTune, new BLE2902());
+		addSubscribable(chSequence, new BLE2902());
+		addSubscribable(chDiagnostics, new BLE2902());
+		addSubscribable(chFreqSweepProgress, new BLE2902());
+		addSubscribable(chToggle, new BLE2902());
+		addSubscribable(chBurst, new BLE2902());
+		addSubscribable(chBps, new BLE2902());
+		addSubscribable(chBurstEnabled, new BLE2902());
+		addSubscribable(chPhaseLead, new BLE2902());
+		addSubscribable(chReverseBurstPhase, new BLE2902());
+		addSubscribable(chPlayMidi, new BLE2902());
+		addSubscribable(chMidiOctave, new BLE2902());
+		addSubscribable(chChordSwapTime, new BLE2902());
+		addSubscribable(chParameterBlock, new BLE2902());
+		addSubscribable(chMinFreqSweep, new BLE2902());
+		addSubscribable(chMaxFreqSweep, new BLE2902());
 		// chVbus->addDescriptor(pid2902);
 		// chCt->addDescriptor(pid2902);
 		// chTherm1->addDescriptor(pid2902);
@@ -257,10 +906,30 @@ namespace BleControl {
 		advertising->setMinPreferred(0x06);
 		advertising->setMaxPreferred(0x12);
 		BLEDevice::startAdvertising();
+
+		xTaskCreatePinnedToCore(notifyTask, "bleNotifyTask", 3072, NULL, 1, &notifyTaskHandle, 0);
 	}
 
 	void handle() {
-		// No periodic handling needed for GATT server beyond notifications, handled elsewhere
+		// Short connection interval and 2M PHY for the controller while the coil is being played live, relaxed otherwise
+		bool live = state.burstEnabled || MidiControl::isPlaying;
+		Peer changed[maxClients];
+		uint8_t changedCount = 0;
+		portENTER_CRITICAL(&peersMux);
+		for (uint8_t i = 0; i < maxClients; i++) {
+			Peer& peer = peers[i];
+			bool peerLive = live && peer.connId == controllerConnId;
+			if (peer.connected && peerLive != peer.live) {
+				peer.live = peerLive;
+				changed[changedCount++] = peer;
+			}
+		}
+		portEXIT_CRITICAL(&peersMux);
+		for (uint8_t i = 0; i < changedCount; i++) {
+			requestConnParams(changed[i], changed[i].live);
+		}
+
+		sendLatencyPing();
 	}
 
 	static void setFloat(BLECharacteristic* ch, float v, bool notify) {
@@ -275,11 +944,15 @@ namespace BleControl {
 		if (chTherm2) setFloat(chTherm2, therm2, true);
 	}
 
-	void IRAM_ATTR notifyFrequencySweepData(uint32_t data) {
-		if (chFreqSweepData) {
-			chFreqSweepData->setValue((uint8_t*)&data, sizeof(uint32_t));
-			chFreqSweepData->notify();
+	bool IRAM_ATTR queueFrequencySweepData(uint32_t frequencyHz, uint16_t ctMilliVolts, int16_t errorHz) {
+		if (frequencyHz == 0) {
+			return true;
 		}
+		return sweepRing.push({ frequencyHz, ctMilliVolts, errorHz });
+	}
+
+	bool endFrequencySweepData() {
+		return sweepRing.push({ 0, 0, 0 });
 	}
 
 	void resetStartFrequencySweep() {
@@ -294,8 +967,65 @@ namespace BleControl {
 		state.bps = newBps;
 	}
 
+	void setPhaseLead(uint16_t newPhaseLead) {
+		state.phaseLead = newPhaseLead;
+	}
+
+	void setBurstLength(uint16_t newBurstLength) {
+		state.burstLength = newBurstLength;
+	}
+
+	void startFrequencySweep() {
+		state.startFrequencySweep = true;
+	}
+
+	bool applyParameterBlock(const uint8_t* data, size_t length) {
+		if (data == nullptr || length < parameterBlockSize) {
+			return false;
+		}
+
+		uint16_t burstLength = readU16(&data[1]);
+		uint16_t bps = readU16(&data[3]);
+		uint16_t phaseLead = readU16(&data[5]);
+		int8_t midiOctave = (int8_t)data[10];
+		uint8_t chordSwapTime = data[11];
+		// Same limits the burst scheduler, the ZCD ISR and the app apply, so nothing gets silently clamped later
+		if (burstLength < 10 || burstLength > 500 || bps < 1 || phaseLead > 1250
+			|| midiOctave < -3 || midiOctave > 3 || chordSwapTime < 1 || chordSwapTime > 100) {
+			return false;
+		}
+
+		portENTER_CRITICAL(&stateMux);
+		state.enabled = data[0] != 0;
+		state.burstLength = burstLength;
+		state.bps = bps;
+		state.phaseLead = phaseLead;
+		state.reverseBurstPhase = data[7] != 0;
+		state.burstEnabled = data[8] != 0;
+		// data[9] is reserved
+		state.midiOctave = midiOctave;
+		state.chordSwapTime = chordSwapTime;
+		portEXIT_CRITICAL(&stateMux);
+		return true;
+	}
+
+	void encodeParameterBlock(const ControlState& s, uint8_t* out) {
+		out[0] = s.enabled ? 1 : 0;
+		writeU16(&out[1], s.burstLength);
+		writeU16(&out[3], s.bps);
+		writeU16(&out[5], s.phaseLead);
+		out[7] = s.reverseBurstPhase ? 1 : 0;
+		out[8] = s.burstEnabled ? 1 : 0;
+		out[9] = 0;
+		out[10] = (uint8_t)s.midiOctave;
+		out[11] = s.chordSwapTime;
+	}
+
 	ControlState IRAM_ATTR getState() {
-		return state;
+		portENTER_CRITICAL_SAFE(&stateMux);
+		ControlState copy = state;
+		portEXIT_CRITICAL_SAFE(&stateMux);
+		return copy;
 	}
 }
 
@@ -17,13 +17,29 @@ namespace BleControl {
 		uint8_t chordSwapTime;
 	};
 
+	// Size of a packed parameter block, little-endian:
+	// enabled u8, burstLength u16, bps u16, phaseLead u16, reverseBurstPhase u8, burstEnabled u8, reserved u8, midiOctave i8, chordSwapTime u8
+	const size_t parameterBlockSize = 12;
+
 	void begin(const char* deviceName);
 	void handle();
 	void notifyReadings(float vbus, float currentTransformer, float therm1, float therm2);
-	void notifyFrequencySweepData(uint32_t data);
+	// Queue a sweep result for the batched notifier on the comms core, returns false while the ring is full.
+	// errorHz is how far the PWM timer landed from the frequency asked for
+	bool queueFrequencySweepData(uint32_t frequencyHz, uint16_t ctMilliVolts, int16_t errorHz);
+	// Queue the end of sweep marker, sent with the last batch
+	bool endFrequencySweepData();
 	void resetStartFrequencySweep();
 	void setBurstEnabled(bool newBurstEnabled);
 	void setBps(uint16_t newBps);
+	void setPhaseLead(uint16_t newPhaseLead);
+	void setBurstLength(uint16_t newBurstLength);
+	void startFrequencySweep();
+
+	// Validates a packed parameter block and swaps it into the state in one step.
+	// Returns false (leaving the state untouched) if the block is malformed or out of range.
+	bool applyParameterBlock(const uint8_t* data, size_t length);
+	void encodeParameterBlock(const ControlState& state, uint8_t* out);
 	ControlState getState();
 }
 
@@ -6,6 +6,15 @@
 #include "FrequencySweep.h"
 #include "DelayNanoseconds.h"
 #include "OCD.h"
+#include "CurrentTransformer.h"
+#include "Thermal.h"
+#include "VBus.h"
+#include "Scope.h"
+#include "AudioStream.h"
+#include "Sequence.h"
+#include "PulseBench.h"
+#include "Trace.h"
+#include "Metrics.h"
 
 namespace Burst {
     // Constants
@@ -14,10 +23,11 @@ namespace Burst {
     bool burstEnabled = 0;
     TaskHandle_t burstTaskHandle;
     unsigned long lastBurstMillis;
+    bool burstScheduled = false; // Since enabling, the first burst had nothing to be late for
 
     void handle() {
         BleControl::ControlState controlState = BleControl::getState();
-        if (burstEnabled == controlState.burstEnabled || FrequencySweep::running) {
+        if (burstEnabled == controlState.burstEnabled || FrequencySweep::running || AudioStream::isPulsing()) {
             return;
         }
 
@@ -30,17 +40,50 @@ namespace Burst {
 
     void burstTaskLoop(void * arg) {
         while(burstEnabled){
+            // OCD runs off the captured peak once its samples have come in
+            if (CurrentTransformer::processCaptures()) {
+                OCD::checkOCD();
+                CurrentTransformer::BurstPeak burstPeak = CurrentTransformer::getLastBurstPeak();
+                Thermal::addBurst(burstPeak.burstLength, ((uint32_t)burstPeak.endPeakMilliVolts * OCD::turnsRatio) / OCD::burdenMiliohms);
+            } else if (OCD::latched && !CurrentTransformer::capturePending()) {
+                OCD::checkOCD();
+            }
+            Scope::process();
+
             BleControl::ControlState controlState = BleControl::getState();
-            uint32_t burstFrequencyHz = 1000000 / controlState.burstLength;
-            uint16_t maxBurstsPerSecond = burstFrequencyHz / 10; // Max 10% duty cycle
+            // Longer on-time as the bus sags, so the spark doesn't shrink through dense passages
+            uint16_t burstLength = constrain(VBus::compensateBurstLength(controlState.burstLength), 10, 500); // In microseconds
+            uint32_t burstFrequencyHz = 1000000 / burstLength;
+            uint16_t maxBurstsPerSecond = (burstFrequencyHz * Thermal::getMaxDutyPermille()) / 1000; // Duty cycle cap, derated as the bridge heats up
+            if (maxBurstsPerSecond == 0) {
+                delay(1);
+                continue;
+            }
             uint16_t burstsPerSecond = constrain(controlState.bps, 1, maxBurstsPerSecond);
-            if ((millis() - lastBurstMillis) * 10 >= (10000 / burstsPerSecond)) {
+            // Whole milliseconds between bursts, rounded up (3ms at 440 bps)
+            uint32_t intervalMillis = (10000 / burstsPerSecond + 9) / 10;
+            // A burst due while the last one's capture is pending waits for it, usually a DMA frame and a sample
+            // period (~200us) but up to captureTimeoutMicros (5ms) when samples were missed. That much jitter on the
+            // next burst, recorded as lateness
+            if (millis() - lastBurstMillis >= intervalMillis && !CurrentTransformer::capturePending() && !Sequence::isMuted()) {
+                // Against the millisecond the burst was due at, millis() and micros() count the same clock
+                if (burstScheduled) {
+                    Metrics::recordLateness(micros() - (lastBurstMillis + intervalMillis) * 1000);
+                }
                 lastBurstMillis = millis();
+                burstScheduled = true;
+                // The filter steps once per burst, so the bus is read right before this one
+                VBus::update();
+                burstLength = constrain(VBus::compensateBurstLength(controlState.burstLength), 10, 500);
                 
-                if (!OCD::ocdTriggered || controlState.burstLength <= 100) {
-                    singleBurst();
+                if (!OCD::ocdTriggered || burstLength <= 100) {
+                    uint32_t startCycles = ESP.getCycleCount();
+                    singleBurst(burstLength);
+                    PulseBench::record(startCycles, ESP.getCycleCount() - startCycles, controlState.bps);
+                    Metrics::recordBurst(OCD::latched);
                 } else {
                     OCD::resetOCDTriggered();
+                    Metrics::recordSkippedBurst();
                 }
             }
             
@@ -48,30 +91,41 @@ namespace Burst {
         }
     }
 
-    void IRAM_ATTR singleBurst() {
-        BleControl::ControlState controlState = BleControl::getState();
-        uint16_t burstLength = constrain(controlState.burstLength, 10, 500); // In microseconds
+    void IRAM_ATTR singleBurst(uint16_t burstLength) {
         //uint32_t burstLengthCycles = burstLength * cpuFrequencyMHz;
         //unsigned long startMicros = micros();
 
         // ZCD::enableInterrupt();
+        Trace::record(Trace::burstStart, burstLength);
+        CurrentTransformer::armBurst(burstLength);
+        OCD::arm();
+        Scope::trigger(burstLength);
         GateDrive::enableGD1();
         delayMicroseconds(4);
         //delayNanoseconds(8333);
         GateDrive::toggleGD1();
-        ZCD::enable(false);
+        Trace::record(Trace::gateToggle, GateDrive::GD1APinEnabled);
+        ZCD::enable(false, burstLength);
 
         //delayNanoseconds(burstLength * 1000);
         //while (micros() - startMicros < burstLength) {}
-        delayMicroseconds(burstLength);
+        // Cut short by the OCD latch, which has already turned the gates off
+        unsigned long startMicros = micros();
+        while (micros() - startMicros < burstLength && !OCD::latched) {}
 
-        ZCD::disableOnInterrupt();
+        if (!OCD::latched) {
+            ZCD::disableOnInterrupt();
+        }
         //GateDrive::disableGD1();
-        OCD::checkOCD();
+        CurrentTransformer::captureBurstEnd();
+        Scope::burstEnd();
+        Trace::record(Trace::burstEnd, OCD::latched);
     }
 
     void enable() {
-        xTaskCreate(burstTaskLoop, "burstTaskLoop", 2000, NULL, 2, &burstTaskHandle);
+        burstScheduled = false;
+        // On the app core like the MIDI task, PulseBench's cycle stamps are only comparable from one core
+        xTaskCreatePinnedToCore(burstTaskLoop, "burstTaskLoop", 2000, NULL, 2, &burstTaskHandle, 1);
         burstEnabled = 1;
         ZCD::enableInterrupt();
     }
@@ -5,7 +5,7 @@
 
 namespace Burst {
     void handle();
-    void IRAM_ATTR singleBurst();
+    void IRAM_ATTR singleBurst(uint16_t burstLength);
     void enable();
     void disable();
     void burstTaskLoop();
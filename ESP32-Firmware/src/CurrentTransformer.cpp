@@ -1,15 +1,30 @@
 #include "CurrentTransformer.h"
-#include "FastAnalogRead.h"
+#include "AdcEngine.h"
+#include "SpscRing.h"
+#include "Telemetry.h"
 
 // Constants
-const uint8_t numAnalogReadings = 5;
+const uint8_t numAnalogReadings = 4; // Newest samples from the background sampler, ~200us at 20kHz per channel
 const uint8_t resetDuration = 5; // In micro seconds
+const uint32_t captureTimeoutMicros = 5000; // Give up on a capture whose samples were missed
 
 // Static member variable definitions
 uint8_t CurrentTransformer::_CTPeakPin = 0;
 uint8_t CurrentTransformer::_CTPeakResetPin = 0;
 bool CurrentTransformer::_initialized = false;
 
+namespace {
+    // Capture in flight, written by the burst, finalized by the burst task
+    volatile bool pending = false;
+    uint32_t burstStartMicros = 0;
+    uint16_t pendingBurstLength = 0;
+    uint32_t rampIndex = 0;
+    uint32_t endIndex = 0;
+
+    CurrentTransformer::BurstPeak lastBurstPeak = { 0, 0, 0, 0 };
+    SpscRing<CurrentTransformer::BurstPeak, 64> burstPeaks;
+}
+
 void CurrentTransformer::begin(uint8_t CTPeakPin, uint8_t CTPeakResetPin) {
     _CTPeakPin = CTPeakPin;
     _CTPeakResetPin = CTPeakResetPin;
@@ -25,16 +40,81 @@ uint16_t IRAM_ATTR CurrentTransformer::readCurrentTransformer() {
         return 0;
     }
     
-    uint32_t sum = 0;
-    
-    // Take readings and average them
-    for (int i = 0; i < numAnalogReadings; i++) {
-        sum += analogReadMilliVoltsFast(_CTPeakPin);
-        digitalWrite(_CTPeakResetPin, 1);
-        delayMicroseconds(resetDuration);
-        digitalWrite(_CTPeakResetPin, 0);
+    // The peak detector holds its value, so the highest recent sample is the peak
+    uint16_t peak = AdcEngine::maxMilliVolts(_CTPeakPin, numAnalogReadings);
+
+    // Discharge the peak detector for the next reading
+    digitalWrite(_CTPeakResetPin, 1);
+    delayMicroseconds(resetDuration);
+    digitalWrite(_CTPeakResetPin, 0);
+
+    return peak;
+}
+
+void IRAM_ATTR CurrentTransformer::armBurst(uint16_t burstLength) {
+    if (!_initialized) {
+        return;
     }
-    
-    // Return the averaged result
-    return (uint16_t)(sum / numAnalogReadings);
+
+    digitalWrite(_CTPeakResetPin, 1);
+    delayMicroseconds(resetDuration);
+    digitalWrite(_CTPeakResetPin, 0);
+
+    burstStartMicros = micros();
+    pendingBurstLength = burstLength;
+    rampIndex = AdcEngine::sampleIndexAt(_CTPeakPin, burstStartMicros + burstLength / 2);
+    pending = false;
+}
+
+void IRAM_ATTR CurrentTransformer::captureBurstEnd() {
+    if (!_initialized) {
+        return;
+    }
+
+    // The detector keeps holding after the gates stop, so any sample after the end is the burst's peak. Past the
+    // anchor's error so it's never one from before the end
+    endIndex = AdcEngine::sampleIndexAt(_CTPeakPin, micros() + AdcEngine::maxAnchorLateMicros);
+    pending = true;
+}
+
+bool CurrentTransformer::processCaptures() {
+    if (!pending) {
+        return false;
+    }
+
+    uint16_t rampRaw;
+    uint16_t endRaw;
+    if (!AdcEngine::sampleAt(_CTPeakPin, endIndex, endRaw)) {
+        if (micros() - burstStartMicros > captureTimeoutMicros) {
+            pending = false;
+        }
+        return false;
+    }
+    if (!AdcEngine::sampleAt(_CTPeakPin, rampIndex, rampRaw)) {
+        rampRaw = endRaw;
+    }
+
+    BurstPeak burstPeak = {
+        burstStartMicros,
+        pendingBurstLength,
+        AdcEngine::toMilliVolts(_CTPeakPin, rampRaw),
+        AdcEngine::toMilliVolts(_CTPeakPin, endRaw)
+    };
+    lastBurstPeak = burstPeak;
+    burstPeaks.push(burstPeak);
+    Telemetry::push(Telemetry::streamCt, burstPeak.endPeakMilliVolts);
+    pending = false;
+    return true;
+}
+
+bool CurrentTransformer::capturePending() {
+    return pending;
+}
+
+CurrentTransformer::BurstPeak CurrentTransformer::getLastBurstPeak() {
+    return lastBurstPeak;
+}
+
+bool CurrentTransformer::popBurstPeak(BurstPeak& burstPeak) {
+    return burstPeaks.pop(burstPeak);
 }
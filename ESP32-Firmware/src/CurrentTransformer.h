@@ -5,12 +5,34 @@
 
 class CurrentTransformer {
 public:
+    // Peak detector readings captured for one burst
+    struct BurstPeak {
+        uint32_t timestampMicros; // Burst start
+        uint16_t burstLength;     // In microseconds
+        uint16_t rampPeakMilliVolts; // Halfway through the burst
+        uint16_t endPeakMilliVolts;  // Peak of the whole burst
+    };
+
     // Initialize the current transformer with the specified pin
     static void begin(uint8_t CTPeakPin, uint8_t CTPeakResetPin);
     
-    // Read the current transformer value (averaged over 5 samples)
+    // Read the current transformer peak from the background sampler and reset the peak detector
     static uint16_t readCurrentTransformer();
 
+    // Burst synchronised capture: arm resets the peak detector right before the gates switch,
+    // captureBurstEnd marks the end, and the peak detector samples at the ramp end and burst end
+    // are picked out of the background sampler's ring by index once they arrive.
+    static void IRAM_ATTR armBurst(uint16_t burstLength);
+    static void IRAM_ATTR captureBurstEnd();
+
+    // Finalize the pending capture once its samples have arrived, returns true when a new BurstPeak is ready
+    static bool processCaptures();
+    static bool capturePending();
+    static BurstPeak getLastBurstPeak();
+
+    // Every captured burst, for telemetry consumers
+    static bool popBurstPeak(BurstPeak& burstPeak);
+
 private:
     static uint8_t _CTPeakPin;
     static uint8_t _CTPeakResetPin;
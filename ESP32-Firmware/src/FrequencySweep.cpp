@@ -2,43 +2,59 @@
 #include "BleControl.h"
 #include "CurrentTransformer.h"
 #include "GateDrive.h"
-#include <hal/cpu_hal.h>
+#include "AudioStream.h"
 
 namespace FrequencySweep {
     // Constants
-    const uint32_t cpuFrequencyHz = getCpuFrequencyMhz() * 1000000;
-    const uint32_t magnitude32Bit = 4294967295;
-    const unsigned long frequencySweepDurationMs = 20000;
+    const uint16_t maxResults = 1000;
+    const uint16_t minPeakMilliVolts = 20; // Below this a coarse point is noise, not worth refining
+    const uint32_t captureWaitMs = 10; // The CT sample lands within a frame of the burst ending
+    const uint32_t pausePollMs = 10;
+    const Config defaultConfig = {
+        modeAdaptive,
+        10,  // coarseStepKHz
+        10,  // settleCycles
+        100, // dwellMs, the rest the sweep always had
+        250, // fineStepHz
+        2    // refinePeaks
+    };
     // Variable definitions
     uint8_t gd1aPin = 0;
     uint8_t gd1bPin = 0;
     bool initialized = false;
-    bool running = false;
+    volatile bool running = false;
     uint16_t currentFrequency = 0;
     uint16_t minFrequency = 0;
     uint16_t maxFrequency = 0;
-    uint32_t toggleCount = 0;
-    //unsigned long lastToggleTime = 0;
-    uint32_t lastCycleCount = ESP.getCycleCount();
-    uint32_t cyclesNeededToToggle = 0;
-    TaskHandle_t Task0;
+    int32_t worstErrorHz = 0;
+    volatile bool cancelRequested = false;
+    volatile bool paused = false;
+    TaskHandle_t sweepTaskHandle;
+    Progress progress = { stateIdle, 0, 0, 0, 0 };
+    uint32_t progressSequence = 0;
+    // Progress is written by the sweep task and read by BLE on the other core
+    portMUX_TYPE progressMux = portMUX_INITIALIZER_UNLOCKED;
+    Config config = defaultConfig;
+    Point results[maxResults];
+    uint16_t resultCount = 0;
+    Point peaks[maxPeaks];
+    uint8_t peakCount = 0;
 
     void begin(uint8_t newgd1aPin, uint8_t newgd1bPin) {
         gd1aPin = newgd1aPin;
         gd1bPin = newgd1bPin;
-        
+
         initialized = true;
     }
-    // TODO: there's a smidge of extra on time at the start of a burst, and the output is left high at the end, causing extra pulses / oscillations
     void handle() {
         if (!initialized) {
             return;
         }
-        
+
         // Check BLE state for frequency sweep trigger
         BleControl::ControlState state = BleControl::getState();
-        
-        if (!state.startFrequencySweep || running || state.burstEnabled) {
+
+        if (!state.startFrequencySweep || running || state.burstEnabled || AudioStream::isActive()) {
             return;
         }
 
@@ -50,50 +66,261 @@ namespace FrequencySweep {
         return running;
     }
 
-    uint32_t IRAM_ATTR getCyclesNeededToToggle(uint32_t toggleFrequencyKHz) {
-        return cpuFrequencyHz / (toggleFrequencyKHz * 2000);
-    }
-
-    void IRAM_ATTR Task0SweepLoop() {
-        //(void)parameter; // Suppress unused parameter warning
-        // lastCycleCount = ESP.getCycleCount();
-        lastCycleCount = cpu_hal_get_cycle_count();
-        while (running) {
-            // uint32_t currentCycleCount = ESP.getCycleCount();
-            uint32_t currentCycleCount = cpu_hal_get_cycle_count();
-            
-            // Check if it's time to toggle
-            uint32_t compare = currentCycleCount >= lastCycleCount ? currentCycleCount - lastCycleCount : ((magnitude32Bit - currentCycleCount) + 1) - lastCycleCount;
-            if (compare >= cyclesNeededToToggle) {
-                // If we've completed 20 toggles at this frequency, move to next frequency
-                if (toggleCount >= 20) {
-                    uint16_t ctValue = CurrentTransformer::readCurrentTransformer();
-                    uint32_t sweepData = ((uint32_t)currentFrequency << 16) + ctValue; // Frequency then ctValue are merged into a single uint32
-                    BleControl::notifyFrequencySweepData(sweepData);
-
-                    currentFrequency++;
-                    toggleCount = 0;
-                    // If we've reached the max frequency, stop the sweep
-                    if (currentFrequency > maxFrequency) {
-                        stopSweep();
-                        GateDrive::disableGD1();
-                        break;
-                    }
-                    // Calculate new toggle interval for the next frequency
-                    //cyclesNeededToToggle = (uint32_t)1000000 / ((uint32_t)currentFrequency * 2000); // Convert KHz to microseconds
-                    cyclesNeededToToggle = getCyclesNeededToToggle(currentFrequency);
-
-                    delay(100);
-                }
-
-                // digitalWrite(gd1aPin, !digitalRead(gd1aPin));
-                // digitalWrite(gd1bPin, !digitalRead(gd1bPin));
-                GateDrive::toggleGD1();
-                // lastCycleCount = ESP.getCycleCount();
-                lastCycleCount = cpu_hal_get_cycle_count();
-                toggleCount++;
+    void setState(State state) {
+        portENTER_CRITICAL(&progressMux);
+        progress.state = state;
+        progressSequence++;
+        portEXIT_CRITICAL(&progressMux);
+    }
+
+    void cancel() {
+        if (running) {
+            cancelRequested = true;
+        }
+    }
+
+    void pause() {
+        if (running && !paused) {
+            paused = true;
+            setState(statePaused);
+        }
+    }
+
+    void resume() {
+        if (running && paused) {
+            paused = false;
+            setState(stateRunning);
+        }
+    }
+
+    Progress getProgress() {
+        portENTER_CRITICAL(&progressMux);
+        Progress copy = progress;
+        portEXIT_CRITICAL(&progressMux);
+        return copy;
+    }
+
+    uint32_t getProgressSequence() {
+        return progressSequence;
+    }
+
+    void setConfig(const Config& newConfig) {
+        if (running) {
+            return;
+        }
+        config = newConfig;
+        config.coarseStepKHz = max(config.coarseStepKHz, (uint8_t)1);
+        config.settleCycles = max(config.settleCycles, (uint8_t)1);
+        config.fineStepHz = max(config.fineStepHz, (uint16_t)50);
+        config.refinePeaks = constrain(config.refinePeaks, 1, maxPeaks);
+    }
+
+    Config getConfig() {
+        return config;
+    }
+
+    uint16_t getResults(const Point*& resultsOut) {
+        resultsOut = results;
+        return resultCount;
+    }
+
+    uint8_t getPeaks(const Point*& peaksOut) {
+        peaksOut = peaks;
+        return peakCount;
+    }
+
+    // Drives settleCycles cycles at one frequency and returns the CT peak over them, at the frequency generated
+    Point measure(uint32_t frequencyHz) {
+        // Paused between points, never mid-burst
+        while (paused && !cancelRequested) {
+            delay(pausePollMs);
+        }
+        if (cancelRequested) {
+            return { frequencyHz, 0, 0 };
+        }
+
+        uint32_t achievedHz = GateDrive::startGD1Pwm(frequencyHz);
+        // Rounded up so the last cycle isn't cut short
+        uint32_t driveMicros = ((uint32_t)config.settleCycles * 1000000 + achievedHz - 1) / achievedHz;
+        CurrentTransformer::armBurst(driveMicros);
+        delayMicroseconds(driveMicros);
+        GateDrive::stopGD1Pwm();
+        CurrentTransformer::captureBurstEnd();
+
+        currentFrequency = achievedHz / 1000;
+        int32_t errorHz = (int32_t)achievedHz - (int32_t)frequencyHz;
+        if (abs(errorHz) > abs(worstErrorHz)) {
+            worstErrorHz = errorHz;
+        }
+
+        unsigned long waitStarted = millis();
+        while (!CurrentTransformer::processCaptures() && millis() - waitStarted < captureWaitMs) {
+            delay(1);
+        }
+        uint16_t ctValue = CurrentTransformer::getLastBurstPeak().endPeakMilliVolts;
+        Point point = { achievedHz, ctValue, (int16_t)errorHz };
+
+        if (resultCount < maxResults) {
+            results[resultCount++] = point;
+        }
+        // Only buffered here, BleControl's notify task batches it out from the comms core. The app gets the achieved
+        // frequency and how far it is from the one asked for
+        while (!BleControl::queueFrequencySweepData(achievedHz, ctValue, point.errorHz)) {
+            delay(1);
+        }
+
+        portENTER_CRITICAL(&progressMux);
+        progress.pointsDone++;
+        progress.frequencyHz = achievedHz;
+        progressSequence++;
+        portEXIT_CRITICAL(&progressMux);
+
+        delay(config.dwellMs);
+        return point;
+    }
+
+    // Vertex of the parabola through three points, at most halfway to either neighbour. The PWM timer rarely
+    // generates the frequencies asked for, so the points aren't evenly spaced
+    uint32_t parabolicPeakHz(const Point& left, const Point& middle, const Point& right) {
+        // Relative to the middle point, so the parabola is a x^2 + b x
+        float leftHz = (float)left.frequencyHz - (float)middle.frequencyHz;
+        float rightHz = (float)right.frequencyHz - (float)middle.frequencyHz;
+        float leftMilliVolts = (float)left.milliVolts - (float)middle.milliVolts;
+        float rightMilliVolts = (float)right.milliVolts - (float)middle.milliVolts;
+        if (leftHz >= 0.0f || rightHz <= 0.0f) {
+            return middle.frequencyHz;
+        }
+        float denominator = leftHz * rightHz * (leftHz - rightHz);
+        float a = (leftMilliVolts * rightHz - rightMilliVolts * leftHz) / denominator;
+        float b = (rightMilliVolts * leftHz * leftHz - leftMilliVolts * rightHz * rightHz) / denominator;
+        if (a >= 0.0f) {
+            return middle.frequencyHz;
+        }
+        float offsetHz = constrain(-b / (2.0f * a), leftHz / 2.0f, rightHz / 2.0f);
+        return (uint32_t)((float)middle.frequencyHz + offsetHz);
+    }
+
+    // Keeps peaks sorted strongest first, dropping the weakest once full
+    void insertPeak(const Point& peak, uint8_t limit) {
+        uint8_t i = peakCount < limit ? peakCount++ : limit;
+        while (i > 0 && peaks[i - 1].milliVolts < peak.milliVolts) {
+            if (i < limit) {
+                peaks[i] = peaks[i - 1];
             }
+            i--;
+        }
+        if (i < limit) {
+            peaks[i] = peak;
+        }
+    }
+
+    // Local maxima of a run of results in frequency order, optionally interpolated between points
+    void findPeaks(const Point* points, uint16_t count, bool interpolate, uint8_t limit) {
+        for (uint16_t i = 1; i + 1 < count; i++) {
+            // The timer rounds some neighbouring requests to one frequency, each run is judged on its last reading
+            // against the frequencies either side
+            if (points[i + 1].frequencyHz == points[i].frequencyHz) {
+                continue;
+            }
+            uint16_t previous = i - 1;
+            while (previous > 0 && points[previous].frequencyHz == points[i].frequencyHz) {
+                previous--;
+            }
+            uint16_t v = points[i].milliVolts;
+            if (v < minPeakMilliVolts || points[previous].frequencyHz == points[i].frequencyHz
+                || v < points[previous].milliVolts || v < points[i + 1].milliVolts) {
+                continue;
+            }
+            Point peak = points[i];
+            if (interpolate) {
+                peak.frequencyHz = parabolicPeakHz(points[previous], points[i], points[i + 1]);
+            }
+            insertPeak(peak, limit);
+        }
+    }
+
+    void linearSweep() {
+        for (uint32_t frequencyKHz = minFrequency; frequencyKHz <= maxFrequency && !cancelRequested; frequencyKHz++) {
+            measure(frequencyKHz * 1000);
+        }
+        findPeaks(results, resultCount, true, maxPeaks);
+    }
+
+    // Points refinePeak measures for one peak, two per halving plus the final neighbours
+    uint16_t refinePoints() {
+        uint16_t points = 2;
+        for (uint32_t stepHz = (uint32_t)config.coarseStepKHz * 1000; stepHz > config.fineStepHz; stepHz /= 2) {
+            points += 2;
         }
+        return points;
+    }
+
+    // Successive halving: each round probes half a step either side and moves to the stronger point
+    Point refinePeak(Point peak) {
+        uint32_t lowHz = (uint32_t)minFrequency * 1000;
+        uint32_t highHz = (uint32_t)maxFrequency * 1000;
+        uint32_t stepHz = (uint32_t)config.coarseStepKHz * 1000;
+
+        while (stepHz > config.fineStepHz && !cancelRequested) {
+            stepHz /= 2;
+            // Each keeps the frequency actually generated, so the peak stays on a point that was driven
+            Point left = measure(max(peak.frequencyHz - stepHz, lowHz));
+            Point right = measure(min(peak.frequencyHz + stepHz, highHz));
+            if (left.milliVolts > peak.milliVolts && left.milliVolts >= right.milliVolts) {
+                peak = left;
+            } else if (right.milliVolts > peak.milliVolts) {
+                peak = right;
+            }
+        }
+
+        // Final neighbours for the interpolation, at the finest step
+        if (peak.frequencyHz > lowHz + stepHz && peak.frequencyHz + stepHz < highHz && !cancelRequested) {
+            Point left = measure(peak.frequencyHz - stepHz);
+            Point right = measure(peak.frequencyHz + stepHz);
+            peak.frequencyHz = parabolicPeakHz(left, peak, right);
+        }
+        return peak;
+    }
+
+    void adaptiveSweep() {
+        uint32_t coarseStepHz = (uint32_t)config.coarseStepKHz * 1000;
+        for (uint32_t frequencyHz = (uint32_t)minFrequency * 1000; frequencyHz <= (uint32_t)maxFrequency * 1000 && !cancelRequested; frequencyHz += coarseStepHz) {
+            measure(frequencyHz);
+        }
+        // Left on the sampled points, the refinement interpolates at the finest step instead
+        findPeaks(results, resultCount, false, config.refinePeaks);
+
+        // Now the number of peaks is known the total is exact
+        portENTER_CRITICAL(&progressMux);
+        progress.phase = phaseRefine;
+        progress.pointsTotal = progress.pointsDone + peakCount * refinePoints();
+        progressSequence++;
+        portEXIT_CRITICAL(&progressMux);
+
+        for (uint8_t i = 0; i < peakCount && !cancelRequested; i++) {
+            peaks[i] = refinePeak(peaks[i]);
+        }
+
+        // Refinement can reorder them
+        Point refined[maxPeaks];
+        uint8_t refinedCount = peakCount;
+        memcpy(refined, peaks, sizeof(Point) * refinedCount);
+        peakCount = 0;
+        for (uint8_t i = 0; i < refinedCount; i++) {
+            insertPeak(refined[i], maxPeaks);
+        }
+    }
+
+    void sweepTask(void* arg) {
+        unsigned long millisStarted = millis();
+        if (config.mode == modeAdaptive) {
+            adaptiveSweep();
+        } else {
+            linearSweep();
+        }
+        Serial.printf("Sweep took %lums, %u points, worst frequency error %ldHz\n", millis() - millisStarted, resultCount, (long)worstErrorHz);
+        stopSweep();
+        vTaskDelete(NULL);
     }
 
     void startSweep(uint16_t minFreq, uint16_t maxFreq) {
@@ -101,37 +328,43 @@ namespace FrequencySweep {
 
         minFreq = constrain(minFreq, 20, 999);
         maxFreq = constrain(maxFreq, 30, 999);
-        
+
         Serial.println(minFreq);
         Serial.println(maxFreq);
         minFrequency = minFreq;
         maxFrequency = maxFreq;
         currentFrequency = minFreq;
-        toggleCount = 0;
-        //lastCycleCount = ESP.getCycleCount();
-        // lastToggleTime = micros();
-        
-        // Calculate toggle interval for the starting frequency (KHz to microseconds)
-        //cyclesNeededToToggle = (uint32_t)1000000 / ((uint32_t)currentFrequency * 2000);
-        cyclesNeededToToggle = getCyclesNeededToToggle(currentFrequency);
-        Serial.println(cyclesNeededToToggle);
-        running = true;
+        resultCount = 0;
+        peakCount = 0;
+        worstErrorHz = 0;
+        cancelRequested = false;
+        paused = false;
+
+        uint16_t pointsTotal = maxFreq - minFreq + 1;
+        if (config.mode == modeAdaptive) {
+            // Assumes every peak gets refined, corrected once the coarse pass has found them
+            pointsTotal = (maxFreq - minFreq) / config.coarseStepKHz + 1 + config.refinePeaks * refinePoints();
+        }
+        portENTER_CRITICAL(&progressMux);
+        progress = { stateRunning, phaseCoarse, 0, pointsTotal, (uint32_t)minFreq * 1000 };
+        progressSequence++;
+        portEXIT_CRITICAL(&progressMux);
 
-        //unsigned long millisStarted = millis();
-        //xTaskCreatePinnedToCore(Task0SweepLoop, "Task0", 10000, NULL, 1, &Task0, 0);
-        //void *a = NULL;
-        GateDrive::enableGD1();
-        Task0SweepLoop();
+        // Running before the task exists, so Burst and AutoTune see the sweep straight away
+        running = true;
+        // Above loop() so the drive timing holds, on the app core so BLE keeps its own
+        xTaskCreatePinnedToCore(sweepTask, "sweepTask", 4096, NULL, 2, &sweepTaskHandle, 1);
     }
 
     void stopSweep() {
-        running = false;
-        
-        // Set pins to safe state (both low)
-        // digitalWrite(gd1aPin, LOW);
-        // digitalWrite(gd1bPin, LOW);
-        
+        GateDrive::disableGD1();
+
         // Notify BLE that sweep is complete
-        //BleControl::notifyFrequencySweepData(currentFrequency);
+        while (!BleControl::endFrequencySweepData()) {
+            delay(1);
+        }
+        setState(cancelRequested ? stateCancelled : stateDone);
+        paused = false;
+        running = false;
     }
 }
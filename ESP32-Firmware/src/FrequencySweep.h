@@ -4,16 +4,85 @@
 #include <Arduino.h>
 
 namespace FrequencySweep {
+    enum Mode : uint8_t {
+        modeLinear = 0,   // 1 kHz steps across the whole range
+        modeAdaptive = 1  // Coarse pass, then successive halving around the strongest peaks
+    };
+
+    struct Config {
+        Mode mode;
+        uint8_t coarseStepKHz;
+        uint8_t settleCycles; // Drive cycles at each point before the CT is read
+        uint8_t dwellMs;      // Rest between points, keeps the sweep's duty cycle low
+        uint16_t fineStepHz;  // Refinement stops once the step is at or below this
+        uint8_t refinePeaks;
+    };
+
+    struct Point {
+        uint32_t frequencyHz; // As generated, the nearest the PWM timer gets to the one asked for
+        uint16_t milliVolts;  // CT peak
+        int16_t errorHz;      // Generated minus requested
+    };
+
+    const uint8_t maxPeaks = 4;
+
+    // First byte written to the start characteristic
+    enum Command : uint8_t {
+        commandCancel = 0,
+        commandStart = 1,
+        commandPause = 2,
+        commandResume = 3
+    };
+
+    enum State : uint8_t {
+        stateIdle = 0,
+        stateRunning = 1,
+        statePaused = 2,
+        stateDone = 3,
+        stateCancelled = 4
+    };
+
+    enum Phase : uint8_t {
+        phaseCoarse = 0, // Also the whole of a linear sweep
+        phaseRefine = 1
+    };
+
+    // Packed for the BLE characteristic, little endian
+    struct Progress {
+        uint8_t state;
+        uint8_t phase;
+        uint16_t pointsDone;
+        uint16_t pointsTotal; // Estimated until the coarse pass has found the peaks
+        uint32_t frequencyHz; // Last point measured
+    } __attribute__((packed));
 
     // Initialize the frequency sweep system
     void begin(uint8_t gd1aPin, uint8_t gd1bPin);
     
-    // Start frequency sweep if triggered
+    // Start frequency sweep if triggered, the sweep itself runs in its own task
     void handle();
     
     // Check if sweep is currently running
     bool isRunning();
 
+    // Take effect between points, a cancelled sweep still ends its data stream
+    void cancel();
+    void pause();
+    void resume();
+
+    Progress getProgress();
+    uint32_t getProgressSequence();
+
+    // Applied from the next sweep, ignored while one is running
+    void setConfig(const Config& config);
+    Config getConfig();
+
+    // Every point of the last sweep in the order it was measured
+    uint16_t getResults(const Point*& results);
+
+    // Resonances of the last sweep, interpolated, strongest first
+    uint8_t getPeaks(const Point*& peaks);
+
 
     // Pin assignments
     extern uint8_t gd1aPin;
@@ -21,16 +90,12 @@ namespace FrequencySweep {
     
     // State tracking
     extern bool initialized;
-    extern bool running;
+    extern volatile bool running;
     extern uint16_t currentFrequency;
     extern uint16_t minFrequency;
     extern uint16_t maxFrequency;
-    extern uint32_t toggleCount;
-    //extern unsigned long lastToggleTime;
-    extern uint32_t toggleInterval;
     
     // Helper functions
-    void togglePins();
     void startSweep(uint16_t minFreq, uint16_t maxFreq);
     void stopSweep();
 };
@@ -1,5 +1,6 @@
 #include "GateDrive.h"
 #include "BleControl.h"
+#include <driver/mcpwm.h>
 
 namespace GateDrive {
     bool GD1APinEnabled = 0;
@@ -7,6 +8,30 @@ namespace GateDrive {
     uint8_t GD1APin = 0;
     uint8_t GD1BPin = 0;
 
+    // MCPWM clocks from the 160 MHz PLL, the timer at 80 MHz gives 12.5ns period steps
+    const uint32_t pwmGroupResolutionHz = 160000000;
+    const uint32_t pwmTimerResolutionHz = 80000000;
+    const uint32_t pwmDeadTimeNanos = 100;
+    bool pwmInitialized = false;
+
+    void initPwm() {
+        mcpwm_config_t config = {};
+        config.frequency = 100000;
+        config.cmpr_a = 50.0f;
+        config.cmpr_b = 50.0f;
+        config.duty_mode = MCPWM_DUTY_MODE_0;
+        config.counter_mode = MCPWM_UP_COUNTER;
+        mcpwm_group_set_resolution(MCPWM_UNIT_0, pwmGroupResolutionHz);
+        mcpwm_timer_set_resolution(MCPWM_UNIT_0, MCPWM_TIMER_0, pwmTimerResolutionHz);
+        mcpwm_init(MCPWM_UNIT_0, MCPWM_TIMER_0, &config);
+        mcpwm_stop(MCPWM_UNIT_0, MCPWM_TIMER_0);
+
+        // B is A inverted, both rising edges held off by the dead time. The dead time generator counts group clock ticks
+        uint32_t deadTimeTicks = (uint64_t)pwmDeadTimeNanos * pwmGroupResolutionHz / 1000000000ULL;
+        mcpwm_deadtime_enable(MCPWM_UNIT_0, MCPWM_TIMER_0, MCPWM_ACTIVE_HIGH_COMPLIMENT_MODE, deadTimeTicks, deadTimeTicks);
+        pwmInitialized = true;
+    }
+
     void begin(uint8_t newGD1APin, uint8_t newGD1BPin, uint8_t newGD2APin, uint8_t newGD2BPin) {
         GD1APin = newGD1APin;
         GD1BPin = newGD1BPin;
@@ -41,4 +66,32 @@ namespace GateDrive {
         digitalWrite(GD1APin, GD1APinEnabled);
         digitalWrite(GD1BPin, GD1BPinEnabled);
     }
-}
\ No newline at end of file
+
+    uint32_t startGD1Pwm(uint32_t frequencyHz) {
+        if (!pwmInitialized) {
+            initPwm();
+        }
+
+        // Nearest whole number of timer ticks, the driver truncates so hand it the exact achievable frequency
+        uint32_t periodTicks = max((pwmTimerResolutionHz + frequencyHz / 2) / frequencyHz, (uint32_t)2);
+        uint32_t achievedHz = pwmTimerResolutionHz / periodTicks;
+        mcpwm_set_frequency(MCPWM_UNIT_0, MCPWM_TIMER_0, achievedHz);
+        mcpwm_set_duty(MCPWM_UNIT_0, MCPWM_TIMER_0, MCPWM_GEN_A, 50.0f);
+        mcpwm_set_duty_type(MCPWM_UNIT_0, MCPWM_TIMER_0, MCPWM_GEN_A, MCPWM_DUTY_MODE_0);
+
+        // The first half cycle is on 0A, which leg that is follows the same phase setting as enableGD1
+        BleControl::ControlState state = BleControl::getState();
+        mcpwm_gpio_init(MCPWM_UNIT_0, MCPWM0A, state.reverseBurstPhase ? GD1APin : GD1BPin);
+        mcpwm_gpio_init(MCPWM_UNIT_0, MCPWM0B, state.reverseBurstPhase ? GD1BPin : GD1APin);
+        mcpwm_start(MCPWM_UNIT_0, MCPWM_TIMER_0);
+        return achievedHz;
+    }
+
+    void stopGD1Pwm() {
+        // Level first so the pins drop straight to low once they're back on GPIO
+        disableGD1();
+        pinMatrixOutDetach(GD1APin, false, false);
+        pinMatrixOutDetach(GD1BPin, false, false);
+        mcpwm_stop(MCPWM_UNIT_0, MCPWM_TIMER_0);
+    }
+}
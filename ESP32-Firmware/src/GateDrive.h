@@ -9,6 +9,12 @@ namespace GateDrive {
     void enableGD1();
     void disableGD1();
 
+    // GD1 driven by MCPWM, complementary with dead time, for the frequency sweep.
+    // Returns the frequency actually generated, the nearest the timer resolution allows.
+    uint32_t startGD1Pwm(uint32_t frequencyHz);
+    // Hands the pins back to GPIO, both low
+    void stopGD1Pwm();
+
     extern bool GD1APinEnabled;
     extern bool GD1BPinEnabled;
     extern uint8_t GD1APin;
@@ -0,0 +1,176 @@
+#include "Metrics.h"
+
+namespace Metrics {
+    // Constants
+    const unsigned long sampleIntervalMs = 1000;
+    // Names the tasks are created with, loopTask is the Arduino core's
+    const char* const taskNames[taskCount] = { "loopTask", "burstTaskLoop", "playMidiTask", "bleNotifyTask", "adcSamplerTask",
+        "sweepTask", "sequenceTask", "audioTask", "pitchTask", "wifiControlTask" };
+
+    // Variables
+    // Each counter has one writer, a torn read only skews one sample
+    volatile uint32_t zcdEdges = 0;
+    volatile uint32_t zcdMaxGapCycles = 0;
+    volatile uint32_t ocdInterrupts = 0;
+    volatile uint32_t bursts = 0;
+    volatile uint32_t burstsCutShort = 0;
+    volatile uint32_t burstsSkipped = 0;
+    volatile uint32_t maxLatenessMicros = 0;
+    volatile uint32_t lateness[latenessBuckets] = {};
+    volatile uint32_t bleRxBytes = 0;
+    volatile uint32_t bleTxBytes = 0;
+    volatile uint32_t bleWrites = 0;
+    volatile uint32_t bleMaxParseCycles = 0;
+    volatile uint64_t bleParseCycles = 0;
+    uint16_t stackFreeBytes[taskCount];
+    uint32_t bleRxBytesPerSecond = 0;
+    uint32_t bleTxBytesPerSecond = 0;
+    uint32_t sampledRxBytes = 0;
+    uint32_t sampledTxBytes = 0;
+    unsigned long lastSampleMillis = 0;
+    uint32_t sequence = 0;
+    bool stacksCleared = false;
+
+    void clearStacks() {
+        for (uint8_t i = 0; i < taskCount; i++) {
+            stackFreeBytes[i] = stackNotSeen;
+        }
+        stacksCleared = true;
+    }
+
+    void handle() {
+        unsigned long now = millis();
+        if (now - lastSampleMillis < sampleIntervalMs) {
+            return;
+        }
+        unsigned long elapsed = now - lastSampleMillis;
+        lastSampleMillis = now;
+
+        if (!stacksCleared) {
+            clearStacks();
+        }
+        // Tasks come and go (the burst task with every enable), keep the worst any instance got to
+        for (uint8_t i = 0; i < taskCount; i++) {
+            TaskHandle_t task = xTaskGetHandle(taskNames[i]);
+            if (task != NULL) {
+                stackFreeBytes[i] = min(stackFreeBytes[i], (uint16_t)min(uxTaskGetStackHighWaterMark(task), (UBaseType_t)0xFFFE));
+            }
+        }
+
+        uint32_t rxBytes = bleRxBytes;
+        uint32_t txBytes = bleTxBytes;
+        bleRxBytesPerSecond = (uint64_t)(rxBytes - sampledRxBytes) * 1000 / elapsed;
+        bleTxBytesPerSecond = (uint64_t)(txBytes - sampledTxBytes) * 1000 / elapsed;
+        sampledRxBytes = rxBytes;
+        sampledTxBytes = txBytes;
+        sequence++;
+    }
+
+    void IRAM_ATTR recordZcdEdge(uint32_t gapCycles) {
+        zcdEdges++;
+        if (gapCycles > zcdMaxGapCycles) {
+            zcdMaxGapCycles = gapCycles;
+        }
+    }
+
+    void IRAM_ATTR recordOcdInterrupt() {
+        ocdInterrupts++;
+    }
+
+    void recordBurst(bool cutShort) {
+        bursts++;
+        if (cutShort) {
+            burstsCutShort++;
+        }
+    }
+
+    void recordSkippedBurst() {
+        burstsSkipped++;
+    }
+
+    void recordLateness(uint32_t micros) {
+        uint8_t bucket = 0;
+        while (bucket < latenessBuckets - 1 && micros > latenessBucketMicros[bucket]) {
+            bucket++;
+        }
+        lateness[bucket]++;
+        if (micros > maxLatenessMicros) {
+            maxLatenessMicros = micros;
+        }
+    }
+
+    void recordBleWrite(size_t bytes, uint32_t cycles) {
+        bleRxBytes += bytes;
+        bleWrites++;
+        bleParseCycles += cycles;
+        if (cycles > bleMaxParseCycles) {
+            bleMaxParseCycles = cycles;
+        }
+    }
+
+    void recordBleNotify(size_t bytes) {
+        bleTxBytes += bytes;
+    }
+
+    Snapshot getSnapshot() {
+        uint32_t cyclesPerMicro = ESP.getCpuFreqMHz();
+        Snapshot snapshot = {};
+        snapshot.version = snapshotVersion;
+        snapshot.uptimeMs = millis();
+        snapshot.zcdEdges = zcdEdges;
+        snapshot.zcdMaxGapNanos = (uint64_t)zcdMaxGapCycles * 1000 / cyclesPerMicro;
+        snapshot.ocdInterrupts = ocdInterrupts;
+        snapshot.bursts = bursts;
+        snapshot.burstsCutShort = burstsCutShort;
+        snapshot.burstsSkipped = burstsSkipped;
+        snapshot.maxLatenessMicros = maxLatenessMicros;
+        for (uint8_t i = 0; i < latenessBuckets; i++) {
+            snapshot.lateness[i] = lateness[i];
+        }
+        snapshot.freeHeap = ESP.getFreeHeap();
+        snapshot.minFreeHeap = ESP.getMinFreeHeap();
+        snapshot.freePsram = ESP.getFreePsram();
+        snapshot.minFreePsram = ESP.getMinFreePsram();
+        snapshot.bleRxBytes = bleRxBytes;
+        snapshot.bleTxBytes = bleTxBytes;
+        snapshot.bleRxBytesPerSecond = bleRxBytesPerSecond;
+        snapshot.bleTxBytesPerSecond = bleTxBytesPerSecond;
+        snapshot.bleWrites = bleWrites;
+        snapshot.bleMaxParseMicros = min(bleMaxParseCycles / cyclesPerMicro, (uint32_t)0xFFFF);
+        uint32_t writes = bleWrites;
+        snapshot.bleAverageParseMicros = writes == 0 ? 0 : min((uint32_t)(bleParseCycles / writes / cyclesPerMicro), (uint32_t)0xFFFF);
+        for (uint8_t i = 0; i < taskCount; i++) {
+            snapshot.stackFreeBytes[i] = stacksCleared ? stackFreeBytes[i] : stackNotSeen;
+        }
+        return snapshot;
+    }
+
+    uint32_t getSequence() {
+        return sequence;
+    }
+
+    const char* getTaskName(uint8_t index) {
+        return index < taskCount ? taskNames[index] : "";
+    }
+
+    void reset() {
+        zcdEdges = 0;
+        zcdMaxGapCycles = 0;
+        ocdInterrupts = 0;
+        bursts = 0;
+        burstsCutShort = 0;
+        burstsSkipped = 0;
+        maxLatenessMicros = 0;
+        for (uint8_t i = 0; i < latenessBuckets; i++) {
+            lateness[i] = 0;
+        }
+        bleRxBytes = 0;
+        bleTxBytes = 0;
+        bleWrites = 0;
+        bleMaxParseCycles = 0;
+        bleParseCycles = 0;
+        sampledRxBytes = 0;
+        sampledTxBytes = 0;
+        clearStacks();
+    }
+}
@@ -0,0 +1,65 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <Arduino.h>
+
+// Counters for diagnosing a coil in the field without a debugger: how busy the ISRs are, how late the burst
+// scheduler runs, how close the tasks and heaps come to running out, and what the BLE link carries.
+// Read as a Snapshot over BLE (diagnostics characteristic) or printed by the "metrics" serial command.
+namespace Metrics {
+    const uint8_t snapshotVersion = 1;
+    const uint8_t latenessBuckets = 8;
+    // Upper bound of each lateness bucket in microseconds, the last bucket is everything later
+    const uint16_t latenessBucketMicros[latenessBuckets - 1] = { 50, 100, 250, 500, 1000, 2000, 5000 };
+    // Tasks whose stacks are watched, see getTaskName() for the order
+    const uint8_t taskCount = 10;
+    const uint16_t stackNotSeen = 0xFFFF;
+
+    // Little-endian, 125 bytes
+    struct __attribute__((packed)) Snapshot {
+        uint8_t version;
+        uint32_t uptimeMs;
+        uint32_t zcdEdges;           // Edges that toggled the bridge
+        uint32_t zcdMaxGapNanos;     // Longest between two toggles in a burst, half a primary cycle plus the ISR running late
+        uint32_t ocdInterrupts;      // Comparator interrupts
+        uint32_t bursts;
+        uint32_t burstsCutShort;     // Ended early by the OCD latch
+        uint32_t burstsSkipped;      // Held back after an OCD trip
+        uint32_t maxLatenessMicros;
+        uint32_t lateness[latenessBuckets]; // Bursts by how late they fired after the millisecond the scheduler had them due
+        uint32_t freeHeap;
+        uint32_t minFreeHeap;        // Since boot, the allocator keeps it and it can't be reset
+        uint32_t freePsram;
+        uint32_t minFreePsram;
+        uint32_t bleRxBytes;
+        uint32_t bleTxBytes;         // Notifications, the readings and sweep data included
+        uint32_t bleRxBytesPerSecond;
+        uint32_t bleTxBytesPerSecond;
+        uint32_t bleWrites;
+        uint16_t bleMaxParseMicros;  // Longest a write spent in the control callback
+        uint16_t bleAverageParseMicros;
+        uint16_t stackFreeBytes[taskCount]; // Least free stack seen, stackNotSeen for a task that hasn't run yet
+    };
+
+    // From loop(), samples the heaps, stacks and BLE rates once a second
+    void handle();
+
+    void IRAM_ATTR recordZcdEdge(uint32_t gapCycles);
+    void IRAM_ATTR recordOcdInterrupt();
+    // From the burst task
+    void recordBurst(bool cutShort);
+    void recordSkippedBurst();
+    void recordLateness(uint32_t micros);
+    // From the BLE callbacks
+    void recordBleWrite(size_t bytes, uint32_t cycles);
+    void recordBleNotify(size_t bytes);
+
+    Snapshot getSnapshot();
+    // Changes whenever handle() takes a new sample
+    uint32_t getSequence();
+    const char* getTaskName(uint8_t index);
+    // Zeroes the counters and histogram, the heap low-water marks stay
+    void reset();
+}
+
+#endif
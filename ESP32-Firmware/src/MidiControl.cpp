@@ -1,5 +1,7 @@
 #include "MidiControl.h"
 #include "BleControl.h"
+#include "PulseBench.h"
+#include "Trace.h"
 #include <sstream>
 #include "MidiFile.h"
 
@@ -98,14 +100,10 @@ namespace MidiControl {
 	void setPlaying(bool playing) {
 		if (playing && !isPlaying) {
 			// Start playback
-			Serial.println("setPlaying true");
 			if (!midiFileLoaded && isFileReady()) {
-				Serial.println("Loading MidiFile");
 				// Load MIDI file
-				// Between HERE
 				std::istringstream stream = createInputStream();
 				if (midiFile.read(stream)) {
-					Serial.println("MidiFile loaded");
 					midiFileLoaded = true;
 					midiFile.doTimeAnalysis();
 					midiFile.linkNotePairs();
@@ -118,6 +116,7 @@ namespace MidiControl {
 			
 			if (midiFileLoaded) {
 				isPlaying = true;
+				Trace::record(Trace::midiPlaying, 1);
 				currentEventIndex = 0;
 				playbackStartTime = millis();
 				// Make sure we don't have a dangling task handle
@@ -125,41 +124,21 @@ namespace MidiControl {
 					vTaskDelete(playMidiTaskHandle);
 					playMidiTaskHandle = NULL;
 				}
-				// and HERE is where the heap is being gobbled
-				// Check available heap before creating task
-				size_t freeHeap = ESP.getFreeHeap();
-				//size_t largestFreeBlock = ESP.getMaxAllocHeap();
-				size_t freePsram = ESP.getFreePsram();
-				Serial.print("Free heap before task creation: ");
-				Serial.print(freeHeap);
-				Serial.print(", Free PSRAM: ");
-				Serial.print(freePsram);
-				Serial.println(" bytes");
-				
-				BaseType_t result = xTaskCreate(playMidiTask, "playMidiTask", 4096, NULL, 3, &playMidiTaskHandle);
-				if (result == pdPASS) {
-					Serial.print("playMidiTask created successfully with ");
-				} else {
-					Serial.print("Failed with stack size ");
-					Serial.println(result);
+				// Same core as the burst task, see Burst::enable
+				if (xTaskCreatePinnedToCore(playMidiTask, "playMidiTask", 4096, NULL, 3, &playMidiTaskHandle, 1) != pdPASS) {
+					isPlaying = false;
+					Serial.println("playMidiTask could not be created");
 				}
-				
-				Serial.print("Free heap AFTER task creation: ");
-				Serial.print(freeHeap);
-				Serial.print(", Free PSRAM: ");
-				Serial.print(freePsram);
-				Serial.println(" bytes");
 			}
 		} else if (!playing && isPlaying) {
-			Serial.println("deleting playMidiTask...");
 			// Stop playback
 			isPlaying = false;
+			Trace::record(Trace::midiPlaying, 0);
 			if (playMidiTaskHandle != NULL) {
 				vTaskDelete(playMidiTaskHandle);
 				playMidiTaskHandle = NULL;
 			}
 			clearOnNotes();
-			Serial.println("playMidiTask deleted");
 		}
 	}
 	
@@ -207,11 +186,15 @@ namespace MidiControl {
 
 		BleControl::setBps(noteFreq);
 		currentPlayingNote = note;
+		Trace::record(Trace::noteOn, note);
+		PulseBench::recordNote(note, octave, noteFreq);
 	}
 
 	void stopNote() {
+		Trace::record(Trace::noteOff, currentPlayingNote);
 		currentPlayingNote = 0;
 		BleControl::setBps(1);
+		PulseBench::recordNote(0, 0, 1);
 	}
 
 	int8_t getIndexOfOnNote(uint8_t note) {
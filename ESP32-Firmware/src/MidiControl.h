@@ -49,5 +49,6 @@ namespace MidiControl {
 	void clearOnNotes();
 
 	extern TaskHandle_t playMidiTaskHandle;
+	extern bool isPlaying;
 }
 
@@ -1,26 +1,152 @@
 #include "OCD.h"
 #include "CurrentTransformer.h"
 #include "BleControl.h"
+#include "AdcEngine.h"
+#include "ZCD.h"
+#include "Trace.h"
+#include "Metrics.h"
 
+namespace {
+    const uint32_t tripLogMagic = 0x4F434431; // "OCD1"
+
+    struct TripLog {
+        uint32_t magic;
+        uint32_t bootCount;
+        uint32_t sequence; // Trips logged since the log was cleared
+        uint8_t head;
+        uint8_t count;
+        OCD::Trip entries[OCD::maxTrips];
+    };
+
+    // Not initialised on reset, only a power cycle clears it
+    RTC_NOINIT_ATTR TripLog tripLog;
+    portMUX_TYPE tripLogMux = portMUX_INITIALIZER_UNLOCKED;
+
+    uint8_t ocdInterruptPin = 0;
+    uint8_t ctPeakPin = 0;
+    uint16_t thresholdRaw = 0xFFFF;
+    uint32_t armedMicros = 0;
+    uint32_t armedSampleIndex = 0;
+    volatile uint8_t latchedSource = OCD::tripComparator;
+    volatile uint32_t latchedMicros = 0;
+
+    void IRAM_ATTR latch(uint8_t source) {
+        if (OCD::latched) {
+            return;
+        }
+        ZCD::disable();
+        OCD::latched = true;
+        latchedSource = source;
+        latchedMicros = micros();
+        Trace::record(Trace::ocdTrip, source);
+    }
+
+    void IRAM_ATTR comparatorInterrupt() {
+        Metrics::recordOcdInterrupt();
+        latch(OCD::tripComparator);
+    }
+
+    void logTrip(uint16_t peakCurrent, uint16_t burstLength, uint16_t tripAfterMicros, uint8_t source) {
+        portENTER_CRITICAL(&tripLogMux);
+        OCD::Trip& trip = tripLog.entries[tripLog.head];
+        trip.bootCount = tripLog.bootCount;
+        trip.uptimeMillis = millis();
+        trip.peakCurrent = peakCurrent;
+        trip.burstLength = burstLength;
+        trip.tripAfterMicros = tripAfterMicros;
+        trip.source = source;
+        trip.reserved = 0;
+        tripLog.head = (tripLog.head + 1) % OCD::maxTrips;
+        if (tripLog.count < OCD::maxTrips) {
+            tripLog.count++;
+        }
+        tripLog.sequence++;
+        portEXIT_CRITICAL(&tripLogMux);
+    }
+}
 
 namespace OCD {
     uint16_t OCDCurrent = 0;
     uint16_t turnsRatio = 0;
     uint32_t burdenMiliohms = 0;
     bool ocdTriggered = 0;
+    volatile bool latched = false;
 
-    void begin(uint16_t newOCDCurrent, uint16_t newTurnsRatio, uint32_t newBurdenMiliohms) {
+    void begin(uint16_t newOCDCurrent, uint16_t newTurnsRatio, uint32_t newBurdenMiliohms, uint8_t interruptPin, uint8_t ctPin) {
         OCDCurrent = newOCDCurrent;
         turnsRatio = newTurnsRatio;
         burdenMiliohms = newBurdenMiliohms;
+        ocdInterruptPin = interruptPin;
+        ctPeakPin = ctPin;
+
+        if (tripLog.magic != tripLogMagic || tripLog.head >= maxTrips || tripLog.count > maxTrips) {
+            memset(&tripLog, 0, sizeof(tripLog));
+            tripLog.magic = tripLogMagic;
+        }
+        tripLog.bootCount++;
+
+        refreshThreshold();
+
+        if (ocdInterruptPin != 0) {
+            pinMode(ocdInterruptPin, INPUT);
+            attachInterrupt(digitalPinToInterrupt(ocdInterruptPin), comparatorInterrupt, RISING);
+        }
+    }
+
+    void refreshThreshold() {
+        // Smallest raw peak detector reading at the limit, so the ISR path compares raw values only
+        uint32_t limitMilliVolts = ((uint32_t)OCDCurrent * burdenMiliohms) / turnsRatio;
+        uint16_t low = 0;
+        uint16_t high = 4096;
+        while (low < high) {
+            uint16_t middle = (low + high) / 2;
+            if (AdcEngine::toMilliVolts(ctPeakPin, middle) >= limitMilliVolts) {
+                high = middle;
+            } else {
+                low = middle + 1;
+            }
+        }
+        thresholdRaw = low < 4096 ? low : 0xFFFF;
+    }
+
+    void IRAM_ATTR arm() {
+        armedMicros = micros();
+        // Past the anchor's error, a sample from before arming holds the last burst
+        armedSampleIndex = AdcEngine::sampleIndexAt(ctPeakPin, armedMicros + AdcEngine::maxAnchorLateMicros);
+        latched = false;
+        if (ocdInterruptPin != 0 && digitalRead(ocdInterruptPin)) {
+            latch(tripComparator);
+        }
+    }
+
+    bool IRAM_ATTR checkFast() {
+        if (latched) {
+            return true;
+        }
+
+        // Only samples taken after the peak detector was reset for this burst count. The newest one the sampler has
+        // delivered, not the current, that's the comparator's job
+        uint32_t newest = AdcEngine::getSampleCount(ctPeakPin) - 1;
+        if ((int32_t)(newest - armedSampleIndex) >= 0 && AdcEngine::latestRaw(ctPeakPin) >= thresholdRaw) {
+            latch(tripAdcThreshold);
+            return true;
+        }
+        return false;
     }
 
     void checkOCD() {
-        uint32_t ctMilivolts = CurrentTransformer::readCurrentTransformer();
+        CurrentTransformer::BurstPeak burstPeak = CurrentTransformer::getLastBurstPeak();
+        uint32_t ctMilivolts = burstPeak.endPeakMilliVolts;
         uint16_t ctCurrent = (ctMilivolts * turnsRatio) / burdenMiliohms; // I = (V * turns ratio)/R, because V = (I / turns ratio)R
-        if (ctCurrent >= OCDCurrent) {
+        if (latched) {
+            ocdTriggered = 1;
+            uint32_t tripAfterMicros = min(latchedMicros - armedMicros, (uint32_t)0xFFFF);
+            logTrip(ctCurrent, burstPeak.burstLength, tripAfterMicros, latchedSource);
+            latched = false;
+        } else if (ctCurrent >= OCDCurrent) {
             //Burst::disable();
             ocdTriggered = 1;
+            logTrip(ctCurrent, burstPeak.burstLength, burstPeak.burstLength, tripBurstPeak);
             // BleControl::setBurstEnabled(0);
             // delay(200);
             // BleControl::setBurstEnabled(1);
@@ -30,4 +156,19 @@ namespace OCD {
     void resetOCDTriggered() {
         ocdTriggered = 0;
     }
+
+    uint8_t getTrips(Trip* trips, uint8_t max) {
+        portENTER_CRITICAL(&tripLogMux);
+        uint8_t count = min(tripLog.count, max);
+        uint8_t start = (tripLog.head + maxTrips - tripLog.count) % maxTrips;
+        for (uint8_t i = 0; i < count; i++) {
+            trips[i] = tripLog.entries[(start + i) % maxTrips];
+        }
+        portEXIT_CRITICAL(&tripLogMux);
+        return count;
+    }
+
+    uint32_t getTripSequence() {
+        return tripLog.sequence;
+    }
 }
@@ -1,17 +1,52 @@
 #ifndef OCD_H
-#define OCD_h
+#define OCD_H
 
 #include <Arduino.h>
 
 namespace OCD {
-    void begin(uint16_t newOCDCurrent, uint16_t newTurnsRatio, uint32_t newBurdenMiliohms);
+    // What ended the burst
+    enum TripSource : uint8_t {
+        tripComparator = 0, // OCD comparator interrupt
+        tripAdcThreshold = 1, // Peak detector sample over the limit at a ZCD edge, a DMA frame or more late
+        tripBurstPeak = 2 // Captured burst peak over the limit, after the burst
+    };
+
+    // One over-current event, kept in RTC memory so it survives a crash or watchdog reset
+    struct Trip {
+        uint32_t bootCount;
+        uint32_t uptimeMillis;
+        uint16_t peakCurrent; // Amps
+        uint16_t burstLength; // Configured, in microseconds
+        uint16_t tripAfterMicros; // Time into the burst the gates were stopped
+        uint8_t source;
+        uint8_t reserved;
+    };
+
+    const uint8_t maxTrips = 16;
+
+    // interruptPin is the comparator output, 0 when it isn't fitted
+    void begin(uint16_t newOCDCurrent, uint16_t newTurnsRatio, uint32_t newBurdenMiliohms, uint8_t interruptPin, uint8_t ctPin);
+    // Maps the limit onto a raw CT reading through the calibration, again whenever the calibration changes
+    void refreshThreshold();
+    // Called at the start of each burst, clears the latch unless the comparator is still asserted
+    void IRAM_ATTR arm();
+    // Called from the ZCD ISR each half cycle, true if the burst has to stop. Only a comparator trip stops the burst
+    // within a half cycle. The ADC check sees the peak detector a DMA frame late (100us and more), so it only cuts
+    // bursts that run well past that, without the comparator fitted checkOCD is the real protection
+    bool IRAM_ATTR checkFast();
+    // After each burst, flags the next one to be skipped if this one tripped or its captured peak was over the limit
     void checkOCD();
     void resetOCDTriggered();
 
+    // Oldest first, returns the number copied
+    uint8_t getTrips(Trip* trips, uint8_t max);
+    uint32_t getTripSequence();
+
     extern uint16_t OCDCurrent;
     extern uint16_t turnsRatio;
     extern uint32_t burdenMiliohms;
     extern bool ocdTriggered;
+    extern volatile bool latched;
 }
 
-#endif
\ No newline at end of file
+#endif
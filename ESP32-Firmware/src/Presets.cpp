@@ -0,0 +1,101 @@
+#include "Presets.h"
+#include "BleControl.h"
+#include <Preferences.h>
+
+namespace Presets {
+    const uint8_t opRecall = 0;
+    const uint8_t opSave = 1;
+    const uint8_t opDelete = 2;
+
+    struct StoredPreset {
+        char name[maxNameLength];
+        uint8_t block[BleControl::parameterBlockSize];
+    };
+
+    Preferences preferences;
+    bool initialized = false;
+
+    void getKey(uint8_t index, char* key) {
+        snprintf(key, 4, "p%u", index);
+    }
+
+    bool load(uint8_t index, StoredPreset& preset) {
+        if (!initialized || index >= maxPresets) {
+            return false;
+        }
+
+        char key[4];
+        getKey(index, key);
+        return preferences.getBytes(key, &preset, sizeof(StoredPreset)) == sizeof(StoredPreset);
+    }
+
+    void begin() {
+        initialized = preferences.begin("presets", false);
+    }
+
+    bool save(uint8_t index, const char* name) {
+        if (!initialized || index >= maxPresets) {
+            return false;
+        }
+
+        StoredPreset preset = {};
+        strncpy(preset.name, name, maxNameLength);
+        BleControl::encodeParameterBlock(BleControl::getState(), preset.block);
+
+        char key[4];
+        getKey(index, key);
+        return preferences.putBytes(key, &preset, sizeof(StoredPreset)) == sizeof(StoredPreset);
+    }
+
+    bool recall(uint8_t index) {
+        StoredPreset preset;
+        if (!load(index, preset)) {
+            return false;
+        }
+
+        // Keep the live relay and burst enable, a preset only swaps the tuning
+        BleControl::ControlState state = BleControl::getState();
+        preset.block[0] = state.enabled ? 1 : 0;
+        preset.block[8] = state.burstEnabled ? 1 : 0;
+        return BleControl::applyParameterBlock(preset.block, sizeof(preset.block));
+    }
+
+    bool remove(uint8_t index) {
+        if (!initialized || index >= maxPresets) {
+            return false;
+        }
+
+        char key[4];
+        getKey(index, key);
+        return preferences.remove(key);
+    }
+
+    bool getName(uint8_t index, char* name) {
+        StoredPreset preset;
+        if (!load(index, preset)) {
+            return false;
+        }
+
+        memcpy(name, preset.name, maxNameLength);
+        name[maxNameLength] = 0;
+        return true;
+    }
+
+    void handleCommand(const uint8_t* data, size_t length) {
+        if (data == nullptr || length < 2) {
+            return;
+        }
+
+        uint8_t op = data[0];
+        uint8_t index = data[1];
+        if (op == opRecall) {
+            recall(index);
+        } else if (op == opSave) {
+            char name[maxNameLength + 1] = {};
+            memcpy(name, &data[2], min(length - 2, (size_t)maxNameLength));
+            save(index, name);
+        } else if (op == opDelete) {
+            remove(index);
+        }
+    }
+}
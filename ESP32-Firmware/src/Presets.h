@@ -0,0 +1,28 @@
+#ifndef PRESETS_H
+#define PRESETS_H
+
+#include <Arduino.h>
+
+namespace Presets {
+    const uint8_t maxPresets = 8;
+    const uint8_t maxNameLength = 16;
+
+    // Open the NVS namespace presets are stored in
+    void begin();
+
+    // Store the current parameter block under the given index
+    bool save(uint8_t index, const char* name);
+
+    // Atomically apply a stored parameter block
+    bool recall(uint8_t index);
+
+    bool remove(uint8_t index);
+
+    // name must hold maxNameLength + 1 bytes, returns false for empty slots
+    bool getName(uint8_t index, char* name);
+
+    // Shared by the BLE and Wi-Fi transports: u8 op (0 recall, 1 save, 2 delete), u8 index, then the name when saving
+    void handleCommand(const uint8_t* data, size_t length);
+}
+
+#endif
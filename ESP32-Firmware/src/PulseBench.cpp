@@ -0,0 +1,86 @@
+#include "PulseBench.h"
+#include "SpscRing.h"
+
+namespace PulseBench {
+    struct Pulse {
+        uint32_t startCycles;
+        uint32_t busyCycles;
+        uint16_t bps;
+    };
+
+    struct Note {
+        uint32_t cycles;
+        uint16_t bps;
+        uint8_t note;
+        int8_t octave;
+    };
+
+    // A couple of seconds at the top of the MIDI range, drained every loop()
+    SpscRing<Pulse, 1024> pulses;
+    SpscRing<Note, 256> notes;
+    // The MIDI task and the audio pitch voice can both play notes
+    portMUX_TYPE notesMux = portMUX_INITIALIZER_UNLOCKED;
+    volatile bool recording = false;
+    volatile uint32_t dropped = 0;
+    uint32_t printed = 0;
+    unsigned long startedMillis = 0;
+
+    void start() {
+        if (recording) {
+            return;
+        }
+        pulses.clear();
+        notes.clear();
+        dropped = 0;
+        printed = 0;
+        startedMillis = millis();
+        Serial.printf("bench,start,%lu\n", (unsigned long)ESP.getCpuFreqMHz());
+        recording = true;
+    }
+
+    void stop() {
+        if (!recording) {
+            return;
+        }
+        recording = false;
+        handle();
+        Serial.printf("bench,stop,%lu,%lu,%lu\n", (unsigned long)printed, (unsigned long)dropped, millis() - startedMillis);
+    }
+
+    bool isRecording() {
+        return recording;
+    }
+
+    void record(uint32_t startCycles, uint32_t busyCycles, uint16_t bps) {
+        if (!recording) {
+            return;
+        }
+        if (!pulses.push({ startCycles, busyCycles, bps })) {
+            dropped++;
+        }
+    }
+
+    void recordNote(uint8_t note, int8_t octave, uint16_t bps) {
+        if (!recording) {
+            return;
+        }
+        portENTER_CRITICAL(&notesMux);
+        bool pushed = notes.push({ ESP.getCycleCount(), bps, note, octave });
+        portEXIT_CRITICAL(&notesMux);
+        if (!pushed) {
+            dropped++;
+        }
+    }
+
+    void handle() {
+        Note note;
+        while (notes.pop(note)) {
+            Serial.printf("note,%lu,%u,%d,%u\n", (unsigned long)note.cycles, note.note, note.octave, note.bps);
+        }
+        Pulse pulse;
+        while (pulses.pop(pulse)) {
+            Serial.printf("pulse,%lu,%lu,%u\n", (unsigned long)pulse.startCycles, (unsigned long)pulse.busyCycles, pulse.bps);
+            printed++;
+        }
+    }
+}
@@ -0,0 +1,30 @@
+#ifndef PULSEBENCH_H
+#define PULSEBENCH_H
+
+#include <Arduino.h>
+
+// Pulse log for the pitch benchmark (tools/pulse_bench.py): every burst the burst task fires and every note
+// MidiControl starts or stops, stamped with the cycle counter and streamed out as CSV while recording so a whole
+// song fits. The native build (sim/) runs the same code.
+//   bench,start,<cpu MHz>
+//   note,<cycles>,<note>,<octave>,<bps>        note 0 is a rest
+//   pulse,<start cycles>,<busy cycles>,<bps>   busy is the time spent firing it
+//   bench,stop,<pulses>,<dropped>,<elapsed ms> dropped is lines lost to a full ring, not missed bursts
+// Cycle counts wrap every few seconds, and notes and pulses come from different tasks so their lines can be
+// out of order by up to a loop() period. Every task that records is pinned to core 1, the two cores' counters
+// don't run in step.
+namespace PulseBench {
+    void start();
+    void stop();
+    bool isRecording();
+
+    // From the burst task, bps is what was asked for when it fired
+    void record(uint32_t startCycles, uint32_t busyCycles, uint16_t bps);
+    // From whichever task plays notes
+    void recordNote(uint8_t note, int8_t octave, uint16_t bps);
+
+    // Prints what has been recorded since the last call
+    void handle();
+}
+
+#endif
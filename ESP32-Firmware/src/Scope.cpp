@@ -0,0 +1,213 @@
+#include "Scope.h"
+#include "BleControl.h"
+#include "SpscRing.h"
+#include <esp_heap_caps.h>
+
+// Constants
+const uint32_t captureTimeoutMicros = 20000; // Give up waiting on samples that were missed
+
+namespace {
+    enum State : uint8_t {
+        stateIdle,
+        stateArmed,
+        stateRecording, // Burst running, edges are being recorded
+        stateWaiting // Burst over, waiting on the post trigger samples
+    };
+
+    struct Capture {
+        uint32_t triggerMicros;
+        uint32_t samplePeriodNanos;
+        uint16_t burstLength;
+        uint16_t phaseLead;
+        int16_t firstSampleOffset;
+        uint8_t sampleCount;
+        uint16_t edgeCount;
+        uint16_t samples[Scope::maxSamples];
+        uint32_t edgeNanos[Scope::maxEdges];
+    };
+
+    uint8_t ctPeakPin = 0;
+    Capture* captures = nullptr; // captureSlots of them, in PSRAM
+    SpscRing<uint8_t, Scope::captureSlots> ready;
+    uint8_t writeSlot = 0;
+    Scope::Sink armedSink = Scope::sinkBle;
+
+    volatile State state = stateIdle;
+    uint16_t preTriggerSamples = 0;
+    uint16_t postTriggerMicros = 0;
+    uint8_t remaining = 0;
+
+    // Capture in progress, the edges go to internal RAM from the ISR and are copied out at the end
+    uint32_t triggerCycles = 0;
+    uint32_t triggerMicros = 0;
+    uint32_t triggerIndex = 0;
+    uint32_t endIndex = 0;
+    uint16_t triggerBurstLength = 0;
+    uint16_t triggerPhaseLead = 0;
+    uint32_t edgeCycles[Scope::maxEdges];
+    volatile uint16_t edgeCount = 0;
+
+    void finalize() {
+        // One slot short of the ring's limit: popCapture takes a slot off the ring before encoding it, and writeSlot
+        // would come round to it while it's being read
+        if (ready.size() >= Scope::captureSlots - 2) {
+            // Nobody is reading them out, drop this one
+            state = remaining > 0 ? stateArmed : stateIdle;
+            return;
+        }
+
+        Capture& capture = captures[writeSlot];
+        capture.triggerMicros = triggerMicros;
+        capture.samplePeriodNanos = AdcEngine::getSamplePeriodNanos();
+        capture.burstLength = triggerBurstLength;
+        capture.phaseLead = triggerPhaseLead;
+
+        // Keep the newest maxSamples if the window is longer than the history
+        uint32_t firstIndex = triggerIndex - preTriggerSamples;
+        if ((int32_t)(endIndex - firstIndex) >= Scope::maxSamples) {
+            firstIndex = endIndex - Scope::maxSamples + 1;
+        }
+        uint8_t sampleCount = 0;
+        int16_t firstSampleOffset = 0;
+        for (uint32_t index = firstIndex; (int32_t)(endIndex - index) >= 0; index++) {
+            uint16_t raw;
+            if (!AdcEngine::sampleAt(ctPeakPin, index, raw)) {
+                continue;
+            }
+            if (sampleCount == 0) {
+                firstSampleOffset = (int32_t)(index - triggerIndex);
+            }
+            capture.samples[sampleCount++] = raw;
+        }
+        AdcEngine::toMilliVolts(ctPeakPin, capture.samples, capture.samples, sampleCount);
+        capture.sampleCount = sampleCount;
+        capture.firstSampleOffset = firstSampleOffset;
+
+        uint16_t edges = edgeCount;
+        uint32_t cpuMHz = getCpuFrequencyMhz();
+        for (uint16_t i = 0; i < edges; i++) {
+            capture.edgeNanos[i] = (uint32_t)(((uint64_t)edgeCycles[i] * 1000) / cpuMHz);
+        }
+        capture.edgeCount = edges;
+
+        ready.push(writeSlot);
+        writeSlot = (writeSlot + 1) % Scope::captureSlots;
+        state = remaining > 0 ? stateArmed : stateIdle;
+    }
+
+    void writeU16(uint8_t* out, uint16_t value) {
+        out[0] = value & 0xFF;
+        out[1] = value >> 8;
+    }
+
+    void writeU32(uint8_t* out, uint32_t value) {
+        writeU16(out, value & 0xFFFF);
+        writeU16(out + 2, value >> 16);
+    }
+}
+
+namespace Scope {
+    bool begin(uint8_t ctPin) {
+        ctPeakPin = ctPin;
+        captures = (Capture*)heap_caps_malloc(sizeof(Capture) * captureSlots, MALLOC_CAP_SPIRAM);
+        return captures != nullptr;
+    }
+
+    void arm(uint16_t preTriggerMicros, uint16_t newPostTriggerMicros, uint8_t count, Sink sink) {
+        if (captures == nullptr || count == 0) {
+            return;
+        }
+
+        uint32_t samplePeriodNanos = AdcEngine::getSamplePeriodNanos();
+        if (samplePeriodNanos == 0) {
+            return;
+        }
+
+        state = stateIdle;
+        preTriggerSamples = min(((uint32_t)preTriggerMicros * 1000) / samplePeriodNanos, (uint32_t)maxSamples);
+        postTriggerMicros = newPostTriggerMicros;
+        remaining = count;
+        armedSink = sink;
+        state = stateArmed;
+    }
+
+    void disarm() {
+        remaining = 0;
+        state = stateIdle;
+    }
+
+    void IRAM_ATTR trigger(uint16_t burstLength) {
+        if (state != stateArmed) {
+            return;
+        }
+
+        triggerCycles = ESP.getCycleCount();
+        triggerMicros = micros();
+        triggerIndex = AdcEngine::sampleIndexAt(ctPeakPin, triggerMicros);
+        triggerBurstLength = burstLength;
+        triggerPhaseLead = BleControl::getState().phaseLead;
+        edgeCount = 0;
+        remaining--;
+        state = stateRecording;
+    }
+
+    void IRAM_ATTR recordEdge(uint32_t cycles) {
+        if (state != stateRecording || edgeCount >= maxEdges) {
+            return;
+        }
+        edgeCycles[edgeCount] = cycles - triggerCycles;
+        edgeCount = edgeCount + 1;
+    }
+
+    void IRAM_ATTR burstEnd() {
+        if (state != stateRecording) {
+            return;
+        }
+        endIndex = AdcEngine::sampleIndexAt(ctPeakPin, micros() + postTriggerMicros);
+        state = stateWaiting;
+    }
+
+    void process() {
+        if (state != stateWaiting) {
+            return;
+        }
+
+        uint16_t raw;
+        if (AdcEngine::sampleAt(ctPeakPin, endIndex, raw) || micros() - triggerMicros > captureTimeoutMicros) {
+            finalize();
+        }
+    }
+
+    size_t popCapture(Sink sink, uint8_t* out) {
+        uint8_t slot;
+        if (sink != armedSink || !ready.pop(slot)) {
+            return 0;
+        }
+
+        const Capture& capture = captures[slot];
+        writeU32(&out[0], capture.triggerMicros);
+        writeU32(&out[4], capture.samplePeriodNanos);
+        writeU16(&out[8], capture.burstLength);
+        writeU16(&out[10], capture.phaseLead);
+        writeU16(&out[12], (uint16_t)capture.firstSampleOffset);
+        out[14] = capture.sampleCount;
+        out[15] = 0;
+        writeU16(&out[16], capture.edgeCount);
+        size_t length = headerSize;
+        for (uint8_t i = 0; i < capture.sampleCount; i++, length += 2) {
+            writeU16(&out[length], capture.samples[i]);
+        }
+        for (uint16_t i = 0; i < capture.edgeCount; i++, length += 4) {
+            writeU32(&out[length], capture.edgeNanos[i]);
+        }
+        return length;
+    }
+
+    bool isArmed() {
+        return state != stateIdle;
+    }
+
+    uint8_t getPendingCaptures() {
+        return ready.size();
+    }
+}
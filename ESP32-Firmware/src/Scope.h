@@ -0,0 +1,48 @@
+#ifndef SCOPE_H
+#define SCOPE_H
+
+#include <Arduino.h>
+#include "AdcEngine.h"
+
+// Triggered capture of the CT peak detector and ZCD edges around a burst, a poor man's oscilloscope for tuning phase lead.
+// Captures are kept in PSRAM until whoever armed the scope (BLE or serial) streams them out.
+//
+// Encoded capture, little endian:
+//   u32 triggerMicros, u32 samplePeriodNanos, u16 burstLength, u16 phaseLead,
+//   i16 firstSampleOffset (in sample periods from the trigger), u8 sampleCount, u8 reserved, u16 edgeCount,
+//   u16 ctMilliVolts[sampleCount], u32 edgeNanos[edgeCount] (since the trigger, taken right after each gate toggle)
+namespace Scope {
+    enum Sink : uint8_t {
+        sinkBle = 0,
+        sinkSerial = 1
+    };
+
+    const uint8_t maxSamples = AdcEngine::windowSize;
+    const uint16_t maxEdges = 512;
+    const uint8_t captureSlots = 16; // Up to 14 pending, one more being streamed out
+    const size_t headerSize = 18;
+    const size_t maxCaptureBytes = headerSize + maxSamples * 2 + maxEdges * 4;
+
+    bool begin(uint8_t ctPin);
+
+    // Capture the next count bursts with preTriggerMicros before and postTriggerMicros after each
+    void arm(uint16_t preTriggerMicros, uint16_t postTriggerMicros, uint8_t count, Sink sink);
+    void disarm();
+
+    // Called from singleBurst and the ZCD ISR
+    void IRAM_ATTR trigger(uint16_t burstLength);
+    // cycles is the ESP.getCycleCount() the ISR already read after toggling the gates
+    void IRAM_ATTR recordEdge(uint32_t cycles);
+    void IRAM_ATTR burstEnd();
+
+    // Called from the burst task, finalizes a capture once its post trigger samples have arrived
+    void process();
+
+    // Oldest finished capture for this sink, encoded into out (maxCaptureBytes), 0 if there is none
+    size_t popCapture(Sink sink, uint8_t* out);
+
+    bool isArmed();
+    uint8_t getPendingCaptures();
+}
+
+#endif
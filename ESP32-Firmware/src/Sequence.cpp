@@ -0,0 +1,234 @@
+#include "Sequence.h"
+#include "BleControl.h"
+#include "MidiControl.h"
+#include "FrequencySweep.h"
+#include "AudioStream.h"
+#include <esp_timer.h>
+#include <vector>
+
+namespace Sequence {
+    // Constants
+    const uint8_t magic[4] = { 'T', 'C', 'S', 'Q' };
+    const int64_t tickMicros = portTICK_PERIOD_MS * 1000;
+    const int64_t maxSleepTicks = 50; // Short enough sleeps that a stop is noticed promptly
+    const uint16_t maxPhaseLead = 1250; // Same limits as BleControl::applyParameterBlock
+    const uint16_t minBurstLength = 10;
+    const uint16_t maxBurstLength = 500;
+
+    // Variables
+    std::vector<uint8_t> uploadBuffer;
+    std::vector<Event> timeline;
+    volatile State state = stateEmpty;
+    volatile bool playing = false;
+    volatile bool voiceOn = true;
+    volatile uint16_t cursor = 0;
+    uint32_t durationMicros = 0;
+    int64_t startedMicros = 0;
+    uint32_t maxLateMicros = 0;
+    uint32_t statusSequence = 0;
+    TaskHandle_t sequenceTaskHandle = NULL;
+    // Restored when the show ends, so it doesn't leave the sliders wherever it finished
+    BleControl::ControlState savedState;
+
+    void setState(State newState) {
+        state = newState;
+        statusSequence++;
+    }
+
+    void begin() {
+        setState(stateEmpty);
+    }
+
+    // Checks the upload and unpacks it into the timeline, rejecting anything the parameter block would reject
+    bool finishUpload() {
+        size_t length = uploadBuffer.size();
+        if (length < headerSize || memcmp(uploadBuffer.data(), magic, sizeof(magic)) != 0 || uploadBuffer[4] != formatVersion) {
+            return false;
+        }
+        uint16_t count;
+        memcpy(&count, &uploadBuffer[6], sizeof(count));
+        if (count == 0 || count > maxEvents || length != headerSize + count * sizeof(Event)) {
+            return false;
+        }
+
+        timeline.resize(count);
+        memcpy(timeline.data(), &uploadBuffer[headerSize], count * sizeof(Event));
+        uploadBuffer.clear();
+        uploadBuffer.shrink_to_fit();
+
+        uint32_t lastTime = 0;
+        for (const Event& event : timeline) {
+            uint32_t time = event.timeMicros;
+            uint16_t value = event.value;
+            bool valid = time >= lastTime;
+            if (event.parameter == parameterBps) {
+                valid = valid && value >= 1;
+            } else if (event.parameter == parameterBurstLength) {
+                valid = valid && value >= minBurstLength && value <= maxBurstLength;
+            } else if (event.parameter == parameterPhaseLead) {
+                valid = valid && value <= maxPhaseLead;
+            } else if (event.parameter != parameterVoice && event.parameter != parameterEnd) {
+                valid = false;
+            }
+            if (!valid) {
+                timeline.clear();
+                return false;
+            }
+            lastTime = time;
+        }
+        durationMicros = lastTime;
+        return true;
+    }
+
+    void apply(const Event& event) {
+        uint16_t value = event.value;
+        if (event.parameter == parameterBps) {
+            BleControl::setBps(value);
+        } else if (event.parameter == parameterBurstLength) {
+            BleControl::setBurstLength(value);
+        } else if (event.parameter == parameterPhaseLead) {
+            BleControl::setPhaseLead(value);
+        } else if (event.parameter == parameterVoice) {
+            voiceOn = value != 0;
+        }
+    }
+
+    // Same cursor walk as MidiControl::handle, but sleeping between events instead of polling. Events land on the
+    // first tick at or after their time: the burst task only picks a change up at its next burst, on its own
+    // millisecond grid, and spinning out the rest of a tick here would starve it
+    void sequenceTask(void* arg) {
+        while (playing && cursor < timeline.size()) {
+            const Event& event = timeline[cursor];
+            int64_t due = startedMicros + event.timeMicros;
+            int64_t wait = due - esp_timer_get_time();
+            // A sleep of n ticks can end early within the nth tick, so round up and check again
+            if (wait > 0) {
+                vTaskDelay(min((wait + tickMicros - 1) / tickMicros, maxSleepTicks));
+                continue;
+            }
+
+            // Everything due at the same time goes out together
+            uint32_t late = esp_timer_get_time() - due;
+            maxLateMicros = max(maxLateMicros, late);
+            uint32_t time = event.timeMicros;
+            while (cursor < timeline.size() && timeline[cursor].timeMicros == time) {
+                apply(timeline[cursor]);
+                cursor++;
+            }
+        }
+
+        playing = false;
+        voiceOn = true;
+        BleControl::setBps(savedState.bps);
+        BleControl::setBurstLength(savedState.burstLength);
+        BleControl::setPhaseLead(savedState.phaseLead);
+        // Stays off if that's what stopped the show
+        BleControl::setBurstEnabled(savedState.burstEnabled && BleControl::getState().burstEnabled);
+        Serial.printf("Sequence finished at event %u of %u, worst lateness %lu us\n", cursor, (unsigned)timeline.size(), (unsigned long)maxLateMicros);
+        setState(stateReady);
+        sequenceTaskHandle = NULL;
+        vTaskDelete(NULL);
+    }
+
+    bool play() {
+        BleControl::ControlState controlState = BleControl::getState();
+        if (state != stateReady || playing || sequenceTaskHandle != NULL || !controlState.enabled
+            || MidiControl::isPlaying || FrequencySweep::running || AudioStream::isActive()) {
+            return false;
+        }
+
+        savedState = controlState;
+        cursor = 0;
+        maxLateMicros = 0;
+        // Silent until the timeline turns the voice on
+        voiceOn = false;
+        // Bursts on first, handle() stops a show once they're off
+        BleControl::setBurstEnabled(true);
+        playing = true;
+        setState(statePlaying);
+        startedMicros = esp_timer_get_time();
+        // On the app core with the burst and MIDI tasks (Burst::enable), at the MIDI player's priority above the burst task
+        xTaskCreatePinnedToCore(sequenceTask, "sequenceTask", 3072, NULL, 3, &sequenceTaskHandle, 1);
+        return true;
+    }
+
+    void stop() {
+        // The task restores the parameters on its way out
+        playing = false;
+    }
+
+    void handle() {
+        if (!playing) {
+            return;
+        }
+
+        BleControl::ControlState controlState = BleControl::getState();
+        if (!controlState.enabled || !controlState.burstEnabled) {
+            stop();
+        }
+    }
+
+    void handleCommand(const uint8_t* data, size_t length) {
+        if (data == nullptr || length < 1) {
+            return;
+        }
+
+        uint8_t op = data[0];
+        if (op == opPlay) {
+            if (!play()) {
+                Serial.println("Sequence not started");
+            }
+            return;
+        }
+        if (op == opStop) {
+            stop();
+            return;
+        }
+        // The timeline can't change under a running show
+        if (playing || sequenceTaskHandle != NULL) {
+            return;
+        }
+
+        if (op == opBegin) {
+            timeline.clear();
+            uploadBuffer.clear();
+            setState(stateUploading);
+        } else if (op == opAppend && state == stateUploading && length >= 3) {
+            uint16_t offset;
+            memcpy(&offset, &data[1], sizeof(offset));
+            // Chunks must arrive in order, a gap means one was lost on the way
+            if (offset != uploadBuffer.size() || uploadBuffer.size() + length - 3 > headerSize + maxEvents * sizeof(Event)) {
+                uploadBuffer.clear();
+                setState(stateInvalid);
+                return;
+            }
+            uploadBuffer.insert(uploadBuffer.end(), &data[3], &data[length]);
+        } else if (op == opFinish && state == stateUploading) {
+            setState(finishUpload() ? stateReady : stateInvalid);
+            Serial.printf("Sequence upload %s, %u events\n", state == stateReady ? "ready" : "rejected", (unsigned)timeline.size());
+        }
+    }
+
+    bool isPlaying() {
+        return playing;
+    }
+
+    bool isMuted() {
+        return playing && !voiceOn;
+    }
+
+    Status getStatus() {
+        Status status;
+        status.state = state;
+        status.eventCount = timeline.size();
+        status.cursor = cursor;
+        status.durationMs = durationMicros / 1000;
+        status.elapsedMs = playing ? (esp_timer_get_time() - startedMicros) / 1000 : 0;
+        status.maxLateMicros = maxLateMicros;
+        return status;
+    }
+
+    uint32_t getStatusSequence() {
+        return statusSequence;
+    }
+}
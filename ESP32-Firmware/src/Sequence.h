@@ -0,0 +1,71 @@
+#ifndef SEQUENCE_H
+#define SEQUENCE_H
+
+#include <Arduino.h>
+
+// Scripted shows: a flat timeline of parameter changes, compiled on the host from keyframes (tools/sequence.py),
+// uploaded once and then played by a cursor the way MidiControl walks its events, so nothing has to be sent while it plays.
+// Times are stored in microseconds, the player only wakes on ticks so an event lands up to a tick late.
+// Timeline format, little-endian: "TCSQ", u8 version, u8 reserved, u16 event count, then count x Event sorted by time.
+namespace Sequence {
+    const uint8_t formatVersion = 1;
+    const size_t headerSize = 8;
+    const uint16_t maxEvents = 4096;
+
+    enum Parameter : uint8_t {
+        parameterBps = 0,
+        parameterBurstLength = 1, // In microseconds
+        parameterPhaseLead = 2,   // In nanoseconds
+        parameterVoice = 3,       // 0 mutes the bursts, anything else lets them fire
+        parameterEnd = 4          // Marks the end of the show, value unused
+    };
+
+    struct __attribute__((packed)) Event {
+        uint32_t timeMicros; // From the start of the show, but played on the next FreeRTOS tick (1ms) at or after it
+        uint8_t parameter;
+        uint16_t value;
+    };
+
+    enum Op : uint8_t {
+        opBegin = 0,  // Start an upload, discarding the last timeline
+        opAppend = 1, // u16 offset, then timeline bytes
+        opFinish = 2, // Validate the upload
+        opPlay = 3,
+        opStop = 4
+    };
+
+    enum State : uint8_t {
+        stateEmpty = 0,
+        stateUploading = 1,
+        stateReady = 2,
+        statePlaying = 3,
+        stateInvalid = 4 // Upload rejected, a chunk went missing or the timeline didn't validate
+    };
+
+    struct __attribute__((packed)) Status {
+        uint8_t state;
+        uint16_t eventCount;
+        uint16_t cursor;        // Next event to play
+        uint32_t durationMs;
+        uint32_t elapsedMs;
+        uint32_t maxLateMicros; // Worst lateness of an event in the last show, up to a tick is expected
+    };
+
+    void begin();
+    // Stops the show when the coil is disabled or the bursts are turned off
+    void handle();
+
+    // Shared by the BLE and Wi-Fi transports: u8 op, then op specific data
+    void handleCommand(const uint8_t* data, size_t length);
+
+    bool play();
+    void stop();
+    bool isPlaying();
+    // Playing with the voice off, the burst task holds its bursts
+    bool isMuted();
+
+    Status getStatus();
+    uint32_t getStatusSequence();
+}
+
+#endif
@@ -0,0 +1,247 @@
+#include "SerialCommands.h"
+#include "Scope.h"
+#include "AdcEngine.h"
+#include "FastAnalogRead.h"
+#include "AutoTune.h"
+#include "AudioStream.h"
+#include "Sequence.h"
+#include "PulseBench.h"
+#include "Trace.h"
+#include "Metrics.h"
+#include "OCD.h"
+
+namespace SerialCommands {
+    // Constants
+    const size_t maxLineLength = 64;
+
+    // Variables
+    char line[maxLineLength + 1];
+    size_t lineLength = 0;
+    uint8_t* frame = nullptr;
+
+    void runScope(char* arguments) {
+        if (strncmp(arguments, "off", 3) == 0) {
+            Scope::disarm();
+            Serial.println("scope off");
+            return;
+        }
+
+        unsigned int preTrigger = 0;
+        unsigned int postTrigger = 0;
+        unsigned int count = 1;
+        if (sscanf(arguments, "%u %u %u", &preTrigger, &postTrigger, &count) < 2 || count == 0 || count > 255) {
+            Serial.println("usage: scope <preMicros> <postMicros> [count] | scope off");
+            return;
+        }
+        Scope::arm(preTrigger, postTrigger, count, Scope::sinkSerial);
+        Serial.println("scope armed");
+    }
+
+    void runEnob(char* arguments) {
+        unsigned int pin = 0;
+        if (sscanf(arguments, "%u", &pin) != 1) {
+            Serial.println("usage: enob <pin>");
+            return;
+        }
+        Serial.print("enob ");
+        Serial.print(pin);
+        Serial.print(": ");
+        Serial.println(AdcEngine::measureEnob(pin), 2);
+    }
+
+    void runCalibration(char* arguments) {
+        unsigned int atten = 0;
+        unsigned int points[4];
+        char clear[6] = "";
+        if (sscanf(arguments, "%u %5s", &atten, clear) == 2 && strcmp(clear, "clear") == 0) {
+            fadcClearCorrection(atten);
+            OCD::refreshThreshold();
+            Serial.println("calibration cleared");
+        } else if (sscanf(arguments, "%u %u %u %u %u", &atten, &points[0], &points[1], &points[2], &points[3]) == 5) {
+            fadcSetCorrection(atten, points[0], points[1], points[2], points[3]);
+            OCD::refreshThreshold();
+            Serial.println("calibration stored");
+        } else {
+            Serial.println("usage: cal <atten> <measured1> <actual1> <measured2> <actual2> | cal <atten> clear");
+        }
+    }
+
+    void runAudio(char* arguments) {
+        if (strstr(arguments, "pitch") != nullptr) {
+            AudioStream::setVoice(AudioStream::voicePitch);
+        } else if (strstr(arguments, "pulses") != nullptr) {
+            AudioStream::setVoice(AudioStream::voicePulses);
+        }
+
+        AudioStream::Stats stats = AudioStream::getStats();
+        Serial.printf("audio %s, voice %s, %u samples buffered, pitch %.1f Hz\n", AudioStream::isActive() ? "active" : "idle",
+            AudioStream::getVoice() == AudioStream::voicePitch ? "pitch" : "pulses", (unsigned)AudioStream::getBufferedSamples(),
+            AudioStream::getPitchHz());
+        Serial.printf("  %lu pulses, %lu skipped, %lu underruns, %lu overruns, %lu lost packets\n", (unsigned long)stats.pulses,
+            (unsigned long)stats.skippedPulses, (unsigned long)stats.underruns, (unsigned long)stats.overruns, (unsigned long)stats.lostPackets);
+        Serial.printf("  latency %lu us, max %lu us\n", (unsigned long)stats.latencyMicros, (unsigned long)stats.maxLatencyMicros);
+        Serial.printf("  %lu pitch frames, %lu cycles average (%lu us), %lu max\n", (unsigned long)stats.pitchFrames,
+            (unsigned long)stats.averageFrameCycles, (unsigned long)(stats.averageFrameCycles / ESP.getCpuFreqMHz()),
+            (unsigned long)stats.maxFrameCycles);
+    }
+
+    void runSequence(char* arguments) {
+        if (strstr(arguments, "play") != nullptr) {
+            uint8_t op = Sequence::opPlay;
+            Sequence::handleCommand(&op, 1);
+        } else if (strstr(arguments, "stop") != nullptr) {
+            uint8_t op = Sequence::opStop;
+            Sequence::handleCommand(&op, 1);
+        }
+
+        const char* stateNames[] = { "empty", "uploading", "ready", "playing", "invalid" };
+        Sequence::Status status = Sequence::getStatus();
+        uint8_t state = status.state;
+        Serial.printf("sequence %s, event %u of %u, %lu of %lu ms, worst lateness %lu us\n",
+            stateNames[min(state, (uint8_t)Sequence::stateInvalid)], status.cursor, status.eventCount,
+            (unsigned long)status.elapsedMs, (unsigned long)status.durationMs, (unsigned long)status.maxLateMicros);
+    }
+
+    void runBench(char* arguments) {
+        if (strstr(arguments, "start") != nullptr) {
+            PulseBench::start();
+        } else if (strstr(arguments, "stop") != nullptr) {
+            PulseBench::stop();
+        } else {
+            Serial.printf("bench %s\n", PulseBench::isRecording() ? "recording" : "stopped");
+        }
+    }
+
+    void runTrace(char* arguments) {
+        unsigned int mask = Trace::allEvents;
+        if (strstr(arguments, "start") != nullptr) {
+            sscanf(strstr(arguments, "start") + 5, "%x", &mask);
+            Trace::start(mask);
+            Serial.printf("trace recording, mask %x\n", mask & Trace::allEvents);
+        } else if (strstr(arguments, "stop") != nullptr) {
+            Trace::stop();
+            Serial.println("trace stopped");
+        } else if (strstr(arguments, "dump") != nullptr) {
+            Trace::dump();
+        } else {
+            Serial.printf("trace %s\n", Trace::isRecording() ? "recording" : "stopped");
+        }
+    }
+
+    void runMetrics(char* arguments) {
+        if (strstr(arguments, "reset") != nullptr) {
+            Metrics::reset();
+        }
+
+        Metrics::Snapshot snapshot = Metrics::getSnapshot();
+        Serial.printf("metrics after %lu ms\n", (unsigned long)snapshot.uptimeMs);
+        Serial.printf("  zcd %lu edges, %lu ns longest gap between toggles, %lu ocd interrupts\n", (unsigned long)snapshot.zcdEdges,
+            (unsigned long)snapshot.zcdMaxGapNanos, (unsigned long)snapshot.ocdInterrupts);
+        Serial.printf("  bursts %lu, %lu cut short, %lu skipped, %lu us latest\n", (unsigned long)snapshot.bursts,
+            (unsigned long)snapshot.burstsCutShort, (unsigned long)snapshot.burstsSkipped, (unsigned long)snapshot.maxLatenessMicros);
+        Serial.print("  lateness");
+        for (uint8_t i = 0; i < Metrics::latenessBuckets; i++) {
+            if (i < Metrics::latenessBuckets - 1) {
+                Serial.printf(" <=%u:%lu", Metrics::latenessBucketMicros[i], (unsigned long)snapshot.lateness[i]);
+            } else {
+                Serial.printf(" more:%lu", (unsigned long)snapshot.lateness[i]);
+            }
+        }
+        Serial.println();
+        Serial.printf("  heap %lu free, %lu lowest, psram %lu free, %lu lowest\n", (unsigned long)snapshot.freeHeap,
+            (unsigned long)snapshot.minFreeHeap, (unsigned long)snapshot.freePsram, (unsigned long)snapshot.minFreePsram);
+        Serial.printf("  ble in %lu B (%lu B/s, %lu writes, parse %u us max %u us average), out %lu B (%lu B/s)\n",
+            (unsigned long)snapshot.bleRxBytes, (unsigned long)snapshot.bleRxBytesPerSecond, (unsigned long)snapshot.bleWrites,
+            snapshot.bleMaxParseMicros, snapshot.bleAverageParseMicros, (unsigned long)snapshot.bleTxBytes,
+            (unsigned long)snapshot.bleTxBytesPerSecond);
+        Serial.print("  stack free");
+        for (uint8_t i = 0; i < Metrics::taskCount; i++) {
+            if (snapshot.stackFreeBytes[i] != Metrics::stackNotSeen) {
+                Serial.printf(" %s:%u", Metrics::getTaskName(i), snapshot.stackFreeBytes[i]);
+            }
+        }
+        Serial.println();
+    }
+
+    void runCommand(char* command) {
+        if (strncmp(command, "scope", 5) == 0) {
+            runScope(command + 5);
+        } else if (strncmp(command, "enob", 4) == 0) {
+            runEnob(command + 4);
+        } else if (strncmp(command, "cal", 3) == 0) {
+            runCalibration(command + 3);
+        } else if (strncmp(command, "autotune", 8) == 0) {
+            if (strstr(command + 8, "cancel") != nullptr) {
+                AutoTune::cancel();
+            } else {
+                AutoTune::start();
+            }
+        } else if (strncmp(command, "audio", 5) == 0) {
+            runAudio(command + 5);
+        } else if (strncmp(command, "sequence", 8) == 0) {
+            runSequence(command + 8);
+        } else if (strncmp(command, "bench", 5) == 0) {
+            runBench(command + 5);
+        } else if (strncmp(command, "trace", 5) == 0) {
+            runTrace(command + 5);
+        } else if (strncmp(command, "metrics", 7) == 0) {
+            runMetrics(command + 7);
+        } else if (command[0] != '\0') {
+            Serial.print("unknown command: ");
+            Serial.println(command);
+        }
+    }
+
+    void writeScopeCaptures() {
+        if (frame == nullptr) {
+            frame = (uint8_t*)malloc(4 + 2 + Scope::maxCaptureBytes);
+            if (frame == nullptr) {
+                return;
+            }
+        }
+
+        size_t length;
+        while ((length = Scope::popCapture(Scope::sinkSerial, &frame[6])) > 0) {
+            memcpy(frame, "SCOP", 4);
+            frame[4] = length & 0xFF;
+            frame[5] = length >> 8;
+            Serial.write(frame, length + 6);
+        }
+    }
+
+    void printAutoTune() {
+        static uint32_t printedSequence = 0;
+        uint32_t sequence = AutoTune::getResultSequence();
+        if (sequence == printedSequence) {
+            return;
+        }
+        printedSequence = sequence;
+
+        const char* statusNames[] = { "idle", "sweeping", "tuning phase", "done", "failed" };
+        AutoTune::Result result = AutoTune::getResult();
+        uint8_t status = result.status;
+        Serial.printf("autotune %s: resonance %lu Hz, second %lu Hz, phase lead %u ns, peak %u mV\n",
+            statusNames[min(status, (uint8_t)AutoTune::statusFailed)], (unsigned long)result.resonanceHz,
+            (unsigned long)result.secondResonanceHz, result.phaseLead, result.peakMilliVolts);
+    }
+
+    void handle() {
+        while (Serial.available() > 0) {
+            char c = Serial.read();
+            if (c == '\r') {
+                continue;
+            }
+            if (c == '\n') {
+                line[lineLength] = '\0';
+                runCommand(line);
+                lineLength = 0;
+            } else if (lineLength < maxLineLength) {
+                line[lineLength++] = c;
+            }
+        }
+
+        writeScopeCaptures();
+        printAutoTune();
+        PulseBench::handle();
+    }
+}
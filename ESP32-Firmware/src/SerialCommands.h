@@ -0,0 +1,21 @@
+#ifndef SERIALCOMMANDS_H
+#define SERIALCOMMANDS_H
+
+#include <Arduino.h>
+
+// Line based commands on the USB serial port, for bench work without the app:
+//   scope <preMicros> <postMicros> <count>   arm the scope, captures are written back as binary frames
+//   scope off                                disarm it
+//   enob <pin>                               effective number of bits from the noise on an analog pin
+//   cal <atten> <measured1> <actual1> <measured2> <actual2>   two-point ADC correction in millivolts, kept in NVS
+//   cal <atten> clear                        back to the eFuse calibration
+//   autotune [cancel]                        find the resonances and phase lead, the coil must be enabled with bursts off
+//   bench [start|stop]                       log every burst as CSV for tools/pulse_bench.py (see PulseBench.h)
+//   trace [start [hexMask]|stop|dump]        record ISR and task events, dump them for tools/trace_json.py (see Trace.h)
+//   metrics [reset]                          ISR, burst scheduler, stack, heap and BLE counters (see Metrics.h)
+// Binary frames are "SCOP", u16 length, then the encoded capture (see Scope.h)
+namespace SerialCommands {
+    void handle();
+}
+
+#endif
@@ -0,0 +1,42 @@
+#include "Telemetry.h"
+#include "SpscRing.h"
+
+namespace Telemetry {
+    volatile uint8_t enabledStreams = 0;
+
+    SpscRing<Sample, 1024> rings[streamCount];
+    volatile uint32_t dropped[streamCount] = {};
+
+    void setEnabledStreams(uint8_t mask) {
+        enabledStreams = mask;
+    }
+
+    void IRAM_ATTR push(uint8_t stream, uint16_t value) {
+        if (stream >= streamCount || !(enabledStreams & (1 << stream))) {
+            return;
+        }
+
+        pushAt(stream, micros(), value);
+    }
+
+    void IRAM_ATTR pushAt(uint8_t stream, uint32_t timestampMicros, uint16_t value) {
+        if (stream >= streamCount || !(enabledStreams & (1 << stream))) {
+            return;
+        }
+
+        if (!rings[stream].push({ timestampMicros, value })) {
+            dropped[stream]++;
+        }
+    }
+
+    bool pop(uint8_t stream, Sample& sample) {
+        if (stream >= streamCount) {
+            return false;
+        }
+        return rings[stream].pop(sample);
+    }
+
+    uint32_t getDropped(uint8_t stream) {
+        return stream < streamCount ? dropped[stream] : 0;
+    }
+}
@@ -0,0 +1,35 @@
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <Arduino.h>
+
+// High-rate sample streams for transports that can carry them (Wi-Fi), BLE only gets the slow readings
+namespace Telemetry {
+    enum Stream : uint8_t {
+        streamCt = 0,  // CT peak in millivolts, one sample per burst
+        streamZcd = 1, // ZCD edge, value is the edge count
+        streamCtSamples = 2, // CT peak detector in millivolts, every AdcEngine sample (20kHz)
+        streamCount = 3
+    };
+
+    struct Sample {
+        uint32_t timestampMicros;
+        uint16_t value;
+    };
+
+    // Bit per Stream, producers skip pushing streams nobody is subscribed to
+    void setEnabledStreams(uint8_t mask);
+
+    // Safe to call from an ISR, one producer per stream
+    void IRAM_ATTR push(uint8_t stream, uint16_t value);
+    // For samples taken before they're pushed
+    void IRAM_ATTR pushAt(uint8_t stream, uint32_t timestampMicros, uint16_t value);
+    bool pop(uint8_t stream, Sample& sample);
+
+    // Samples lost because the consumer fell behind
+    uint32_t getDropped(uint8_t stream);
+
+    extern volatile uint8_t enabledStreams;
+}
+
+#endif
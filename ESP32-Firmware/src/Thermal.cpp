@@ -0,0 +1,135 @@
+#include "Thermal.h"
+#include "AdcEngine.h"
+
+// Thermistors: 10k B3950 NTC from 3V3 to the ADC pin, 10k to ground
+const float supplyMilliVolts = 3300.0f;
+const float seriesResistorOhms = 10000.0f;
+const float steinhartA = 1.009249522e-3f;
+const float steinhartB = 2.378405444e-4f;
+const float steinhartC = 2.019202697e-7f;
+const uint16_t openMilliVolts = 50; // Below this the thermistor is open
+const uint16_t shortedMilliVolts = 3250; // Above this it is shorted
+const uint8_t multisampleCount = 16;
+
+// Millivolts to temperature, linearly interpolated
+const uint8_t tableBits = 6;
+const uint16_t tableStepMilliVolts = 64;
+
+// Thermal model
+const float conductionMilliVolts = 2500.0f; // Vce(sat) plus switching loss folded in, per amp of average current
+const float junctionToHeatsinkKelvinPerWatt = 0.6f;
+const float junctionTimeConstantSeconds = 2.0f;
+
+// Derating
+const uint16_t defaultDutyPermille = 100; // The old fixed cap, used while the thermistors can't be read
+const uint16_t coolDutyPermille = defaultDutyPermille; // Derating only lowers the old cap until the model's constants are checked on the coil
+const uint16_t hotDutyPermille = 20;
+const float deratingStartCelsius = 85.0f;
+const float deratingEndCelsius = 115.0f;
+const float shutdownCelsius = 125.0f;
+
+namespace Thermal {
+    volatile uint16_t maxDutyPermille = defaultDutyPermille;
+
+    uint8_t thermPins[sensorCount] = { 0, 0 };
+    int16_t temperatureTable[(1 << tableBits) + 1]; // Tenths of a degree
+    float temperatures[sensorCount] = { invalidTemperature, invalidTemperature };
+    float junctionRise = 0.0f;
+    unsigned long lastUpdateMicros = 0;
+
+    // Energy since the last handle(), microjoules, added by the burst task
+    uint32_t pendingEnergyMicroJoules = 0;
+    portMUX_TYPE energyMux = portMUX_INITIALIZER_UNLOCKED;
+
+    float steinhartHart(float milliVolts) {
+        float ohms = seriesResistorOhms * (supplyMilliVolts - milliVolts) / milliVolts;
+        float lnR = logf(ohms);
+        return 1.0f / (steinhartA + steinhartB * lnR + steinhartC * lnR * lnR * lnR) - 273.15f;
+    }
+
+    float lookup(uint16_t milliVolts) {
+        uint16_t index = min(milliVolts / tableStepMilliVolts, (1 << tableBits) - 1);
+        uint16_t fraction = milliVolts - index * tableStepMilliVolts;
+        int32_t low = temperatureTable[index];
+        int32_t high = temperatureTable[index + 1];
+        return (low + ((high - low) * fraction) / tableStepMilliVolts) * 0.1f;
+    }
+
+    void begin(uint8_t therm1Pin, uint8_t therm2Pin) {
+        thermPins[0] = therm1Pin;
+        thermPins[1] = therm2Pin;
+
+        // Steinhart-Hart is too slow to evaluate per reading, precompute it
+        for (uint16_t i = 0; i <= (1 << tableBits); i++) {
+            float milliVolts = constrain(i * tableStepMilliVolts, openMilliVolts, shortedMilliVolts);
+            temperatureTable[i] = (int16_t)(steinhartHart(milliVolts) * 10.0f);
+        }
+
+        lastUpdateMicros = micros();
+    }
+
+    void addBurst(uint16_t burstLengthMicros, uint16_t peakCurrent) {
+        // The current ramps up through the burst, so it averages about half the peak
+        uint32_t energy = (uint32_t)(conductionMilliVolts * peakCurrent / 2 * burstLengthMicros / 1000.0f);
+        portENTER_CRITICAL(&energyMux);
+        pendingEnergyMicroJoules += energy;
+        portEXIT_CRITICAL(&energyMux);
+    }
+
+    void handle() {
+        unsigned long now = micros();
+        float dt = (now - lastUpdateMicros) * 0.000001f;
+        lastUpdateMicros = now;
+        if (dt <= 0.0f) {
+            return;
+        }
+
+        float heatsink = invalidTemperature;
+        for (uint8_t i = 0; i < sensorCount; i++) {
+            uint16_t milliVolts = thermPins[i] == 0 ? 0 : AdcEngine::averageMilliVolts(thermPins[i], multisampleCount);
+            bool valid = milliVolts > openMilliVolts && milliVolts < shortedMilliVolts;
+            temperatures[i] = valid ? lookup(milliVolts) : invalidTemperature;
+            heatsink = max(heatsink, temperatures[i]);
+        }
+
+        portENTER_CRITICAL(&energyMux);
+        uint32_t energy = pendingEnergyMicroJoules;
+        pendingEnergyMicroJoules = 0;
+        portEXIT_CRITICAL(&energyMux);
+
+        // First order step of the junction's rise over the heatsink towards P * Rth
+        float watts = energy * 0.000001f / dt;
+        float alpha = min(dt / junctionTimeConstantSeconds, 1.0f);
+        junctionRise += (watts * junctionToHeatsinkKelvinPerWatt - junctionRise) * alpha;
+
+        if (heatsink == invalidTemperature) {
+            maxDutyPermille = defaultDutyPermille;
+            return;
+        }
+
+        float junction = heatsink + junctionRise;
+        if (junction >= shutdownCelsius) {
+            maxDutyPermille = 0;
+        } else if (junction >= deratingEndCelsius) {
+            maxDutyPermille = hotDutyPermille;
+        } else if (junction > deratingStartCelsius) {
+            float position = (junction - deratingStartCelsius) / (deratingEndCelsius - deratingStartCelsius);
+            maxDutyPermille = coolDutyPermille - (uint16_t)((coolDutyPermille - hotDutyPermille) * position);
+        } else {
+            maxDutyPermille = coolDutyPermille;
+        }
+    }
+
+    float getTemperature(uint8_t sensor) {
+        return sensor < sensorCount ? temperatures[sensor] : invalidTemperature;
+    }
+
+    float getJunctionTemperature() {
+        float heatsink = max(temperatures[0], temperatures[1]);
+        return heatsink == invalidTemperature ? invalidTemperature : heatsink + junctionRise;
+    }
+
+    uint16_t getMaxDutyPermille() {
+        return maxDutyPermille;
+    }
+}
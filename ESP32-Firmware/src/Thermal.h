@@ -0,0 +1,28 @@
+#ifndef THERMAL_H
+#define THERMAL_H
+
+#include <Arduino.h>
+
+// Heatsink thermistors plus a lumped RC model of the IGBT junctions above them.
+// The burst task reports each burst's energy, handle() advances the model and sets the duty limit the scheduler uses.
+namespace Thermal {
+    const uint8_t sensorCount = 2;
+    const float invalidTemperature = -273.0f;
+
+    void begin(uint8_t therm1Pin, uint8_t therm2Pin);
+    void handle();
+
+    // Called once per burst with its captured CT peak
+    void addBurst(uint16_t burstLengthMicros, uint16_t peakCurrent);
+
+    // Degrees C, invalidTemperature when the thermistor reads open or shorted
+    float getTemperature(uint8_t sensor);
+    float getJunctionTemperature();
+
+    // Allowed on-time per second in permille, replaces the fixed 10% cap
+    uint16_t getMaxDutyPermille();
+
+    extern volatile uint16_t maxDutyPermille;
+}
+
+#endif
@@ -0,0 +1,108 @@
+#include "Trace.h"
+#include <esp_timer.h>
+
+namespace Trace {
+    struct Entry {
+        uint32_t cycles;
+        uint16_t arg;
+        uint8_t event;
+        uint8_t reserved;
+    };
+
+    // Past the Events, never in the mask. An anchor is a pair: anchorCycles holds the cycle counter with arg 1 after a
+    // gap, anchorMicros right after it holds the clock's low 32 bits in cycles and the next 16 in arg
+    const uint8_t anchorCycles = eventCount;
+    const uint8_t anchorMicros = eventCount + 1;
+    // Well short of half a cycle counter wrap, so consecutive entries are never ambiguous
+    const TickType_t anchorGapTicks = pdMS_TO_TICKS(1000);
+
+    struct Ring {
+        uint32_t head;          // Entries ever recorded, the next slot is head % traceDepth
+        TickType_t lastTick;    // Of the last entry
+        uint16_t sinceAnchor;   // Events since the last anchor
+        bool anchored;          // False until the first anchor after start()
+        Entry entries[traceDepth];
+    };
+
+    // Internal RAM, never PSRAM, so the ISRs can write it with the cache disabled
+    DRAM_ATTR Ring rings[portNUM_PROCESSORS];
+    DRAM_ATTR volatile uint16_t enabledMask = 0;
+
+    void start(uint16_t mask) {
+        enabledMask = 0;
+        for (uint8_t core = 0; core < portNUM_PROCESSORS; core++) {
+            rings[core].head = 0;
+            rings[core].anchored = false;
+        }
+        enabledMask = mask & allEvents;
+    }
+
+    void stop() {
+        enabledMask = 0;
+    }
+
+    bool isRecording() {
+        return enabledMask != 0;
+    }
+
+    void IRAM_ATTR record(uint8_t event, uint16_t arg) {
+        if (!(enabledMask & (1 << event))) {
+            return;
+        }
+        recordAt(event, ESP.getCycleCount(), arg);
+    }
+
+    void IRAM_ATTR append(Ring& ring, const Entry& entry) {
+        ring.entries[ring.head & (traceDepth - 1)] = entry;
+        ring.head++;
+    }
+
+    void IRAM_ATTR recordAt(uint8_t event, uint32_t cycles, uint16_t arg) {
+        if (!(enabledMask & (1 << event))) {
+            return;
+        }
+        // Each core has its own ring, only an interrupt on the same core can race for it
+        Ring& ring = rings[xPortGetCoreID()];
+        UBaseType_t interrupts = portSET_INTERRUPT_MASK_FROM_ISR();
+        TickType_t tick = xTaskGetTickCountFromISR();
+        bool afterGap = !ring.anchored || tick - ring.lastTick > anchorGapTicks;
+        if (afterGap || ring.sinceAnchor >= anchorInterval) {
+            uint64_t micros = esp_timer_get_time();
+            append(ring, { ESP.getCycleCount(), (uint16_t)afterGap, anchorCycles, 0 });
+            append(ring, { (uint32_t)micros, (uint16_t)(micros >> 32), anchorMicros, 0 });
+            ring.anchored = true;
+            ring.sinceAnchor = 0;
+        }
+        append(ring, { cycles, arg, event, 0 });
+        ring.lastTick = tick;
+        ring.sinceAnchor++;
+        portCLEAR_INTERRUPT_MASK_FROM_ISR(interrupts);
+    }
+
+    void dump() {
+        stop();
+        // Lets an event that was half written when recording stopped finish
+        delay(1);
+
+        Serial.printf("trace,start,%lu,%u\n", (unsigned long)ESP.getCpuFreqMHz(), (unsigned)portNUM_PROCESSORS);
+        for (uint8_t core = 0; core < portNUM_PROCESSORS; core++) {
+            Ring& ring = rings[core];
+            uint32_t recorded = ring.head;
+            Serial.printf("trace,core,%u,%lu\n", core, (unsigned long)recorded);
+            uint32_t kept = min(recorded, (uint32_t)traceDepth);
+            for (uint32_t i = recorded - kept; i != recorded; i++) {
+                const Entry& entry = ring.entries[i & (traceDepth - 1)];
+                if (entry.event == anchorCycles && i + 1 != recorded) {
+                    const Entry& clock = ring.entries[(i + 1) & (traceDepth - 1)];
+                    uint64_t micros = ((uint64_t)clock.arg << 32) | clock.cycles;
+                    Serial.printf("a,%u,%lu,%llu,%u\n", core, (unsigned long)entry.cycles, (unsigned long long)micros, entry.arg);
+                    i++;
+                } else if (entry.event < eventCount) {
+                    // Skips the clock half of an anchor whose first half the ring overwrote
+                    Serial.printf("t,%u,%lu,%u,%u\n", core, (unsigned long)entry.cycles, entry.event, entry.arg);
+                }
+            }
+        }
+        Serial.println("trace,end");
+    }
+}
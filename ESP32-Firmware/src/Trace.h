@@ -0,0 +1,52 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <Arduino.h>
+
+// Flight recorder for timing bugs: ISRs and tasks drop compact events stamped with the cycle counter into a ring
+// per core. "trace dump" prints them and tools/trace_json.py turns that into a Chrome/Perfetto trace. The rings
+// overwrite, so a dump holds the last traceDepth events of each core.
+// Events are recorded after the work they describe (the ZCD ISR records after toggling the gates), so tracing never
+// delays a toggle. It does lengthen the ISRs and the burst task while recording, narrow the mask to what's needed.
+// Each core's cycle counter started at its own time and wraps every ~18s, so the rings also hold anchors pairing it
+// with the shared microsecond clock: before a core's first event, before any event after a second without one, and
+// every anchorInterval events so a full ring keeps one.
+//   trace,start,<cpu MHz>,<cores>
+//   trace,core,<core>,<recorded>                  recorded counts anchors too
+//   a,<core>,<cycles>,<micros>,<after gap>        an anchor, after gap is 1 when nothing before it is within a second
+//   t,<core>,<cycles>,<event>,<arg>               oldest first
+//   trace,end
+namespace Trace {
+    enum Event : uint8_t {
+        zcdEdge = 0,      // arg is the edge count, stamped when the ISR is done with the edge
+        gateToggle = 1,   // arg is the new GD1A level, stamped right after the toggle
+        burstStart = 2,   // arg is the burst length in us
+        burstEnd = 3,     // arg is 1 when the OCD cut it short
+        ocdTrip = 4,      // arg is the OCD::TripSource
+        noteOn = 5,       // arg is the MIDI note
+        noteOff = 6,
+        bleWrite = 7,     // arg is the length written
+        midiPlaying = 8,  // arg is 1 on start, 0 on stop
+        eventCount = 9
+    };
+
+    const uint16_t traceDepth = 1024; // Per core, a power of two
+    const uint16_t anchorInterval = 64; // Events between anchors, each takes two slots
+    const uint16_t allEvents = (1 << eventCount) - 1;
+
+    // Clears the rings and records the events in the mask (bit per Event)
+    void start(uint16_t mask = allEvents);
+    void stop();
+    bool isRecording();
+
+    // Safe from ISRs and either core. A load and a test when the event isn't recorded, otherwise interrupts are masked
+    // for a tick count read, a cycle counter read and an 8 byte store, and a clock read when an anchor is due
+    void IRAM_ATTR record(uint8_t event, uint16_t arg = 0);
+    // For a caller that already read the cycle counter
+    void IRAM_ATTR recordAt(uint8_t event, uint32_t cycles, uint16_t arg = 0);
+
+    // Stops recording and prints the rings
+    void dump();
+}
+
+#endif
@@ -1,17 +1,43 @@
 #include "VBus.h"
-#include "FastAnalogRead.h"
+#include "AdcEngine.h"
 
 // Constants
-const uint8_t multisampleCount = 10;
+const uint8_t multisampleCount = 16;
 const uint8_t vBusOpAmpResistanceKiloOhms = 3;
 
+// Sag compensation
+const uint8_t filterSampleCount = 32;
+const uint8_t filterShift = 2; // EMA weight 1/4 per burst
+const uint32_t referenceTimeConstantMillis = 10000; // The unsagged reference decays this slowly, rises immediately
+const uint32_t idleGapMillis = 250; // A rest this long between bursts lets the bus recover, it's read afresh after one
+const uint32_t minCompensationMilliVolts = 20000; // Bus not up yet, don't compensate
+const uint8_t compensationTableBits = 6;
+const uint16_t maxSagPermille = 400; // Sag covered by the table, deeper sag gets the last entry
+const uint16_t maxScale = 384; // 1.5x, in 1/256ths
+
 namespace VBus {
     uint8_t VBusPin = 0;
     uint16_t externalResistanceKiloOhms = 0;
 
+    uint32_t filteredMilliVolts = 0;
+    uint32_t referenceMilliVolts = 0;
+    unsigned long lastUpdateMillis = 0;
+    // On-time scale in 1/256ths by sag, 1 / (1 - sag) so the current ramp V * t stays the same
+    uint16_t compensationTable[(1 << compensationTableBits) + 1];
+
+    uint32_t toBusMilliVolts(uint16_t adcMilliVolts) {
+        // Multiply before dividing, 400k / 3k truncates to 133 otherwise. Hundreds of volts don't fit in uint16_t millivolts
+        return ((uint32_t)adcMilliVolts * externalResistanceKiloOhms) / vBusOpAmpResistanceKiloOhms;
+    }
+
     void begin(uint8_t newVBusPin, uint16_t newExternalResistanceKiloOhms) {
         VBusPin = newVBusPin;
         externalResistanceKiloOhms = newExternalResistanceKiloOhms;
+
+        for (uint8_t i = 0; i <= (1 << compensationTableBits); i++) {
+            float sag = (float)i / (1 << compensationTableBits) * maxSagPermille / 1000.0f;
+            compensationTable[i] = min((uint16_t)(256.0f / (1.0f - sag)), maxScale);
+        }
     }
 
     uint16_t readVBus() {
@@ -19,16 +45,50 @@ namespace VBus {
         return 0;
     }
     
-    uint32_t sum = 0;
-    
-    // Take readings and average them
-    for (int i = 0; i < multisampleCount; i++) {
-        sum += analogReadMilliVoltsFast(VBusPin);
-    }
-    
-    // Return the averaged result
-    uint16_t average = sum / multisampleCount;
-    uint16_t busVoltageMilivolts = average * (externalResistanceKiloOhms / vBusOpAmpResistanceKiloOhms);
-    return busVoltageMilivolts / 1000;
+    // Averaged from the background sampler's window, never waits on a conversion
+    uint16_t average = AdcEngine::averageMilliVolts(VBusPin, multisampleCount);
+    return (toBusMilliVolts(average) + 500) / 1000;
 }
+
+    void update() {
+        if (VBusPin == 0) {
+            return;
+        }
+
+        uint32_t busMilliVolts = toBusMilliVolts(AdcEngine::averageMilliVolts(VBusPin, filterSampleCount));
+        unsigned long now = millis();
+        uint32_t elapsed = now - lastUpdateMillis;
+        lastUpdateMillis = now;
+
+        // First burst after a rest, nothing has loaded the bus so this is the reference. Both start here rather than
+        // from before the rest, the variac may have been turned down meanwhile and that isn't sag to make up for
+        if (elapsed >= idleGapMillis || referenceMilliVolts == 0) {
+            filteredMilliVolts = busMilliVolts;
+            referenceMilliVolts = busMilliVolts;
+            return;
+        }
+
+        filteredMilliVolts += ((int32_t)busMilliVolts - (int32_t)filteredMilliVolts) >> filterShift;
+        // While bursting the reference only falls slowly, so a sagging bus is made up for and a turned down one soon isn't
+        elapsed = min(elapsed, referenceTimeConstantMillis);
+        if (filteredMilliVolts >= referenceMilliVolts) {
+            referenceMilliVolts = filteredMilliVolts;
+        } else {
+            referenceMilliVolts -= ((uint64_t)(referenceMilliVolts - filteredMilliVolts) * elapsed) / referenceTimeConstantMillis;
+        }
+    }
+
+    uint16_t getFilteredVBus() {
+        return (filteredMilliVolts + 500) / 1000;
+    }
+
+    uint16_t compensateBurstLength(uint16_t burstLength) {
+        if (referenceMilliVolts < minCompensationMilliVolts || filteredMilliVolts >= referenceMilliVolts) {
+            return burstLength;
+        }
+
+        uint32_t sagPermille = ((referenceMilliVolts - filteredMilliVolts) * 1000ULL) / referenceMilliVolts;
+        uint32_t index = min((sagPermille << compensationTableBits) / maxSagPermille, (uint32_t)(1 << compensationTableBits));
+        return ((uint32_t)burstLength * compensationTable[index]) >> 8;
+    }
 }
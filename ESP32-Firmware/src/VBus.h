@@ -10,6 +10,14 @@ namespace VBus {
     // Read the current transformer value (multisampled)
     uint16_t readVBus();
 
+    // Filtered bus voltage and its unsagged reference, updated by the burst task before each burst. After a rest
+    // between bursts both restart from the idle bus, so only sag under load is compensated
+    void update();
+    uint16_t getFilteredVBus();
+
+    // Stretches on-time as the bus sags below its reference so the primary current ramp stays the same
+    uint16_t compensateBurstLength(uint16_t burstLength);
+
     extern uint8_t VBusPin;
     extern uint16_t externalResistanceKiloOhms;
 };
@@ -0,0 +1,288 @@
+#ifdef WIFI_SSID
+#include <Arduino.h>
+#include "WifiControl.h"
+#include <WiFi.h>
+#include <WiFiUdp.h>
+#include <WebSocketsServer.h>
+#include "BleControl.h"
+#include "Presets.h"
+#include "Telemetry.h"
+#include "AudioStream.h"
+#include "AudioSink.h"
+#include "Sequence.h"
+
+namespace {
+	const uint8_t packetParameterBlock = 0x01;
+	const uint8_t packetGetState = 0x02;
+	const uint8_t packetSubscribe = 0x03;
+	const uint8_t packetPreset = 0x04;
+	const uint8_t packetAudio = 0x05;
+	const uint8_t packetAudioVoice = 0x06;
+	const uint8_t packetAudioFormat = 0x07;
+	const uint8_t packetSequence = 0x08;
+	const uint8_t packetState = 0x81;
+	const uint8_t packetReadings = 0x82;
+	const uint8_t packetSamples = 0x83;
+	const uint8_t packetSequenceStatus = 0x84;
+
+	const uint8_t streamReadingsMask = 0x80;
+	const uint8_t maxUdpSubscribers = 4;
+	const unsigned long subscriptionTimeoutMs = 10000; // Clients resubscribe to keep streams flowing
+	const size_t maxPacketSize = 1400; // Stays under the Ethernet MTU so datagrams aren't fragmented
+	const size_t samplesHeaderSize = 6;
+	const size_t sampleSize = 6;
+	const size_t readingsSize = 1 + 4 * sizeof(float);
+	const size_t maxReplySize = 1 + (sizeof(Sequence::Status) > BleControl::parameterBlockSize ? sizeof(Sequence::Status) : BleControl::parameterBlockSize);
+	const uint16_t webSocketPort = 81;
+	const unsigned long taskIntervalMs = 2;
+
+	struct UdpSubscriber {
+		IPAddress address;
+		uint16_t port;
+		uint8_t streams;
+		unsigned long lastSeenMillis;
+	};
+
+	WiFiUDP udp;
+	WebSocketsServer webSocket(webSocketPort);
+	UdpSubscriber udpSubscribers[maxUdpSubscribers] = {};
+	uint8_t webSocketStreams[WEBSOCKETS_SERVER_CLIENT_MAX] = {};
+	uint16_t sampleSequence[Telemetry::streamCount] = {};
+	TaskHandle_t wifiControlTaskHandle = NULL;
+
+	// Written by loop(), sent from the Wi-Fi task so the UDP socket is only touched from one task
+	portMUX_TYPE readingsMux = portMUX_INITIALIZER_UNLOCKED;
+	float readings[4] = {};
+	volatile bool readingsPending = false;
+
+	uint8_t packetBuffer[maxPacketSize];
+	AudioSink audioSink;
+
+	// Handles one request, returns the length of the reply written to reply (0 for none)
+	size_t handlePacket(const uint8_t* data, size_t length, uint8_t& streams, uint8_t* reply) {
+		if (length == 0) {
+			return 0;
+		}
+
+		uint8_t type = data[0];
+		if (type == packetParameterBlock) {
+			if (!BleControl::applyParameterBlock(&data[1], length - 1)) {
+				Serial.println("Parameter block rejected");
+			}
+		} else if (type == packetSubscribe) {
+			streams = length >= 2 ? data[1] : 0;
+			return 0;
+		} else if (type == packetPreset) {
+			Presets::handleCommand(&data[1], length - 1);
+		} else if (type == packetAudio) {
+			if (length >= 3) {
+				uint16_t sequence;
+				memcpy(&sequence, &data[1], sizeof(sequence));
+				AudioStream::countPacket(sequence);
+				audioSink.write(&data[3], length - 3);
+			}
+			return 0;
+		} else if (type == packetAudioFormat) {
+			if (length >= 6) {
+				uint32_t sampleRate;
+				memcpy(&sampleRate, &data[1], sizeof(sampleRate));
+				audioSink.set_sample_rate(sampleRate);
+				audioSink.set_channels(data[5]);
+				audioSink.begin();
+			}
+			return 0;
+		} else if (type == packetAudioVoice) {
+			if (length >= 2) {
+				AudioStream::setVoice((AudioStream::Voice)data[1]);
+			}
+			return 0;
+		} else if (type == packetSequence) {
+			// Answered so the uploader can tell a lost chunk from a slow one
+			Sequence::handleCommand(&data[1], length - 1);
+			Sequence::Status status = Sequence::getStatus();
+			reply[0] = packetSequenceStatus;
+			memcpy(&reply[1], &status, sizeof(status));
+			return 1 + sizeof(status);
+		} else if (type != packetGetState) {
+			return 0;
+		}
+
+		// Anything that touches the parameters is answered with the resulting state
+		reply[0] = packetState;
+		BleControl::encodeParameterBlock(BleControl::getState(), &reply[1]);
+		return 1 + BleControl::parameterBlockSize;
+	}
+
+	void updateEnabledStreams() {
+		unsigned long now = millis();
+		uint8_t mask = 0;
+		for (uint8_t i = 0; i < maxUdpSubscribers; i++) {
+			UdpSubscriber& subscriber = udpSubscribers[i];
+			if (subscriber.streams != 0 && now - subscriber.lastSeenMillis > subscriptionTimeoutMs) {
+				subscriber.streams = 0;
+			}
+			mask |= subscriber.streams;
+		}
+		for (uint8_t i = 0; i < WEBSOCKETS_SERVER_CLIENT_MAX; i++) {
+			mask |= webSocketStreams[i];
+		}
+		Telemetry::setEnabledStreams(mask & ((1 << Telemetry::streamCount) - 1));
+	}
+
+	void subscribeUdp(IPAddress address, uint16_t port, uint8_t streams) {
+		UdpSubscriber* slot = nullptr;
+		for (uint8_t i = 0; i < maxUdpSubscribers; i++) {
+			UdpSubscriber& subscriber = udpSubscribers[i];
+			if (subscriber.streams != 0 && subscriber.address == address && subscriber.port == port) {
+				slot = &subscriber;
+				break;
+			}
+			if (slot == nullptr && subscriber.streams == 0) {
+				slot = &subscriber;
+			}
+		}
+
+		if (slot == nullptr) {
+			return;
+		}
+		slot->address = address;
+		slot->port = port;
+		slot->streams = streams;
+		slot->lastSeenMillis = millis();
+	}
+
+	void receiveUdp() {
+		uint8_t reply[maxReplySize];
+		int packetSize;
+		while ((packetSize = udp.parsePacket()) > 0) {
+			size_t length = udp.read(packetBuffer, sizeof(packetBuffer));
+			uint8_t streams = 0;
+			size_t replyLength = handlePacket(packetBuffer, length, streams, reply);
+			if (length >= 1 && packetBuffer[0] == packetSubscribe) {
+				subscribeUdp(udp.remoteIP(), udp.remotePort(), streams);
+			}
+			if (replyLength > 0) {
+				udp.beginPacket(udp.remoteIP(), udp.remotePort());
+				udp.write(reply, replyLength);
+				udp.endPacket();
+			}
+		}
+	}
+
+	void onWebSocketEvent(uint8_t num, WStype_t type, uint8_t* payload, size_t length) {
+		if (num >= WEBSOCKETS_SERVER_CLIENT_MAX) {
+			return;
+		}
+
+		if (type == WStype_DISCONNECTED) {
+			webSocketStreams[num] = 0;
+		} else if (type == WStype_BIN) {
+			uint8_t reply[maxReplySize];
+			uint8_t streams = webSocketStreams[num];
+			size_t replyLength = handlePacket(payload, length, streams, reply);
+			webSocketStreams[num] = streams;
+			if (replyLength > 0) {
+				webSocket.sendBIN(num, reply, replyLength);
+			}
+		}
+	}
+
+	void send(uint8_t streamMask, const uint8_t* data, size_t length) {
+		for (uint8_t i = 0; i < maxUdpSubscribers; i++) {
+			UdpSubscriber& subscriber = udpSubscribers[i];
+			if (subscriber.streams & streamMask) {
+				udp.beginPacket(subscriber.address, subscriber.port);
+				udp.write(data, length);
+				udp.endPacket();
+			}
+		}
+		for (uint8_t i = 0; i < WEBSOCKETS_SERVER_CLIENT_MAX; i++) {
+			if (webSocketStreams[i] & streamMask) {
+				webSocket.sendBIN(i, data, length);
+			}
+		}
+	}
+
+	void sendSamples() {
+		for (uint8_t stream = 0; stream < Telemetry::streamCount; stream++) {
+			Telemetry::Sample sample;
+			size_t length = samplesHeaderSize;
+			uint16_t count = 0;
+			while (Telemetry::pop(stream, sample)) {
+				memcpy(&packetBuffer[length], &sample.timestampMicros, sizeof(uint32_t));
+				memcpy(&packetBuffer[length + 4], &sample.value, sizeof(uint16_t));
+				length += sampleSize;
+				count++;
+
+				if (length + sampleSize > maxPacketSize) {
+					break;
+				}
+			}
+
+			if (count == 0) {
+				continue;
+			}
+			packetBuffer[0] = packetSamples;
+			packetBuffer[1] = stream;
+			memcpy(&packetBuffer[2], &sampleSequence[stream], sizeof(uint16_t));
+			memcpy(&packetBuffer[4], &count, sizeof(uint16_t));
+			sampleSequence[stream]++;
+			send(1 << stream, packetBuffer, length);
+		}
+	}
+
+	void sendReadings() {
+		if (!readingsPending) {
+			return;
+		}
+
+		uint8_t packet[readingsSize];
+		packet[0] = packetReadings;
+		portENTER_CRITICAL(&readingsMux);
+		memcpy(&packet[1], readings, sizeof(readings));
+		readingsPending = false;
+		portEXIT_CRITICAL(&readingsMux);
+		send(streamReadingsMask, packet, sizeof(packet));
+	}
+
+	void wifiControlTask(void* arg) {
+		while (true) {
+			webSocket.loop();
+			receiveUdp();
+			updateEnabledStreams();
+			sendSamples();
+			sendReadings();
+			delay(taskIntervalMs);
+		}
+	}
+}
+
+namespace WifiControl {
+	void begin(uint16_t udpPort) {
+		if (WiFi.status() != WL_CONNECTED) {
+			Serial.println("WiFi not connected. WifiControl disabled.");
+			return;
+		}
+
+		udp.begin(udpPort);
+		webSocket.begin();
+		webSocket.onEvent(onWebSocketEvent);
+		xTaskCreatePinnedToCore(wifiControlTask, "wifiControlTask", 4096, NULL, 1, &wifiControlTaskHandle, 0);
+
+		Serial.print("WifiControl UDP port ");
+		Serial.print(udpPort);
+		Serial.print(", WebSocket port ");
+		Serial.println(webSocketPort);
+	}
+
+	void notifyReadings(float vbus, float currentTransformer, float therm1, float therm2) {
+		portENTER_CRITICAL(&readingsMux);
+		readings[0] = vbus;
+		readings[1] = currentTransformer;
+		readings[2] = therm1;
+		readings[3] = therm2;
+		readingsPending = true;
+		portEXIT_CRITICAL(&readingsMux);
+	}
+}
+#endif
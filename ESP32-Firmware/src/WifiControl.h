@@ -0,0 +1,22 @@
+#pragma once
+
+#include <Arduino.h>
+
+// Optional Wi-Fi transport, only built when WIFI_SSID is defined (see the wifi environment in platformio.ini).
+// Speaks the same packets over UDP and over a WebSocket for browsers:
+//   0x01 parameter block      -> BleControl::applyParameterBlock, answered with 0x81
+//   0x02 get state            -> answered with 0x81 (current parameter block)
+//   0x03 subscribe, u8 mask   -> streams sent back to the sender, bit 0 CT peaks, bit 1 ZCD,
+//                                bit 2 CT samples, bit 7 readings
+//   0x04 preset command       -> Presets::handleCommand
+//   0x05 audio, u16 sequence  -> AudioSink, then interleaved 16 bit PCM in the format set by 0x07
+//   0x06 audio voice, u8      -> AudioStream::setVoice, 0 pulses, 1 pitch
+//   0x07 audio format         -> u32 sample rate, u8 channels, 8000 Hz mono until set
+//   0x08 sequence command     -> Sequence::handleCommand, answered with 0x84
+//   0x82 readings             <- f32 vbus, ct, therm1, therm2
+//   0x83 samples              <- u8 stream, u16 sequence, u16 count, then count x (u32 timestamp us, u16 value)
+//   0x84 sequence status      <- Sequence::Status
+namespace WifiControl {
+	void begin(uint16_t udpPort);
+	void notifyReadings(float vbus, float currentTransformer, float therm1, float therm2);
+}
@@ -2,6 +2,11 @@
 #include "GateDrive.h"
 #include "BleControl.h"
 #include "DelayNanoseconds.h"
+#include "Telemetry.h"
+#include "OCD.h"
+#include "Scope.h"
+#include "Trace.h"
+#include "Metrics.h"
 
 // Constants
 const uint32_t cpuFrequencyMHz = getCpuFrequencyMhz();
@@ -13,6 +18,10 @@ uint8_t ZCD::_gd1aPin = 0;
 uint8_t ZCD::_gd1bPin = 0;
 bool ZCD::_enabled = false;
 bool ZCD::_disableOnInterrupt = false;
+uint16_t ZCD::_edgeCount = 0;
+uint32_t ZCD::_lastToggleCycles = 0;
+uint32_t ZCD::_enableCycles = 0;
+uint32_t ZCD::_maxCycles = 0;
 //volatile bool ZCD::_interruptOccurred = false;
 
 void ZCD::begin(uint8_t interruptPin, uint8_t gd1aPin, uint8_t gd1bPin) {
@@ -38,8 +47,12 @@ void IRAM_ATTR ZCD::disableInterrupt() {
     detachInterrupt(digitalPinToInterrupt(_interruptPin));
 }
 
-void IRAM_ATTR ZCD::enable(bool enableGD1) {
+void IRAM_ATTR ZCD::enable(bool enableGD1, uint16_t maxMicros) {
     if (_interruptPin != 0) {
+        // Toggles are timed from here, the gates were just switched on
+        _enableCycles = ESP.getCycleCount();
+        _lastToggleCycles = _enableCycles;
+        _maxCycles = maxMicros * cpuFrequencyMHz;
         _enabled = true;
         if (enableGD1) {
             GateDrive::enableGD1();
@@ -50,6 +63,7 @@ void IRAM_ATTR ZCD::enable(bool enableGD1) {
 void IRAM_ATTR ZCD::disable(bool disableGD1) {
     if (_interruptPin != 0) {
         _enabled = false;
+        _disableOnInterrupt = false;
         if (disableGD1) {
             GateDrive::disableGD1();
         }
@@ -69,6 +83,12 @@ void IRAM_ATTR ZCD::interruptHandler() {
     if (!_enabled) {
         return;
     }
+    // Over current stops the burst at this edge, the gates are already off
+    if (OCD::checkFast()) {
+        recordEdge(ESP.getCycleCount(), false);
+        return;
+    }
+
     // Phase lead
     BleControl::ControlState controlState = BleControl::getState();
     uint16_t phaseLead = constrain(controlState.phaseLead, 0, 1250);
@@ -84,9 +104,12 @@ void IRAM_ATTR ZCD::interruptHandler() {
     //     }
     // }
 
-    if (_disableOnInterrupt) {
+    // With the phase lead near a half cycle this ISR can take all of its core, the burst task never gets to ask
+    // for the stop. Going by the last toggle's time keeps cycle counter reads off the path to this toggle
+    if (_disableOnInterrupt || (_maxCycles != 0 && _lastToggleCycles - _enableCycles >= _maxCycles)) {
         _disableOnInterrupt = false;
         disable();
+        recordEdge(ESP.getCycleCount(), false);
         return;
     }
 
@@ -94,6 +117,22 @@ void IRAM_ATTR ZCD::interruptHandler() {
     // digitalWrite(_gd1aPin, !digitalRead(_gd1aPin));
     // digitalWrite(_gd1bPin, !digitalRead(_gd1bPin));
     GateDrive::toggleGD1();
+    // Read after the toggle so measuring never delays it
+    uint32_t toggleCycles = ESP.getCycleCount();
+    Metrics::recordZcdEdge(toggleCycles - _lastToggleCycles);
+    _lastToggleCycles = toggleCycles;
+    recordEdge(toggleCycles, true);
 
     //_interruptOccurred = true;
 }
+
+// Only once the edge has been acted on, so the gates never wait on it
+void IRAM_ATTR ZCD::recordEdge(uint32_t cycles, bool toggled) {
+    _edgeCount++;
+    Telemetry::push(Telemetry::streamZcd, _edgeCount);
+    Trace::recordAt(Trace::zcdEdge, cycles, _edgeCount);
+    if (toggled) {
+        Trace::recordAt(Trace::gateToggle, cycles, GateDrive::GD1APinEnabled);
+    }
+    Scope::recordEdge(cycles);
+}
@@ -8,8 +8,9 @@ public:
     // Initialize the ZCD system
     static void begin(uint8_t interruptPin, uint8_t gd1aPin, uint8_t gd1bPin);
     
-    // Enable/disable the interrupt
-    static IRAM_ATTR void enable(bool enableGD1 = true);
+    // Enable/disable the interrupt. With maxMicros the ISR stops toggling that long after enabling by itself, for when
+    // it keeps the caller from getting to disable it in time. 0 for no limit
+    static IRAM_ATTR void enable(bool enableGD1 = true, uint16_t maxMicros = 0);
     static IRAM_ATTR void disable(bool disableGD1 = true);
     static IRAM_ATTR void disableOnInterrupt();
     static IRAM_ATTR void enableInterrupt();
@@ -21,6 +22,7 @@ public:
 private:
     // Interrupt service routine
     static void IRAM_ATTR interruptHandler();
+    static void IRAM_ATTR recordEdge(uint32_t cycles, bool toggled);
     
     // Pin assignments
     static uint8_t _interruptPin;
@@ -31,6 +33,10 @@ private:
     static bool _enabled;
     static volatile bool _interruptOccurred;
     static bool _disableOnInterrupt;
+    static uint16_t _edgeCount;
+    static uint32_t _lastToggleCycles;
+    static uint32_t _enableCycles;
+    static uint32_t _maxCycles;
 };
 
 #endif // ZCD_H
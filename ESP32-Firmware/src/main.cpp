@@ -1,10 +1,12 @@
 // Inclues
 #include <Arduino.h>
-//#include "WifiOta.h"
+#include "WifiOta.h"
+#include "WifiControl.h"
 #include "BleControl.h"
 #include "MidiControl.h"
 #include "ZCD.h"
 #include "FastAnalogRead.h"
+#include "AdcEngine.h"
 #include "CurrentTransformer.h"
 #include "GateDrive.h"
 #include "FrequencySweep.h"
@@ -12,6 +14,15 @@
 #include "Burst.h"
 #include "VBus.h"
 #include "OCD.h"
+#include "Presets.h"
+#include "Thermal.h"
+#include "Scope.h"
+#include "SerialCommands.h"
+#include "AutoTune.h"
+#include "AudioStream.h"
+#include "Sequence.h"
+#include "Metrics.h"
+#include "Telemetry.h"
 
 // Constants
 const uint16_t startFrequency = 400; // In KHz
@@ -20,6 +31,8 @@ const uint16_t externalResistanceKiloOhms = 400;
 const uint16_t ocdCurrent = 400;
 const uint16_t ctTurnsRatio = 512;
 const uint32_t ctBurdenMiliohms = 3300;
+const uint16_t wifiControlPort = 4210;
+const uint32_t adcSampleRateHz = 80000; // Shared round robin by the analog pins, 20kHz each
 
 // Pins
 // const uint8_t CurrentTransformerPin = 2;
@@ -35,6 +48,8 @@ const uint8_t GD2APin = 15;
 const uint8_t GD2BPin = 16;
 const uint8_t ZCDInterruptPin = 21;
 const uint8_t CTPeakResetPin = 45;
+// Without the comparator over current is caught a DMA frame (100us) late or after the burst, not within a half cycle
+const uint8_t OCDInterruptPin = 0; // OCD comparator output, 0 when not fitted. REV 2 routes it to IO21, which the ZCD uses
 
 // Analog Pins
 const uint8_t CTPeakPin = 9;
@@ -57,24 +72,51 @@ void setup() {
 	Serial.println("Starting up...");
 
 	// Initialize the FastADC library
-    fadcInit(2, CTPeakPin, VbusPin);
-	//WifiOta::begin(WIFI_SSID, WIFI_PASSWORD, "tesla-coil");
+    fadcInit(4, CTPeakPin, VbusPin, Therm1Pin, Therm2Pin);
+	// Then hand ADC1 to the continuous DMA sampler
+	const uint8_t analogPins[] = { CTPeakPin, VbusPin, Therm1Pin, Therm2Pin };
+	const uint8_t analogAttenuations[] = { ADC_11db, ADC_11db, ADC_11db, ADC_11db }; // All of them swing up to about 3V
+	if (!AdcEngine::begin(adcSampleRateHz, sizeof(analogPins), analogPins, analogAttenuations)) {
+		Serial.println("AdcEngine failed to start");
+	}
+	AdcEngine::streamTelemetry(CTPeakPin, Telemetry::streamCtSamples);
+#ifdef WIFI_SSID
+	WifiOta::begin(WIFI_SSID, WIFI_PASSWORD, "tesla-coil");
+	WifiControl::begin(wifiControlPort);
+#endif
 
 	GateDrive::begin(GD1APin, GD1BPin, GD2APin, GD2BPin);
 	BleControl::begin("TeslaCoil");
+	Presets::begin();
 	MidiControl::begin();
 	ZCD::begin(ZCDInterruptPin, GD1APin, GD1BPin);
 	CurrentTransformer::begin(CTPeakPin, CTPeakResetPin);
 	FrequencySweep::begin(GD1APin, GD1BPin);
 	Relay::begin(PrimaryRelayPin, BypassRelayPin);
 	VBus::begin(VbusPin, externalResistanceKiloOhms);
-	OCD::begin(ocdCurrent, ctTurnsRatio, ctBurdenMiliohms);
+	OCD::begin(ocdCurrent, ctTurnsRatio, ctBurdenMiliohms, OCDInterruptPin, CTPeakPin);
+	Thermal::begin(Therm1Pin, Therm2Pin);
+	AutoTune::begin();
+	AudioStream::begin();
+	Sequence::begin();
+	if (!Scope::begin(CTPeakPin)) {
+		Serial.println("Scope buffer allocation failed");
+	}
 }
 
 void loop() {
-  	//WifiOta::handle();
+#ifdef WIFI_SSID
+	WifiOta::handle();
+#endif
 	FrequencySweep::handle();
+	AutoTune::handle();
+	AudioStream::handle();
+	Sequence::handle();
 	Burst::handle();
+	BleControl::handle();
+	Thermal::handle();
+	SerialCommands::handle();
+	Metrics::handle();
 
 	BleControl::ControlState controlState = BleControl::getState();
 	(void)controlState;
@@ -85,7 +127,12 @@ void loop() {
 	// float t2 = analogRead(Therm2Pin);
 	//float cpuFrequency = getCpuFrequencyMhz();
 	uint16_t vBusVoltage = VBus::readVBus();
-	BleControl::notifyReadings(vBusVoltage, test, 0, 0);
+	float therm1 = Thermal::getTemperature(0);
+	float therm2 = Thermal::getTemperature(1);
+	BleControl::notifyReadings(vBusVoltage, test, therm1, therm2);
+#ifdef WIFI_SSID
+	WifiControl::notifyReadings(vBusVoltage, test, therm1, therm2);
+#endif
 	Relay::setEnabled(controlState.enabled);
 	// Serial.print("Enabled: ");
 	// Serial.print(s.enabled);
@@ -0,0 +1,246 @@
+#!/usr/bin/env python3
+"""Audio mode host side: stream a WAV file to the coil, or render it into the pulse train the coil would play.
+
+Stream over the WifiControl UDP transport (packet 0x05, see src/AudioStream.h):
+    audio_stream.py --host 192.168.86.56 stream song.wav
+    audio_stream.py --host 192.168.86.56 stream song.wav --native   # as recorded, src/AudioSink.cpp converts it
+
+Render offline through lib/PulseModulator itself, writing the pulse train back out as a WAV:
+    audio_stream.py render song.wav pulses.wav --burst-length 20 --max-duty 150
+
+Check the pitch voice's tracker (lib/PitchTracker) against known tones, synthetic or a WAV of one steady note:
+    audio_stream.py pitch
+    audio_stream.py pitch --expect 220 cello_a3.wav
+Both run the native build (sim/), pio run -e native first. pitch reports the host's time per frame, cycles per frame
+on the coil come from the audio serial command.
+"""
+
+import argparse
+import array
+import math
+import os
+import socket
+import struct
+import subprocess
+import sys
+import time
+import wave
+
+DEFAULT_PORT = 4210
+PACKET_AUDIO = 0x05
+PACKET_AUDIO_VOICE = 0x06
+PACKET_AUDIO_FORMAT = 0x07
+VOICES = {'pulses': 0, 'pitch': 1}
+
+# Matches src/AudioStream.cpp
+SAMPLE_RATE_HZ = 8000
+RING_CAPACITY = 4096
+PREFETCH_SAMPLES = RING_CAPACITY * 25 // 100
+MAX_PULSE_RATE_HZ = 4000
+NOISE_GATE = 600
+VOICE_ON_RMS = 1000
+SAMPLES_PER_PACKET = 256  # 32ms of audio, well under the 1400 byte packet limit
+DEFAULT_PROGRAM = os.path.join(os.path.dirname(os.path.abspath(__file__)), '..', '.pio', 'build', 'native', 'program')
+
+
+def load_raw_wav(path):
+    """Interleaved 16 bit samples as recorded, with the rate and channel count."""
+    with wave.open(path, 'rb') as wav:
+        channels = wav.getnchannels()
+        width = wav.getsampwidth()
+        rate = wav.getframerate()
+        frames = wav.readframes(wav.getnframes())
+    if width != 2:
+        sys.exit(f'{path}: only 16 bit PCM is supported, got {8 * width} bit')
+
+    samples = array.array('h', frames)
+    if sys.byteorder == 'big':
+        samples.byteswap()
+    return samples, rate, channels
+
+
+def load_wav(path):
+    """16 bit mono at SAMPLE_RATE_HZ, mixing down and resampling linearly as needed."""
+    samples, rate, channels = load_raw_wav(path)
+    if channels > 1:
+        samples = array.array('h', (sum(samples[i:i + channels]) // channels for i in range(0, len(samples), channels)))
+    if rate == SAMPLE_RATE_HZ:
+        return samples
+
+    out = array.array('h')
+    step = rate / SAMPLE_RATE_HZ
+    position = 0.0
+    while position < len(samples) - 1:
+        index = int(position)
+        fraction = position - index
+        out.append(int(samples[index] * (1 - fraction) + samples[index + 1] * fraction))
+        position += step
+    return out
+
+
+def run_program(program, args, samples):
+    """Runs the native build (sim/) on 8 kHz mono samples, returns its output lines."""
+    if not os.path.exists(program):
+        sys.exit(f'{program} not found, build it with pio run -e native')
+    data = array.array('h', samples)
+    if sys.byteorder == 'big':
+        data.byteswap()
+    result = subprocess.run([program] + args, input=data.tobytes(), stdout=subprocess.PIPE, check=True)
+    return result.stdout.decode().splitlines()
+
+
+def track(program, samples):
+    """Pitch per hop from lib/PitchTracker, like the firmware's pitch task, only over frames loud enough to sound.
+    Also the host's nanoseconds per frame."""
+    frames, nanos = [], 0
+    for line in run_program(program, ['track'], samples):
+        fields = line.split(',')
+        if fields[0] == 'frame' and int(fields[2]) >= VOICE_ON_RMS:
+            frames.append(float(fields[1]))
+        elif fields[0] == 'track':
+            nanos = int(fields[2])
+    return frames, nanos
+
+
+def synthetic_tone(frequency, seconds=0.25):
+    """Sawtooth-ish tone, a fundamental with falling harmonics, well inside full scale."""
+    samples = array.array('h')
+    for i in range(int(seconds * SAMPLE_RATE_HZ)):
+        phase = 2 * math.pi * frequency * i / SAMPLE_RATE_HZ
+        value = sum(math.sin(k * phase) / k for k in range(1, 6) if k * frequency < SAMPLE_RATE_HZ / 2)
+        samples.append(int(9000 * value))
+    return samples
+
+
+def cmd_pitch(args):
+    if args.input:
+        if args.expect is None:
+            sys.exit('--expect is needed with a WAV, the frequency of its note in Hz')
+        cases = [(args.expect, load_wav(args.input))]
+    else:
+        # A1 to A5 in semitones, the range a coil plays well
+        cases = [(110 * 2 ** (n / 12), None) for n in range(-12, 37)]
+
+    print('expected Hz, voiced %, mean cents, max cents')
+    all_errors = []
+    total_frames = 0
+    voiced_frames = 0
+    total_nanos = 0
+    for expected, samples in cases:
+        frames, nanos = track(args.program, samples if samples is not None else synthetic_tone(expected))
+        total_nanos += nanos * len(frames)
+        errors = [abs(1200 * math.log2(f / expected)) for f in frames if f > 0]
+        total_frames += len(frames)
+        voiced_frames += len(errors)
+        all_errors += errors
+        voiced = 100 * len(errors) / max(len(frames), 1)
+        mean = sum(errors) / len(errors) if errors else float('nan')
+        worst = max(errors) if errors else float('nan')
+        print(f'{expected:8.1f}, {voiced:5.1f}, {mean:6.1f}, {worst:6.1f}')
+
+    if all_errors:
+        within = 100 * sum(e < 50 for e in all_errors) / len(all_errors)
+        print(f'overall: {100 * voiced_frames / max(total_frames, 1):.1f}% voiced, mean {sum(all_errors) / len(all_errors):.1f} cents, '
+              f'max {max(all_errors):.1f} cents, {within:.1f}% within a quarter tone')
+    if total_frames:
+        print(f'{total_nanos / total_frames / 1000:.1f}us per frame on the host')
+
+
+def cmd_render(args):
+    samples = load_wav(args.input)
+    burst_length = max(10, min(args.burst_length, 100))
+    max_rate = min((1000000 // burst_length) * args.max_duty // 1000, MAX_PULSE_RATE_HZ)
+    lines = run_program(args.program, ['render', str(max_rate)], samples)
+
+    # Each pulse as a full scale click, burst length rounded to whole samples
+    click = max(1, round(burst_length * SAMPLE_RATE_HZ / 1e6))
+    out = array.array('h', bytes(2 * len(samples)))
+    pulses = 0
+    for line in lines:
+        fields = line.split(',')
+        if fields[0] == 'pulse':
+            i = int(fields[1])
+            pulses += 1
+            for j in range(i, min(i + click, len(out))):
+                out[j] = 32767
+    if sys.byteorder == 'big':
+        out.byteswap()
+
+    with wave.open(args.output, 'wb') as wav:
+        wav.setnchannels(1)
+        wav.setsampwidth(2)
+        wav.setframerate(SAMPLE_RATE_HZ)
+        wav.writeframes(out.tobytes())
+
+    seconds = len(samples) / SAMPLE_RATE_HZ
+    on_time = pulses * burst_length / 1e6
+    print(f'{seconds:.1f}s, {pulses} pulses, {pulses / max(seconds, 1e-9):.0f} pulses/s average, '
+          f'max {max_rate} pulses/s, duty {1000 * on_time / max(seconds, 1e-9):.1f} permille')
+
+
+def cmd_stream(args):
+    if args.native:
+        samples, rate, channels = load_raw_wav(args.input)
+    else:
+        samples, rate, channels = load_wav(args.input), SAMPLE_RATE_HZ, 1
+    address = (args.host, args.port)
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    sock.sendto(bytes([PACKET_AUDIO_VOICE, VOICES[args.voice]]), address)
+    sock.sendto(struct.pack('<BIB', PACKET_AUDIO_FORMAT, rate, channels), address)
+
+    # Whole frames per packet, the same 32ms as at 8 kHz mono where that fits in a packet
+    frames_per_packet = min(SAMPLES_PER_PACKET * rate // SAMPLE_RATE_HZ, 680 // channels)
+    values_per_packet = frames_per_packet * channels
+    period = frames_per_packet / rate
+
+    # Send the prefetch up front, then pace at real time so the ring stays about that full
+    lead = PREFETCH_SAMPLES / SAMPLE_RATE_HZ
+    start = time.monotonic()
+    sequence = 0
+    for offset in range(0, len(samples), values_per_packet):
+        due = start + offset / channels / rate - lead
+        delay = due - time.monotonic()
+        if delay > 0:
+            time.sleep(delay)
+        chunk = samples[offset:offset + values_per_packet]
+        if sys.byteorder == 'big':
+            chunk.byteswap()
+        sock.sendto(struct.pack('<BH', PACKET_AUDIO, sequence) + chunk.tobytes(), address)
+        sequence = (sequence + 1) & 0xFFFF
+    print(f'sent {sequence} packets, {len(samples) / channels / rate:.1f}s of audio in {time.monotonic() - start:.1f}s '
+          f'({period * 1000:.0f}ms per packet, {rate} Hz x {channels})')
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument('--host', default='127.0.0.1')
+    parser.add_argument('--port', type=int, default=DEFAULT_PORT)
+    commands = parser.add_subparsers(dest='command', required=True)
+
+    stream = commands.add_parser('stream', help='stream a WAV file to the coil')
+    stream.add_argument('input')
+    stream.add_argument('--voice', choices=VOICES, default='pulses',
+                        help='pulses plays the waveform, pitch plays its pitch as a note (needs bursts enabled)')
+    stream.add_argument('--native', action='store_true', help='send the WAV as recorded and let the coil convert it')
+    stream.set_defaults(func=cmd_stream)
+
+    render = commands.add_parser('render', help='render a WAV file into the pulse train, as a WAV')
+    render.add_argument('input')
+    render.add_argument('output')
+    render.add_argument('--burst-length', type=int, default=20, help='microseconds, 10 to 100 like the firmware')
+    render.add_argument('--max-duty', type=int, default=150, help='permille, Thermal::getMaxDutyPermille when cool')
+    render.add_argument('--program', default=DEFAULT_PROGRAM, help='the native build')
+    render.set_defaults(func=cmd_render)
+
+    pitch = commands.add_parser('pitch', help='check the pitch tracker against known tones')
+    pitch.add_argument('input', nargs='?', help='WAV of one steady note, synthetic tones when left out')
+    pitch.add_argument('--expect', type=float, help='frequency of the note in the WAV, Hz')
+    pitch.add_argument('--program', default=DEFAULT_PROGRAM, help='the native build')
+    pitch.set_defaults(func=cmd_pitch)
+
+    args = parser.parse_args()
+    args.func(args)
+
+
+if __name__ == '__main__':
+    main()
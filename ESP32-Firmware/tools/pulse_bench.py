@@ -0,0 +1,365 @@
+#!/usr/bin/env python3
+"""How in tune the coil plays: per-note pitch error, jitter, missed pulses and CPU load from src/PulseBench.h's log.
+
+On the host, songs go through the native build (sim/) against the simulated coil:
+    pulse_bench.py corpus songs                         # write the test songs
+    pulse_bench.py sim --corpus songs -o results.csv    # after pio run -e native
+On the coil, record over USB serial while the app plays a song:
+    pulse_bench.py serial --port /dev/ttyACM0 --song chords --seconds 30 -o coil.csv
+Then compare two runs, exiting 1 on a regression:
+    pulse_bench.py compare baseline.csv results.csv
+
+Each note runs from MidiControl starting it to the next note or rest, its pulses are timed against each other and
+its latency is how long the first one took to fire. A missed pulse is an interval well over the note's median, so
+rounding to the scheduler's grid shows up as cents rather than as drops. Logs without note lines (an older build,
+or bps set by hand) fall back to runs of the same bps.
+"""
+
+import argparse
+import csv
+import math
+import os
+import statistics
+import struct
+import subprocess
+import sys
+import tempfile
+import time
+
+NOTE_NAMES = ['C', 'C#', 'D', 'D#', 'E', 'F', 'F#', 'G', 'G#', 'A', 'A#', 'B']
+COLUMNS = ['song', 'note', 'name', 'target_hz', 'played_hz', 'cents', 'jitter_us', 'latency_us', 'pulses', 'dropped',
+           'cpu_load_pct']
+DEFAULT_PROGRAM = os.path.join(os.path.dirname(os.path.abspath(__file__)), '..', '.pio', 'build', 'native', 'program')
+REST_BPS = 1  # MidiControl::stopNote leaves the burst task at 1 bps
+
+# Test songs as (start ms, length ms, notes), covering the range, fast repeats and chord swapping
+TICKS_PER_BEAT = 480
+MICROS_PER_BEAT = 500000
+
+
+def chromatic():
+    return [(i * 500, 400, [note]) for i, note in enumerate(range(33, 94))]
+
+
+def scales():
+    major = [0, 2, 4, 5, 7, 9, 11]
+    up = [48 + octave * 12 + step for octave in range(3) for step in major] + [84]
+    return [(i * 250, 230, [note]) for i, note in enumerate(up + up[-2::-1])]
+
+
+def chords():
+    triads = [[60, 64, 67], [65, 69, 72], [67, 71, 74], [60, 64, 67], [48, 52, 55], [53, 57, 60]]
+    return [(i * 1600, 1500, triad) for i, triad in enumerate(triads)]
+
+
+def staccato():
+    return [(i * 125, 80, [69 if i < 32 else 76]) for i in range(64)]
+
+
+def melody():
+    # Ode to Joy, crotchet at 400ms
+    tune = [64, 64, 65, 67, 67, 65, 64, 62, 60, 60, 62, 64, 64, 62, 62]
+    lengths = [1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1.5, 0.5, 2]
+    events, start = [], 0
+    for note, beats in zip(tune, lengths):
+        events.append((start, beats * 400 - 30, [note]))
+        start += beats * 400
+    return events
+
+
+CORPUS = {'chromatic': chromatic, 'scales': scales, 'chords': chords, 'staccato': staccato, 'melody': melody}
+
+
+def variable_length(value):
+    data = [value & 0x7F]
+    value >>= 7
+    while value:
+        data.insert(0, (value & 0x7F) | 0x80)
+        value >>= 7
+    return bytes(data)
+
+
+def encode_song(events):
+    """Format 0, MidiControl only plays the first track."""
+    ticks = lambda ms: round(ms * 1000 * TICKS_PER_BEAT / MICROS_PER_BEAT)
+    messages = []
+    for start, length, notes in events:
+        for note in notes:
+            messages.append((ticks(start), 1, bytes([0x90, note, 100])))
+            messages.append((ticks(start + length), 0, bytes([0x80, note, 0])))
+    # Note offs first on a shared tick, so a repeated note isn't cut off by its own release
+    messages.sort(key=lambda message: (message[0], message[1]))
+    track, last = bytearray(b'\x00\xff\x51\x03' + MICROS_PER_BEAT.to_bytes(3, 'big')), 0
+    for tick, _, message in messages:
+        track += variable_length(tick - last) + message
+        last = tick
+    track += b'\x00\xff\x2f\x00'
+    return b'MThd' + struct.pack('>IHHH', 6, 0, 1, TICKS_PER_BEAT) + b'MTrk' + struct.pack('>I', len(track)) + track
+
+
+def write_corpus(directory):
+    os.makedirs(directory, exist_ok=True)
+    paths = []
+    for name, song in CORPUS.items():
+        path = os.path.join(directory, name + '.mid')
+        with open(path, 'wb') as file:
+            file.write(encode_song(song()))
+        paths.append(path)
+    return paths
+
+
+def parse_log(lines, song=None):
+    """Splits a PulseBench log into {song: {'mhz', 'events', 'elapsed_ms', 'lost'}}, events in log order as
+    ('note', cycles, note, octave, bps) and ('pulse', cycles, busy, bps)."""
+    runs = {}
+    run = None
+    for line in lines:
+        fields = line.strip().split(',')
+        if fields[0] == 'song' and len(fields) > 1:
+            song = os.path.splitext(os.path.basename(fields[1]))[0]
+        elif fields[0] == 'bench' and len(fields) > 2 and fields[1] == 'start':
+            run = runs.setdefault(song or 'song', {'mhz': int(fields[2]), 'events': [], 'elapsed_ms': 0, 'lost': 0})
+        elif fields[0] == 'bench' and len(fields) > 4 and fields[1] == 'stop' and run is not None:
+            run['lost'], run['elapsed_ms'] = int(fields[3]), int(fields[4])
+            run = None
+        elif fields[0] == 'pulse' and len(fields) == 4 and run is not None:
+            run['events'].append(('pulse',) + tuple(int(field) for field in fields[1:]))
+        elif fields[0] == 'note' and len(fields) == 5 and run is not None:
+            run['events'].append(('note',) + tuple(int(field) for field in fields[1:]))
+    return runs
+
+
+def unwrap(events, cycles_per_second):
+    """Seconds since the first event, sorted. The cycle counter wraps every few seconds and notes can be logged
+    ahead of pulses that fired before them, so each line is placed by its signed distance from the one before."""
+    timed, elapsed, last = [], 0, None
+    for event in events:
+        if last is not None:
+            delta = (event[1] - last) & 0xFFFFFFFF
+            elapsed += delta - (1 << 32) if delta & 0x80000000 else delta
+        timed.append((elapsed / cycles_per_second,) + event)
+        last = event[1]
+    timed.sort(key=lambda event: event[0])
+    return timed
+
+
+def note_for(bps):
+    return round(69 + 12 * math.log2(bps / 440))
+
+
+def note_name(note):
+    return f'{NOTE_NAMES[note % 12]}{note // 12 - 1}'
+
+
+def analyse(song, run):
+    """Per-note rows and the song's summary row, as dicts keyed by COLUMNS."""
+    cycles_per_second = run['mhz'] * 1e6
+    events = unwrap(run['events'], cycles_per_second)
+    pulses = [(event[0], event[3], event[4]) for event in events if event[1] == 'pulse']
+    # (time, note, octave, bps) for each note started or stopped
+    starts = [(event[0], event[3], event[4], event[5]) for event in events if event[1] == 'note']
+    if not starts:
+        starts = [(time, note_for(bps) if bps > REST_BPS else 0, 0, bps)
+                  for i, (time, _, bps) in enumerate(pulses) if i == 0 or bps != pulses[i - 1][2]]
+
+    # Each note's pulses are the ones fired at its bps before the next note or rest
+    notes = {}
+    index = 0
+    for i, (start, note, octave, bps) in enumerate(starts):
+        end = starts[i + 1][0] if i + 1 < len(starts) else math.inf
+        while index < len(pulses) and pulses[index][0] < start:
+            index += 1
+        if note == 0:
+            continue
+        times = []
+        while index < len(pulses) and pulses[index][0] < end:
+            if pulses[index][2] == bps:
+                times.append(pulses[index][0])
+            index += 1
+        key = note + 12 * octave
+        entry = notes.setdefault(key, {'intervals': [], 'latencies': [], 'pulses': 0, 'dropped': 0})
+        entry['pulses'] += len(times)
+        if times:
+            entry['latencies'].append(times[0] - start)
+        intervals = [b - a for a, b in zip(times, times[1:])]
+        if intervals:
+            median = statistics.median(intervals)
+            entry['dropped'] += sum(max(0, round(interval / median) - 1) for interval in intervals)
+            entry['intervals'] += intervals
+
+    rows = []
+    for note in sorted(notes):
+        entry = notes[note]
+        target = 440 * 2 ** ((note - 69) / 12)
+        row = {'song': song, 'note': note, 'name': note_name(note), 'target_hz': f'{target:.2f}',
+               'pulses': entry['pulses'], 'dropped': entry['dropped'], 'played_hz': '', 'cents': '', 'jitter_us': '',
+               'latency_us': '', 'cpu_load_pct': ''}
+        if entry['latencies']:
+            row['latency_us'] = f'{statistics.fmean(entry["latencies"]) * 1e6:.0f}'
+        if entry['intervals']:
+            played = 1 / statistics.fmean(entry['intervals'])
+            row['played_hz'] = f'{played:.2f}'
+            row['cents'] = f'{1200 * math.log2(played / target):.1f}'
+            row['jitter_us'] = f'{statistics.pstdev(entry["intervals"]) * 1e6:.0f}'
+        rows.append(row)
+
+    # Summary: interval weighted mean error, worst jitter and latency, and the share of the CPU spent firing bursts
+    timed = [row for row in rows if row['cents'] != '']
+    weights = [len(notes[row['note']]['intervals']) for row in timed]
+    mean_cents = sum(abs(float(row['cents'])) * weight for row, weight in zip(timed, weights)) / max(sum(weights), 1)
+    busy = sum(pulse[1] for pulse in pulses) / cycles_per_second
+    seconds = run['elapsed_ms'] / 1000 or (events[-1][0] if events else 0)
+    latencies = [latency for entry in notes.values() for latency in entry['latencies']]
+    rows.append({'song': song, 'note': '', 'name': 'all', 'target_hz': '', 'played_hz': '',
+                 'cents': f'{mean_cents:.1f}', 'jitter_us': max((row['jitter_us'] for row in timed), key=int, default=''),
+                 'latency_us': f'{max(latencies) * 1e6:.0f}' if latencies else '',
+                 'pulses': sum(row['pulses'] for row in rows), 'dropped': sum(row['dropped'] for row in rows) + run['lost'],
+                 'cpu_load_pct': f'{100 * busy / seconds:.2f}' if seconds else ''})
+    return rows
+
+
+def report(runs, output):
+    rows = []
+    for song, run in runs.items():
+        rows += analyse(song, run)
+    for row in rows:
+        if row['name'] == 'all':
+            print(f'{row["song"]:12} {row["pulses"]:6} pulses, {row["cents"]:>6} cents mean error, worst jitter '
+                  f'{row["jitter_us"]}us, worst latency {row["latency_us"]}us, {row["dropped"]} dropped, '
+                  f'{row["cpu_load_pct"]}% CPU')
+    if output:
+        with open(output, 'w', newline='') as file:
+            writer = csv.DictWriter(file, COLUMNS)
+            writer.writeheader()
+            writer.writerows(rows)
+    return rows
+
+
+def save_raw(path, lines):
+    if path:
+        with open(path, 'w') as file:
+            file.writelines(line + '\n' for line in lines)
+
+
+def cmd_corpus(args):
+    for path in write_corpus(args.directory):
+        print(path)
+
+
+def cmd_sim(args):
+    songs = list(args.songs)
+    if args.corpus:
+        songs += sorted(os.path.join(args.corpus, name) for name in os.listdir(args.corpus) if name.endswith('.mid'))
+    if not songs:
+        songs = write_corpus(tempfile.mkdtemp(prefix='pulse_bench_'))
+    if not os.path.exists(args.program):
+        sys.exit(f'{args.program} not found, build it with pio run -e native')
+    result = subprocess.run([args.program, 'bench'] + songs, stdout=subprocess.PIPE, text=True)
+    lines = result.stdout.splitlines()
+    save_raw(args.raw, lines)
+    report(parse_log(lines), args.output)
+    if result.returncode:
+        sys.exit(f'{result.returncode} songs failed to play')
+
+
+def cmd_serial(args):
+    import serial
+    lines = []
+    with serial.Serial(args.port, args.baud, timeout=0.1) as stream:
+        stream.write(b'bench start\n')
+        print(f'recording for {args.seconds}s, play {args.song} from the app (Ctrl-C to stop early)')
+        deadline = time.monotonic() + args.seconds
+        try:
+            while time.monotonic() < deadline:
+                lines += stream.read(stream.in_waiting or 1).decode(errors='replace').splitlines(keepends=True)
+        except KeyboardInterrupt:
+            pass
+        stream.write(b'bench stop\n')
+        deadline = time.monotonic() + 2
+        while time.monotonic() < deadline and not any(line.startswith('bench,stop') for line in lines[-4:]):
+            lines += stream.read(stream.in_waiting or 1).decode(errors='replace').splitlines(keepends=True)
+    # Reads can split a line, join the pieces back up before parsing
+    lines = ''.join(lines).splitlines()
+    save_raw(args.raw, lines)
+    runs = parse_log(lines, args.song)
+    if not runs:
+        sys.exit('no bench log came back, is the firmware new enough?')
+    report(runs, args.output)
+
+
+def cmd_analyse(args):
+    with open(args.log) as file:
+        report(parse_log(file, os.path.splitext(os.path.basename(args.log))[0]), args.output)
+
+
+def cmd_compare(args):
+    def load(path):
+        with open(path, newline='') as file:
+            return {(row['song'], row['name']): row for row in csv.DictReader(file)}
+
+    def number(row, column):
+        return float(row[column]) if row.get(column) not in (None, '') else None
+
+    baseline, current = load(args.baseline), load(args.current)
+    regressions = 0
+    for key, row in current.items():
+        before = baseline.get(key)
+        if before is None:
+            continue
+        checks = [('cents', args.cents, abs), ('jitter_us', args.jitter, float), ('latency_us', args.latency, float),
+                  ('dropped', args.dropped, float), ('cpu_load_pct', args.cpu, float)]
+        for column, tolerance, measure in checks:
+            old, new = number(before, column), number(row, column)
+            if old is not None and new is not None and measure(new) - measure(old) > tolerance:
+                print(f'{key[0]} {key[1]}: {column} {old:g} -> {new:g}')
+                regressions += 1
+    print(f'{regressions} regressions over {len(current)} rows')
+    sys.exit(1 if regressions else 0)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    commands = parser.add_subparsers(dest='command', required=True)
+
+    corpus = commands.add_parser('corpus', help='write the test songs as MIDI files')
+    corpus.add_argument('directory')
+    corpus.set_defaults(func=cmd_corpus)
+
+    sim = commands.add_parser('sim', help='play songs through the native build, the test songs if none are given')
+    sim.add_argument('songs', nargs='*')
+    sim.add_argument('--corpus', help='directory of .mid files to add')
+    sim.add_argument('--program', default=DEFAULT_PROGRAM)
+    sim.add_argument('--raw', help='also save the pulse log')
+    sim.add_argument('-o', '--output', help='CSV to write')
+    sim.set_defaults(func=cmd_sim)
+
+    serial_parser = commands.add_parser('serial', help='record the coil over USB serial while the app plays a song')
+    serial_parser.add_argument('--port', required=True)
+    serial_parser.add_argument('--baud', type=int, default=115200)
+    serial_parser.add_argument('--song', default='song', help='name for the CSV')
+    serial_parser.add_argument('--seconds', type=float, default=60.0)
+    serial_parser.add_argument('--raw', help='also save the pulse log')
+    serial_parser.add_argument('-o', '--output', help='CSV to write')
+    serial_parser.set_defaults(func=cmd_serial)
+
+    analyse_parser = commands.add_parser('analyse', help='analyse a saved pulse log')
+    analyse_parser.add_argument('log')
+    analyse_parser.add_argument('-o', '--output', help='CSV to write')
+    analyse_parser.set_defaults(func=cmd_analyse)
+
+    compare = commands.add_parser('compare', help='list what got worse between two result CSVs')
+    compare.add_argument('baseline')
+    compare.add_argument('current')
+    compare.add_argument('--cents', type=float, default=5.0, help='allowed growth in absolute error')
+    compare.add_argument('--jitter', type=float, default=100.0, help='allowed growth in microseconds')
+    compare.add_argument('--latency', type=float, default=1000.0, help='allowed growth in microseconds')
+    compare.add_argument('--dropped', type=float, default=0.0)
+    compare.add_argument('--cpu', type=float, default=0.5, help='allowed growth in percentage points')
+    compare.set_defaults(func=cmd_compare)
+
+    args = parser.parse_args()
+    args.func(args)
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,120 @@
+#!/usr/bin/env python3
+"""Pull scope captures off the coil over USB serial (see src/Scope.h for the capture layout).
+
+    scope_capture.py --port /dev/ttyACM0 --pre 100 --post 300 --count 4 --csv captures.csv
+    scope_capture.py --port /dev/ttyACM0 --plot
+
+Each capture is the CT peak detector around one burst plus every ZCD edge, so phase lead
+can be tuned by lining the edges up against the current ramp without a real scope attached.
+"""
+
+import argparse
+import csv
+import struct
+import sys
+import time
+
+FRAME_MAGIC = b'SCOP'
+HEADER = struct.Struct('<IIHHhBBH')
+
+
+def decode_capture(payload):
+    (trigger_micros, sample_period_nanos, burst_length, phase_lead,
+     first_sample_offset, sample_count, _, edge_count) = HEADER.unpack_from(payload)
+    offset = HEADER.size
+    samples = struct.unpack_from('<%dH' % sample_count, payload, offset)
+    offset += 2 * sample_count
+    edges = struct.unpack_from('<%dI' % edge_count, payload, offset)
+    sample_times = [(first_sample_offset + i) * sample_period_nanos for i in range(sample_count)]
+    return {
+        'trigger_micros': trigger_micros,
+        'burst_length': burst_length,
+        'phase_lead': phase_lead,
+        'samples': list(zip(sample_times, samples)),
+        'edges': list(edges),
+    }
+
+
+def read_frames(stream, count, timeout):
+    """Yields decoded captures, passing any text the firmware prints through to stderr."""
+    buffer = b''
+    deadline = time.time() + timeout
+    received = 0
+    while received < count and time.time() < deadline:
+        buffer += stream.read(stream.in_waiting or 1)
+        while True:
+            start = buffer.find(FRAME_MAGIC)
+            if start < 0:
+                # Keep a possible partial magic at the end
+                text, buffer = buffer[:-3], buffer[-3:]
+                sys.stderr.write(text.decode(errors='replace'))
+                break
+            sys.stderr.write(buffer[:start].decode(errors='replace'))
+            if len(buffer) < start + 6:
+                buffer = buffer[start:]
+                break
+            (length,) = struct.unpack_from('<H', buffer, start + 4)
+            if len(buffer) < start + 6 + length:
+                buffer = buffer[start:]
+                break
+            yield decode_capture(buffer[start + 6:start + 6 + length])
+            buffer = buffer[start + 6 + length:]
+            received += 1
+
+
+def write_csv(path, captures):
+    with open(path, 'w', newline='') as f:
+        writer = csv.writer(f)
+        writer.writerow(['capture', 'kind', 'time_ns', 'ct_mv'])
+        for index, capture in enumerate(captures):
+            for time_ns, millivolts in capture['samples']:
+                writer.writerow([index, 'ct', time_ns, millivolts])
+            for time_ns in capture['edges']:
+                writer.writerow([index, 'zcd', time_ns, ''])
+
+
+def plot(captures):
+    import matplotlib.pyplot as plt
+    fig, axes = plt.subplots(len(captures), 1, squeeze=False, sharex=True)
+    for axis, capture in zip(axes[:, 0], captures):
+        times = [t / 1000 for t, _ in capture['samples']]
+        axis.step(times, [mv for _, mv in capture['samples']], where='post', label='CT peak (mV)')
+        for edge in capture['edges']:
+            axis.axvline(edge / 1000, color='tab:orange', alpha=0.3, linewidth=0.5)
+        axis.set_title('burst %dus, phase lead %dns' % (capture['burst_length'], capture['phase_lead']))
+        axis.legend(loc='upper left')
+    axes[-1, 0].set_xlabel('us from trigger')
+    plt.show()
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument('--port', required=True)
+    parser.add_argument('--baud', type=int, default=115200)
+    parser.add_argument('--pre', type=int, default=100, help='microseconds before the burst')
+    parser.add_argument('--post', type=int, default=300, help='microseconds after the burst')
+    parser.add_argument('--count', type=int, default=1)
+    parser.add_argument('--timeout', type=float, default=30.0)
+    parser.add_argument('--csv')
+    parser.add_argument('--plot', action='store_true')
+    args = parser.parse_args()
+
+    import serial
+    with serial.Serial(args.port, args.baud, timeout=0.1) as stream:
+        stream.write(b'scope %d %d %d\n' % (args.pre, args.post, args.count))
+        captures = []
+        for capture in read_frames(stream, args.count, args.timeout):
+            captures.append(capture)
+            print('capture %d: burst %dus, %d samples, %d edges' % (
+                len(captures), capture['burst_length'], len(capture['samples']), len(capture['edges'])))
+        if len(captures) < args.count:
+            stream.write(b'scope off\n')
+
+    if args.csv:
+        write_csv(args.csv, captures)
+    if args.plot and captures:
+        plot(captures)
+
+
+if __name__ == '__main__':
+    main()
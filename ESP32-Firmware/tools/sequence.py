@@ -0,0 +1,260 @@
+#!/usr/bin/env python3
+"""Compile light show scripts into the flat timeline src/Sequence.h plays, and upload them over Wi-Fi.
+
+    sequence.py compile show.txt show.tcsq
+    sequence.py dump show.tcsq
+    sequence.py --host 192.168.86.56 upload show.txt --play
+    sequence.py --host 192.168.86.56 stop
+
+A script is one keyframe per line, times in milliseconds. "@t" is from the start of the show, "+t" is after
+the end of the previous line (the end of its ramp or stutter). # starts a comment.
+
+    @0     set bps=100 burst=40 phase=150 voice=on
+    +1000  ramp bps 100 800 2000        # linear over 2000ms, in 10ms steps unless a step is given
+    +0     stutter 50 50 10             # 10 x (50ms on, 50ms off)
+    +0     ramp burst 40 120 1500 25
+    +500   set voice=off
+    +200   end
+"""
+
+import argparse
+import socket
+import struct
+import sys
+
+DEFAULT_PORT = 4210
+PACKET_SEQUENCE = 0x08
+PACKET_SEQUENCE_STATUS = 0x84
+
+# Matches src/Sequence.h
+MAGIC = b'TCSQ'
+FORMAT_VERSION = 1
+MAX_EVENTS = 4096
+EVENT = struct.Struct('<IBH')
+STATUS = struct.Struct('<BHHIII')
+PARAMETERS = {'bps': 0, 'burst': 1, 'phase': 2, 'voice': 3}
+PARAMETER_NAMES = {v: k for k, v in PARAMETERS.items()}
+PARAMETER_END = 4
+# Same limits as BleControl::applyParameterBlock, the coil rejects anything outside them
+LIMITS = {'bps': (1, 65535), 'burst': (10, 500), 'phase': (0, 1250), 'voice': (0, 1)}
+OP_BEGIN, OP_APPEND, OP_FINISH, OP_PLAY, OP_STOP = range(5)
+STATES = ['empty', 'uploading', 'ready', 'playing', 'invalid']
+CHUNK_SIZE = 1024
+
+
+class ScriptError(Exception):
+    pass
+
+
+def parse_value(name, text):
+    if name == 'voice':
+        if text in ('on', 'off'):
+            return int(text == 'on')
+    try:
+        value = int(text)
+    except ValueError:
+        raise ScriptError(f'{name}: {text!r} is not a number')
+    low, high = LIMITS[name]
+    if not low <= value <= high:
+        raise ScriptError(f'{name} {value} is outside {low} to {high}')
+    return value
+
+
+def parameter(name):
+    if name not in PARAMETERS:
+        raise ScriptError(f'unknown parameter {name!r}, expected one of {", ".join(PARAMETERS)}')
+    return name
+
+
+def compile_script(text):
+    """Returns the events as (time us, parameter, value), sorted by time."""
+    events = []
+    cursor_ms = 0.0
+    for number, line in enumerate(text.splitlines(), 1):
+        words = line.split('#', 1)[0].split()
+        if not words:
+            continue
+        try:
+            time, command, args = words[0], words[1] if len(words) > 1 else '', words[2:]
+            if time[0] not in '@+':
+                raise ScriptError(f'time {time!r} must start with @ or +')
+            offset = float(time[1:])
+            start_ms = offset if time[0] == '@' else cursor_ms + offset
+            end_ms = start_ms
+
+            if command == 'set':
+                for assignment in args:
+                    name, _, value = assignment.partition('=')
+                    events.append((start_ms, PARAMETERS[parameter(name)], parse_value(name, value)))
+            elif command == 'ramp':
+                if len(args) not in (4, 5):
+                    raise ScriptError('ramp <parameter> <from> <to> <duration ms> [step ms]')
+                name = parameter(args[0])
+                start, end = parse_value(name, args[1]), parse_value(name, args[2])
+                duration, step = float(args[3]), float(args[4]) if len(args) == 5 else 10.0
+                if duration <= 0 or step <= 0:
+                    raise ScriptError('ramp duration and step must be positive')
+                steps = max(1, round(duration / step))
+                last = None
+                for i in range(steps + 1):
+                    value = round(start + (end - start) * i / steps)
+                    # Only changes go in the timeline
+                    if value != last:
+                        events.append((start_ms + duration * i / steps, PARAMETERS[name], value))
+                        last = value
+                end_ms = start_ms + duration
+            elif command == 'stutter':
+                if len(args) != 3:
+                    raise ScriptError('stutter <on ms> <off ms> <count>')
+                on_ms, off_ms, count = float(args[0]), float(args[1]), int(args[2])
+                for i in range(count):
+                    events.append((start_ms + i * (on_ms + off_ms), PARAMETERS['voice'], 1))
+                    events.append((start_ms + i * (on_ms + off_ms) + on_ms, PARAMETERS['voice'], 0))
+                end_ms = start_ms + count * (on_ms + off_ms)
+            elif command == 'end':
+                events.append((start_ms, PARAMETER_END, 0))
+            else:
+                raise ScriptError(f'unknown command {command!r}')
+            cursor_ms = end_ms
+        except (ScriptError, ValueError, IndexError) as error:
+            raise ScriptError(f'line {number}: {error}')
+
+    if not events:
+        raise ScriptError('the script has no events')
+    # Stable, so changes at the same time keep their script order
+    events = sorted(((round(ms * 1000), p, v) for ms, p, v in events), key=lambda event: event[0])
+    if events[0][0] < 0:
+        raise ScriptError('an event falls before the start of the show')
+    if len(events) > MAX_EVENTS:
+        raise ScriptError(f'{len(events)} events, the coil holds {MAX_EVENTS}')
+    return events
+
+
+def encode(events):
+    header = MAGIC + struct.pack('<BBH', FORMAT_VERSION, 0, len(events))
+    return header + b''.join(EVENT.pack(*event) for event in events)
+
+
+def decode(data):
+    if data[:4] != MAGIC or data[4] != FORMAT_VERSION:
+        raise ScriptError('not a version 1 timeline')
+    count = struct.unpack_from('<H', data, 6)[0]
+    return [EVENT.unpack_from(data, 8 + i * EVENT.size) for i in range(count)]
+
+
+def load(path):
+    with open(path, 'rb') as file:
+        data = file.read()
+    if data[:4] == MAGIC:
+        decode(data)
+        return data
+    return encode(compile_script(data.decode()))
+
+
+def describe_status(reply):
+    state, count, cursor, duration, elapsed, late = STATUS.unpack_from(reply, 1)
+    name = STATES[state] if state < len(STATES) else str(state)
+    return state, f'{name}, event {cursor} of {count}, {elapsed} of {duration} ms, worst lateness {late} us'
+
+
+class Coil:
+    def __init__(self, host, port):
+        self.address = (host, port)
+        self.sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+        self.sock.settimeout(0.5)
+
+    def command(self, op, payload=b''):
+        """Sends a sequence command and returns the status reply, retrying lost ones."""
+        for _ in range(5):
+            self.sock.sendto(bytes([PACKET_SEQUENCE, op]) + payload, self.address)
+            try:
+                while True:
+                    reply, _ = self.sock.recvfrom(64)
+                    if reply and reply[0] == PACKET_SEQUENCE_STATUS and len(reply) >= 1 + STATUS.size:
+                        return reply
+            except socket.timeout:
+                if op == OP_APPEND:
+                    # A resent chunk would land twice, let the caller start over
+                    return None
+        sys.exit(f'no answer from {self.address[0]}:{self.address[1]}')
+
+    def upload(self, data):
+        for attempt in range(3):
+            self.command(OP_BEGIN)
+            ok = True
+            for offset in range(0, len(data), CHUNK_SIZE):
+                reply = self.command(OP_APPEND, struct.pack('<H', offset) + data[offset:offset + CHUNK_SIZE])
+                if reply is None or describe_status(reply)[0] != STATES.index('uploading'):
+                    ok = False
+                    break
+            if ok:
+                state, text = describe_status(self.command(OP_FINISH))
+                if state == STATES.index('ready'):
+                    return text
+                sys.exit(f'timeline rejected: {text}')
+            print(f'upload attempt {attempt + 1} lost a chunk, starting over')
+        sys.exit('upload failed')
+
+
+def cmd_compile(args):
+    data = load(args.input)
+    with open(args.output, 'wb') as file:
+        file.write(data)
+    events = decode(data)
+    print(f'{len(events)} events, {events[-1][0] / 1e6:.3f}s, {len(data)} bytes')
+
+
+def cmd_dump(args):
+    for time, parameter_id, value in decode(load(args.input)):
+        name = PARAMETER_NAMES.get(parameter_id, 'end')
+        print(f'{time / 1000:10.3f} ms  {name:5} {value}')
+
+
+def cmd_upload(args):
+    coil = Coil(args.host, args.port)
+    data = load(args.input)
+    print(coil.upload(data))
+    if args.play:
+        print(describe_status(coil.command(OP_PLAY))[1])
+
+
+def cmd_play(args):
+    print(describe_status(Coil(args.host, args.port).command(OP_PLAY))[1])
+
+
+def cmd_stop(args):
+    print(describe_status(Coil(args.host, args.port).command(OP_STOP))[1])
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument('--host', default='127.0.0.1')
+    parser.add_argument('--port', type=int, default=DEFAULT_PORT)
+    commands = parser.add_subparsers(dest='command', required=True)
+
+    compile_parser = commands.add_parser('compile', help='compile a script into a timeline file')
+    compile_parser.add_argument('input')
+    compile_parser.add_argument('output')
+    compile_parser.set_defaults(func=cmd_compile)
+
+    dump = commands.add_parser('dump', help='list the events of a script or timeline')
+    dump.add_argument('input')
+    dump.set_defaults(func=cmd_dump)
+
+    upload = commands.add_parser('upload', help='upload a script or timeline to the coil')
+    upload.add_argument('input')
+    upload.add_argument('--play', action='store_true', help='start it once uploaded')
+    upload.set_defaults(func=cmd_upload)
+
+    commands.add_parser('play', help='play the uploaded timeline').set_defaults(func=cmd_play)
+    commands.add_parser('stop', help='stop the show').set_defaults(func=cmd_stop)
+
+    args = parser.parse_args()
+    try:
+        args.func(args)
+    except ScriptError as error:
+        sys.exit(f'{args.input}: {error}' if hasattr(args, 'input') else str(error))
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,187 @@
+#!/usr/bin/env python3
+"""Turn a Trace dump (see src/Trace.h) into Chrome trace JSON, for ui.perfetto.dev or chrome://tracing.
+
+    trace_json.py serial --port /dev/ttyACM0 -o trace.json    # "trace start" first, then reproduce the problem
+    trace_json.py convert dump.txt -o trace.json               # a saved dump, or .pio/build/native/program trace
+
+Each core gets a track with its bursts as slices, ZCD edges as instants and GD1A as a counter. Notes get a track of
+their own. Both cores land on one timeline through the anchors in their rings, each event placed from the last anchor
+before it. Events older than a core's oldest kept anchor are placed back from it, or dropped when that anchor came
+after a gap.
+"""
+
+import argparse
+import json
+import sys
+import time
+
+ZCD_EDGE, GATE_TOGGLE, BURST_START, BURST_END, OCD_TRIP, NOTE_ON, NOTE_OFF, BLE_WRITE, MIDI_PLAYING = range(9)
+TRIP_SOURCES = ['comparator', 'adc threshold', 'burst peak']
+NOTE_NAMES = ['C', 'C#', 'D', 'D#', 'E', 'F', 'F#', 'G', 'G#', 'A', 'A#', 'B']
+PID = 1
+NOTES_TID = 100
+
+
+class DumpError(Exception):
+    pass
+
+
+def parse_dump(lines):
+    """Returns (cpu MHz, {core: {'recorded', 'events': [(cycles, event, arg)]}}), anchors are events with event None,
+    micros in place of arg and a third field that is true after a gap."""
+    mhz, cores, ended = None, {}, False
+    for line in lines:
+        fields = line.strip().split(',')
+        if fields[0] == 'trace' and len(fields) >= 3 and fields[1] == 'start':
+            mhz, cores, ended = int(fields[2]), {}, False
+        elif fields[0] == 'trace' and len(fields) == 4 and fields[1] == 'core':
+            core, recorded = (int(field) for field in fields[2:])
+            cores[core] = {'recorded': recorded, 'events': []}
+        elif fields[0] == 'a' and len(fields) == 5 and mhz is not None:
+            core, cycles, micros, after_gap = (int(field) for field in fields[1:])
+            if core in cores:
+                cores[core]['events'].append((cycles, None, (micros, bool(after_gap))))
+        elif fields[0] == 't' and len(fields) == 5 and mhz is not None:
+            core, cycles, event, arg = (int(field) for field in fields[1:])
+            if core in cores:
+                cores[core]['events'].append((cycles, event, arg))
+        elif fields[0] == 'trace' and len(fields) >= 2 and fields[1] == 'end':
+            ended = True
+    if mhz is None or not ended:
+        raise DumpError('no complete trace dump found')
+    return mhz, cores
+
+
+def signed_delta(later, earlier):
+    # Signed, an interrupt can take a later slot than the event it interrupted yet stamp an earlier time
+    delta = (later - earlier) & 0xFFFFFFFF
+    return delta - (1 << 32) if delta & 0x80000000 else delta
+
+
+def timestamps(core, mhz):
+    """(microseconds on the shared clock, event, arg) for each event placed, oldest first."""
+    events = core['events']
+    first = next((i for i, (_, event, _) in enumerate(events) if event is None), None)
+    if first is None:
+        return []
+    placed = []
+    # Back from the oldest anchor, unless nothing before it is within a second of it
+    anchor_cycles, _, (anchor_micros, after_gap) = events[first]
+    if not after_gap:
+        back, later = 0, anchor_cycles
+        for cycles, event, arg in reversed(events[:first]):
+            back += signed_delta(later, cycles)
+            placed.append((anchor_micros - back / mhz, event, arg))
+            later = cycles
+        placed.reverse()
+    # Forward from the last anchor
+    for cycles, event, arg in events[first:]:
+        if event is None:
+            anchor_micros, ahead, earlier = arg[0], 0, cycles
+            continue
+        ahead += signed_delta(cycles, earlier)
+        placed.append((anchor_micros + ahead / mhz, event, arg))
+        earlier = cycles
+    return placed
+
+
+def note_name(note):
+    return f'{NOTE_NAMES[note % 12]}{note // 12 - 1}'
+
+
+def convert(mhz, cores):
+    trace = [{'ph': 'M', 'pid': PID, 'name': 'process_name', 'args': {'name': 'Tesla coil'}},
+             {'ph': 'M', 'pid': PID, 'tid': NOTES_TID, 'name': 'thread_name', 'args': {'name': 'notes'}}]
+    # Notes are played from either core, so merge before pairing them up
+    notes = []
+    for number, core in sorted(cores.items()):
+        trace.append({'ph': 'M', 'pid': PID, 'tid': number, 'name': 'thread_name', 'args': {'name': f'core {number}'}})
+        in_burst = False
+        for ts, event, arg in timestamps(core, mhz):
+            base = {'pid': PID, 'tid': number, 'ts': ts}
+            if event == ZCD_EDGE:
+                trace.append(dict(base, ph='i', s='t', name='ZCD edge', args={'edge': arg}))
+            elif event == GATE_TOGGLE:
+                trace.append(dict(base, ph='C', name='GD1A', args={'level': arg}))
+            elif event == BURST_START:
+                trace.append(dict(base, ph='B', name='burst', args={'length_us': arg}))
+                in_burst = True
+            elif event == BURST_END and in_burst:
+                # One that started before the oldest event kept has nothing to close
+                trace.append(dict(base, ph='E', args={'cut_short': bool(arg)}))
+                in_burst = False
+            elif event == OCD_TRIP:
+                source = TRIP_SOURCES[arg] if arg < len(TRIP_SOURCES) else str(arg)
+                trace.append(dict(base, ph='i', s='g', name='OCD trip', args={'source': source}))
+            elif event in (NOTE_ON, NOTE_OFF):
+                notes.append((ts, event, arg))
+            elif event == BLE_WRITE:
+                trace.append(dict(base, ph='i', s='t', name='BLE write', args={'bytes': arg}))
+            elif event == MIDI_PLAYING:
+                trace.append(dict(base, ph='i', s='p', name='MIDI play' if arg else 'MIDI stop'))
+
+    open_note = None
+    for ts, event, arg in sorted(notes):
+        base = {'pid': PID, 'tid': NOTES_TID, 'ts': ts}
+        if open_note is not None:
+            trace.append(dict(base, ph='E'))
+            open_note = None
+        if event == NOTE_ON:
+            trace.append(dict(base, ph='B', name=note_name(arg), args={'note': arg}))
+            open_note = arg
+    return {'traceEvents': trace, 'displayTimeUnit': 'ns'}
+
+
+def write(result, path):
+    with open(path, 'w') as file:
+        json.dump(result, file)
+    count = sum(1 for event in result['traceEvents'] if event['ph'] != 'M')
+    print(f'{count} events written to {path}')
+
+
+def cmd_convert(args):
+    with open(args.dump) as file:
+        write(convert(*parse_dump(file)), args.output)
+
+
+def cmd_serial(args):
+    import serial
+    text = ''
+    with serial.Serial(args.port, args.baud, timeout=0.1) as stream:
+        stream.reset_input_buffer()
+        stream.write(b'trace dump\n')
+        deadline = time.monotonic() + args.timeout
+        while time.monotonic() < deadline and '\ntrace,end' not in text:
+            text += stream.read(stream.in_waiting or 1).decode(errors='replace')
+    if args.raw:
+        with open(args.raw, 'w') as file:
+            file.write(text)
+    write(convert(*parse_dump(text.splitlines())), args.output)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    commands = parser.add_subparsers(dest='command', required=True)
+
+    convert_parser = commands.add_parser('convert', help='convert a saved dump')
+    convert_parser.add_argument('dump')
+    convert_parser.add_argument('-o', '--output', default='trace.json')
+    convert_parser.set_defaults(func=cmd_convert)
+
+    serial_parser = commands.add_parser('serial', help='dump the coil over USB serial and convert it')
+    serial_parser.add_argument('--port', required=True)
+    serial_parser.add_argument('--baud', type=int, default=115200)
+    serial_parser.add_argument('--timeout', type=float, default=10.0, help='seconds to wait for the dump')
+    serial_parser.add_argument('--raw', help='also save the dump')
+    serial_parser.add_argument('-o', '--output', default='trace.json')
+    serial_parser.set_defaults(func=cmd_serial)
+
+    args = parser.parse_args()
+    try:
+        args.func(args)
+    except DumpError as error:
+        sys.exit(str(error))
+
+
+if __name__ == '__main__':
+    main()
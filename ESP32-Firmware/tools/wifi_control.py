@@ -0,0 +1,241 @@
+#!/usr/bin/env python3
+"""Host side of the WifiControl UDP transport (see src/WifiControl.h for the packet layout).
+
+Talk to a coil:
+    wifi_control.py --host 192.168.86.56 state
+    wifi_control.py --host 192.168.86.56 set --burst-length 80 --bps 50 --burst-enabled 1
+    wifi_control.py --host 192.168.86.56 stream --streams ct,zcd,readings --seconds 10
+    wifi_control.py --host 192.168.86.56 stream --streams ct-samples --seconds 10 --verbose > ct.txt
+
+Or run a stand-in coil on this machine and point the commands above at --host 127.0.0.1:
+    wifi_control.py device
+"""
+
+import argparse
+import math
+import random
+import socket
+import struct
+import time
+
+DEFAULT_PORT = 4210
+
+PACKET_PARAMETER_BLOCK = 0x01
+PACKET_GET_STATE = 0x02
+PACKET_SUBSCRIBE = 0x03
+PACKET_PRESET = 0x04
+PACKET_STATE = 0x81
+PACKET_READINGS = 0x82
+PACKET_SAMPLES = 0x83
+
+STREAM_CT = 0
+STREAM_ZCD = 1
+STREAM_CT_SAMPLES = 2
+STREAM_BITS = {'ct': 1 << STREAM_CT, 'zcd': 1 << STREAM_ZCD, 'ct-samples': 1 << STREAM_CT_SAMPLES,
+               'readings': 0x80}
+STREAM_NAMES = {STREAM_CT: 'ct', STREAM_ZCD: 'zcd', STREAM_CT_SAMPLES: 'ct-samples'}
+CT_SAMPLE_RATE_HZ = 20000
+
+# Matches BleControl::encodeParameterBlock
+PARAMETER_BLOCK = struct.Struct('<BHHHBBBbB')
+PARAMETER_FIELDS = ('enabled', 'burst_length', 'bps', 'phase_lead', 'reverse_burst_phase',
+                    'burst_enabled', 'reserved', 'midi_octave', 'chord_swap_time')
+SUBSCRIPTION_REFRESH_S = 5.0
+
+
+def decode_state(payload):
+    return dict(zip(PARAMETER_FIELDS, PARAMETER_BLOCK.unpack_from(payload)))
+
+
+def encode_state(state):
+    return PARAMETER_BLOCK.pack(*(state[f] for f in PARAMETER_FIELDS))
+
+
+def decode_samples(packet):
+    stream, sequence, count = struct.unpack_from('<BHH', packet, 1)
+    samples = [struct.unpack_from('<IH', packet, 6 + i * 6) for i in range(count)]
+    return stream, sequence, samples
+
+
+def request_state(sock, address, packet):
+    sock.sendto(packet, address)
+    while True:
+        data, _ = sock.recvfrom(2048)
+        if data and data[0] == PACKET_STATE:
+            return decode_state(data[1:])
+
+
+def cmd_state(sock, address, args):
+    print(request_state(sock, address, bytes([PACKET_GET_STATE])))
+
+
+def cmd_set(sock, address, args):
+    state = request_state(sock, address, bytes([PACKET_GET_STATE]))
+    for field in PARAMETER_FIELDS:
+        value = getattr(args, field, None)
+        if value is not None:
+            state[field] = value
+    print(request_state(sock, address, bytes([PACKET_PARAMETER_BLOCK]) + encode_state(state)))
+
+
+def cmd_preset(sock, address, args):
+    ops = {'recall': 0, 'save': 1, 'delete': 2}
+    packet = bytes([PACKET_PRESET, ops[args.op], args.index]) + args.name.encode()[:16]
+    print(request_state(sock, address, packet))
+
+
+def cmd_stream(sock, address, args):
+    mask = 0
+    for name in args.streams.split(','):
+        mask |= STREAM_BITS[name.strip()]
+
+    subscribe = bytes([PACKET_SUBSCRIBE, mask])
+    sock.settimeout(0.5)
+    counts = {}
+    expected = {}
+    gaps = 0
+    start = time.monotonic()
+    last_subscribe = 0.0
+    try:
+        while time.monotonic() - start < args.seconds:
+            now = time.monotonic()
+            if now - last_subscribe > SUBSCRIPTION_REFRESH_S:
+                sock.sendto(subscribe, address)
+                last_subscribe = now
+            try:
+                data, _ = sock.recvfrom(2048)
+            except socket.timeout:
+                continue
+
+            if data[0] == PACKET_SAMPLES:
+                stream, sequence, samples = decode_samples(data)
+                name = STREAM_NAMES.get(stream, str(stream))
+                if name in expected and sequence != expected[name]:
+                    gaps += 1
+                expected[name] = (sequence + 1) & 0xFFFF
+                counts[name] = counts.get(name, 0) + len(samples)
+                if args.verbose:
+                    for timestamp, value in samples:
+                        print(f'{name} {timestamp} {value}')
+            elif data[0] == PACKET_READINGS:
+                vbus, ct, therm1, therm2 = struct.unpack_from('<ffff', data, 1)
+                print(f'readings vbus={vbus:.1f} ct={ct:.1f} therm1={therm1:.1f} therm2={therm2:.1f}')
+    finally:
+        sock.sendto(bytes([PACKET_SUBSCRIBE, 0]), address)
+
+    elapsed = time.monotonic() - start
+    for name, count in counts.items():
+        print(f'{name}: {count} samples, {count / elapsed:.0f} samples/s')
+    print(f'sequence gaps: {gaps}')
+
+
+def cmd_device(sock, address, args):
+    """Stand-in coil: answers requests like WifiControl and streams synthetic CT/ZCD telemetry."""
+    sock.bind(('0.0.0.0', args.port))
+    sock.setblocking(False)
+    state = {'enabled': 0, 'burst_length': 100, 'bps': 2, 'phase_lead': 0, 'reverse_burst_phase': 0,
+             'burst_enabled': 0, 'reserved': 0, 'midi_octave': 0, 'chord_swap_time': 20}
+    subscribers = {}
+    sequences = {STREAM_CT: 0, STREAM_ZCD: 0, STREAM_CT_SAMPLES: 0}
+    ct_sample_time = time.monotonic()
+    edge_count = 0
+    last_tick = time.monotonic()
+    last_readings = last_tick
+    print(f'Stand-in coil listening on UDP {args.port}')
+
+    while True:
+        try:
+            data, sender = sock.recvfrom(2048)
+        except BlockingIOError:
+            data = None
+
+        if data:
+            kind = data[0]
+            if kind == PACKET_SUBSCRIBE:
+                subscribers[sender] = (data[1] if len(data) > 1 else 0, time.monotonic())
+            elif kind in (PACKET_PARAMETER_BLOCK, PACKET_GET_STATE, PACKET_PRESET):
+                if kind == PACKET_PARAMETER_BLOCK and len(data) >= 1 + PARAMETER_BLOCK.size:
+                    new_state = decode_state(data[1:])
+                    if 10 <= new_state['burst_length'] <= 500 and new_state['bps'] >= 1:
+                        state = new_state
+                sock.sendto(bytes([PACKET_STATE]) + encode_state(state), sender)
+
+        now = time.monotonic()
+        subscribers = {a: s for a, s in subscribers.items() if now - s[1] < 10.0}
+        if now - last_tick < 0.002:
+            time.sleep(0.0005)
+            continue
+
+        # One burst per bps period while bursting, each with a CT peak and ~2 ZCD edges per us of burst at 400kHz
+        bursts = int((now - last_tick) * state['bps']) if state['burst_enabled'] else 0
+        if bursts == 0 and state['burst_enabled'] and random.random() < (now - last_tick) * state['bps']:
+            bursts = 1
+        last_tick = now
+        timestamp = int(now * 1e6) & 0xFFFFFFFF
+        ct = []
+        zcd = []
+        for _ in range(min(bursts, 200)):
+            ct.append((timestamp, int(1500 + 400 * math.sin(now) + random.randint(-20, 20))))
+            for _ in range(min(state['burst_length'] * 8 // 10, 200)):
+                edge_count = (edge_count + 1) & 0xFFFF
+                zcd.append((timestamp, edge_count))
+        # The CT peak detector is sampled continuously, it only rises while bursting
+        ct_samples = []
+        while ct_sample_time < now:
+            level = 1200 if state['burst_enabled'] else 0
+            ct_samples.append((int(ct_sample_time * 1e6) & 0xFFFFFFFF, max(0, level + random.randint(-20, 20))))
+            ct_sample_time += 1.0 / CT_SAMPLE_RATE_HZ
+
+        for stream, samples in ((STREAM_CT, ct), (STREAM_ZCD, zcd), (STREAM_CT_SAMPLES, ct_samples)):
+            for offset in range(0, len(samples), 232):
+                chunk = samples[offset:offset + 232]
+                packet = struct.pack('<BBHH', PACKET_SAMPLES, stream, sequences[stream], len(chunk))
+                packet += b''.join(struct.pack('<IH', t, v) for t, v in chunk)
+                sequences[stream] = (sequences[stream] + 1) & 0xFFFF
+                for subscriber, (mask, _) in subscribers.items():
+                    if mask & (1 << stream):
+                        sock.sendto(packet, subscriber)
+
+        if now - last_readings > 0.1:
+            last_readings = now
+            packet = struct.pack('<Bffff', PACKET_READINGS, 340.0, 0.0, 25.0, 25.0)
+            for subscriber, (mask, _) in subscribers.items():
+                if mask & STREAM_BITS['readings']:
+                    sock.sendto(packet, subscriber)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument('--host', default='127.0.0.1')
+    parser.add_argument('--port', type=int, default=DEFAULT_PORT)
+    commands = parser.add_subparsers(dest='command', required=True)
+
+    commands.add_parser('state', help='print the current parameter block')
+
+    set_parser = commands.add_parser('set', help='change parameters atomically')
+    for field in PARAMETER_FIELDS:
+        if field != 'reserved':
+            set_parser.add_argument('--' + field.replace('_', '-'), dest=field, type=int)
+
+    preset_parser = commands.add_parser('preset', help='recall, save or delete a preset')
+    preset_parser.add_argument('op', choices=['recall', 'save', 'delete'])
+    preset_parser.add_argument('index', type=int)
+    preset_parser.add_argument('name', nargs='?', default='')
+
+    stream_parser = commands.add_parser('stream', help='subscribe to telemetry and report rates')
+    stream_parser.add_argument('--streams', default='ct,zcd,readings')
+    stream_parser.add_argument('--seconds', type=float, default=5.0)
+    stream_parser.add_argument('--verbose', action='store_true')
+
+    commands.add_parser('device', help='run a stand-in coil on this machine')
+
+    args = parser.parse_args()
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    handlers = {'state': cmd_state, 'set': cmd_set, 'preset': cmd_preset, 'stream': cmd_stream, 'device': cmd_device}
+    if args.command != 'device':
+        sock.settimeout(2.0)
+    handlers[args.command](sock, (args.host, args.port), args)
+
+
+if __name__ == '__main__':
+    main()
@@ -6,7 +6,7 @@ import SensorGraph from './components/SensorGraph'
 import FrequencySweep from './components/FrequencySweep'
 import MidiControl from './components/MidiControl'
 import { TeslaCoilBluetooth } from './utils/teslaCoilBluetooth'
-import type { TeslaCoilData, TeslaCoilControl, FrequencySweepConfig, FrequencySweepData } from './utils/teslaCoilBluetooth'
+import type { TeslaCoilData, TeslaCoilControl, FrequencySweepConfig, FrequencySweepData, FrequencySweepProgress } from './utils/teslaCoilBluetooth'
 
 function App() {
   const [teslaCoilData, setTeslaCoilData] = useState<TeslaCoilData | null>(null)
@@ -20,6 +20,7 @@ function App() {
   })
   const [frequencySweepData, setFrequencySweepData] = useState<FrequencySweepData[]>([])
   const [isFrequencySweepActive, setIsFrequencySweepActive] = useState(false)
+  const [frequencySweepProgress, setFrequencySweepProgress] = useState<FrequencySweepProgress | null>(null)
   const [isMidiUploading, setIsMidiUploading] = useState(false)
   const [midiSettings, setMidiSettings] = useState({ chordSwapTime: 50 })
   const teslaCoilRef = useRef<TeslaCoilBluetooth | null>(null)
@@ -108,6 +109,10 @@ function App() {
       
       // Start reading sensor data via notifications
       // await teslaCoil.startNotifications(setTeslaCoilData)
+      await teslaCoil.startLatencyEcho()
+
+      // Keep the sliders in sync with changes made by other clients
+      await teslaCoil.startControlNotifications((control) => setTeslaCoilControl(control))
 
       // Send initial control data
       await teslaCoil.writeControlData(teslaCoilControl)
@@ -167,14 +172,23 @@ function App() {
         
         // Start frequency sweep notifications
         let frequencyDataSetTimestamp = Date.now()
+        let sweepPaused = false
+        await teslaCoilRef.current.startFrequencySweepProgressNotifications((progress) => {
+          sweepPaused = progress.state === 'paused'
+          frequencyDataSetTimestamp = Date.now()
+          setFrequencySweepProgress(progress)
+        })
         await teslaCoilRef.current.startFrequencySweepNotifications((data) => {
           frequencyDataSetTimestamp = Date.now()
           setFrequencySweepData(prev => [...prev, data])
+        }, () => {
+          // Sweep finished, let the interval below wrap up straight away
+          frequencyDataSetTimestamp = 0
         })
         
-        // If no data is received after 2 seconds, stop the FrequencySweep.
+        // If no data is received after 2 seconds, stop the FrequencySweep. A paused sweep is quiet on purpose
         const interval = setInterval(async () => {
-          if (Date.now() - frequencyDataSetTimestamp < 2000) { return }
+          if (sweepPaused || Date.now() - frequencyDataSetTimestamp < 2000) { return }
           
           if (teslaCoilRef.current) {
             await teslaCoilRef.current.stopFrequencySweepNotifications()
@@ -190,6 +204,16 @@ function App() {
     }
   }
 
+  const handleControlFrequencySweep = async (command: 'cancel' | 'pause' | 'resume') => {
+    if (teslaCoilRef.current) {
+      try {
+        await teslaCoilRef.current.controlFrequencySweep(command)
+      } catch (error) {
+        console.error(`Failed to ${command} frequency sweep:`, error)
+      }
+    }
+  }
+
   const handleUploadMidiFile = async (file: File, onProgress?: (progress: { totalBytes: number; bytesSent: number; percent: number }) => void): Promise<boolean> => {
     try {
       if (!teslaCoilRef.current) return false
@@ -347,7 +371,9 @@ function App() {
         <FrequencySweep
           onConfigChange={handleFrequencySweepConfigChange}
           onStartSweep={handleStartFrequencySweep}
+          onControlSweep={handleControlFrequencySweep}
           sweepData={frequencySweepData}
+          sweepProgress={frequencySweepProgress}
           isSweepActive={isFrequencySweepActive}
         />
 
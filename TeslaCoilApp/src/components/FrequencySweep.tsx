@@ -1,19 +1,23 @@
 import { useState } from 'react'
 import Slider from '../Slider'
 import FrequencySweepGraph from './FrequencySweepGraph.tsx'
-import type { FrequencySweepConfig, FrequencySweepData } from '../utils/teslaCoilBluetooth'
+import type { FrequencySweepConfig, FrequencySweepData, FrequencySweepProgress } from '../utils/teslaCoilBluetooth'
 
 interface FrequencySweepProps {
   onConfigChange: (config: FrequencySweepConfig) => void
   onStartSweep: () => void
+  onControlSweep: (command: 'cancel' | 'pause' | 'resume') => void
   sweepData: FrequencySweepData[]
+  sweepProgress: FrequencySweepProgress | null
   isSweepActive: boolean
 }
 
 export default function FrequencySweep({ 
   onConfigChange, 
   onStartSweep, 
+  onControlSweep,
   sweepData, 
+  sweepProgress,
   isSweepActive 
 }: FrequencySweepProps) {
   const [config, setConfig] = useState<FrequencySweepConfig>({
@@ -58,7 +62,26 @@ export default function FrequencySweep({
           >
             {isSweepActive ? 'Sweep Running...' : 'Start Frequency Sweep'}
           </button>
+          {isSweepActive && (
+            <>
+              <button
+                className="sweep-button"
+                onClick={() => onControlSweep(sweepProgress?.state === 'paused' ? 'resume' : 'pause')}
+              >
+                {sweepProgress?.state === 'paused' ? 'Resume' : 'Pause'}
+              </button>
+              <button className="sweep-button" onClick={() => onControlSweep('cancel')}>
+                Cancel
+              </button>
+            </>
+          )}
         </div>
+
+        {sweepProgress && sweepProgress.state !== 'idle' && (
+          <div className="sweep-progress">
+            {sweepProgress.state}{sweepProgress.refining ? ' (refining peaks)' : ''}: {sweepProgress.pointsDone} / {sweepProgress.pointsTotal} points, {(sweepProgress.frequencyHz / 1000).toFixed(1)} kHz
+          </div>
+        )}
       </div>
 
       {sweepData.length > 0 && (
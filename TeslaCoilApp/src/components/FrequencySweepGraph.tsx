@@ -75,7 +75,9 @@ export default function FrequencySweepGraph({ data }: FrequencySweepGraphProps)
       ctx.lineWidth = 2
       ctx.beginPath()
 
-      data.forEach((point, index) => {
+      // Adaptive sweeps measure out of order, refining around peaks after the coarse pass
+      const sorted = [...data].sort((a, b) => a.frequency - b.frequency)
+      sorted.forEach((point, index) => {
         const x = padding + ((point.frequency - minFreq) / freqRange) * chartWidth
         const y = height - padding - ((point.value - minValue) / valueRange) * chartHeight
 
@@ -137,6 +139,8 @@ export default function FrequencySweepGraph({ data }: FrequencySweepGraphProps)
     if (data.length > 0) {
       const latestPoint = data[data.length - 1]
       ctx.fillText(`Latest: ${latestPoint.frequency}Hz, ${latestPoint.value}`, padding, padding + 40)
+      const worstError = data.reduce((worst, d) => Math.abs(d.errorHz) > Math.abs(worst) ? d.errorHz : worst, 0)
+      ctx.fillText(`Worst frequency error: ${worstError}Hz`, padding, padding + 60)
     }
 
   }, [data])
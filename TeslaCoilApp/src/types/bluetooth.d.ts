@@ -52,6 +52,7 @@ interface BluetoothRemoteGATTCharacteristic extends EventTarget {
   readonly value?: DataView
   readValue(): Promise<DataView>
   writeValue(value: BufferSource): Promise<void>
+  writeValueWithoutResponse(value: BufferSource): Promise<void>
   startNotifications(): Promise<BluetoothRemoteGATTCharacteristic>
   stopNotifications(): Promise<BluetoothRemoteGATTCharacteristic>
   addEventListener(type: 'characteristicvaluechanged', listener: EventListenerOrEventListenerObject, options?: boolean | AddEventListenerOptions): void
@@ -21,12 +21,18 @@ export const CHARACTERISTIC_UUIDS = {
   PLAY_MIDI: 'c8160660-e062-460c-8834-06f539975761', // Write, Play MIDI (bool)
   MIDI_OCTAVE: 'd8160660-e062-460c-8834-06f539975761', // Write, MIDI octave (int8)
   CHORD_SWAP_TIME: 'e8160660-e062-460c-8834-06f539975761', // Write, Chord swap time (uint8)
+  PARAMETER_BLOCK: 'f8160660-e062-460c-8834-06f539975761', // Write/Read/Notify, Packed parameter block applied atomically
+  PRESET: 'f8160661-e062-460c-8834-06f539975761', // Write op/index/name, Read preset names
+  LATENCY: 'f8160662-e062-460c-8834-06f539975761', // Notify ping, Write echo, Read round-trip latency stats
+  OCD_TRIPS: 'f8160663-e062-460c-8834-06f539975761', // Read OCD trip log, Notify newest trip
+  AUTOTUNE: 'f8160665-e062-460c-8834-06f539975761', // Write start/cancel, Read/Notify auto-tune result
   
   // FrequencySweepService characteristics
   MIN_FREQUENCY_SWEEP: '08160662-e062-460c-8834-06f539975761', // Write, Min frequency for sweep
   MAX_FREQUENCY_SWEEP: '08160663-e062-460c-8834-06f539975761', // Write, Max frequency for sweep
   START_FREQUENCY_SWEEP: '08160664-e062-460c-8834-06f539975761', // Write, Start frequency sweep
-  FREQUENCY_SWEEP_DATA: '08160665-e062-460c-8834-06f539975761', // Read, Frequency sweep data (read)
+  FREQUENCY_SWEEP_DATA: '08160665-e062-460c-8834-06f539975761', // Notify, Batched frequency sweep data
+  FREQUENCY_SWEEP_PROGRESS: '08160666-e062-460c-8834-06f539975761', // Read/Notify, sweep state and points done
 } as const
 
 export interface TeslaCoilData {
@@ -45,9 +51,57 @@ export interface TeslaCoilControl {
   burstEnabled: boolean
 }
 
+// Matches BleControl::parameterBlockSize on the firmware
+export const PARAMETER_BLOCK_SIZE = 12
+export const MAX_PRESETS = 8
+export const PRESET_NAME_LENGTH = 16
+
+// Matches sizeof(OCD::Trip) on the firmware
+const OCD_TRIP_SIZE = 16
+
+const SWEEP_BATCH_HEADER_SIZE = 4
+const SWEEP_SAMPLE_SIZE = 8
+const SWEEP_BATCH_FLAG_COMPLETE = 1
+
+// First byte written to START_FREQUENCY_SWEEP
+const SWEEP_COMMANDS = { cancel: 0, start: 1, pause: 2, resume: 3 } as const
+const SWEEP_STATES = ['idle', 'running', 'paused', 'done', 'cancelled'] as const
+
+const PRESET_OP_RECALL = 0
+const PRESET_OP_SAVE = 1
+const PRESET_OP_DELETE = 2
+
+// Round-trip latency measured by the firmware, in microseconds
+export interface LatencyStats {
+  last: number
+  min: number
+  max: number
+  average: number
+}
+
+// Matches OCD::Trip on the firmware
+export interface OcdTrip {
+  bootCount: number
+  uptimeMillis: number
+  peakCurrent: number // Amps
+  burstLength: number // Microseconds
+  tripAfterMicros: number
+  source: 'comparator' | 'adcThreshold' | 'burstPeak'
+}
+
+// Matches AutoTune::Result on the firmware
+export interface AutoTuneResult {
+  status: 'idle' | 'sweeping' | 'tuningPhase' | 'done' | 'failed'
+  phaseLead: number // Nanoseconds
+  resonanceHz: number
+  secondResonanceHz: number
+  peakMilliVolts: number
+}
+
 export interface FrequencySweepData {
   frequency: number
   value: number
+  errorHz: number // How far the PWM landed from the frequency asked for, achieved minus requested
 }
 
 export interface FrequencySweepConfig {
@@ -55,6 +109,24 @@ export interface FrequencySweepConfig {
   maxFrequency: number
 }
 
+export interface FrequencySweepProgress {
+  state: typeof SWEEP_STATES[number]
+  refining: boolean // Past the coarse pass of an adaptive sweep
+  pointsDone: number
+  pointsTotal: number // Estimated until the coarse pass has found the peaks
+  frequencyHz: number // Last point measured
+}
+
+// Sent along with the start trigger, the firmware keeps its last options when omitted
+export interface FrequencySweepOptions {
+  adaptive: boolean // Coarse pass then refinement around peaks, otherwise 1 kHz steps
+  coarseStepKHz: number
+  settleCycles: number
+  dwellMs: number
+  fineStepHz: number
+  refinePeaks: number
+}
+
 // MIDI upload helpers and API
 export class MidiUploadError extends Error {}
 
@@ -81,6 +153,9 @@ export class TeslaCoilBluetooth {
   private frequencySweepService: BluetoothRemoteGATTService | null = null
   private characteristics: Map<string, BluetoothRemoteGATTCharacteristic> = new Map()
   private lastControlState: TeslaCoilControl = {toggle: false, burstLength: 0, bps: 0, phaseLead: 0, reverseBurstPhase: false, burstEnabled: false}
+  // Sent along with every parameter block so it doesn't clobber the MIDI settings, seeded from the coil on connect
+  private midiOctave = 0
+  private chordSwapTime = 20
 
   constructor(server: BluetoothRemoteGATTServer) {
     this.server = server
@@ -97,7 +172,7 @@ export class TeslaCoilBluetooth {
       this.frequencySweepService = await this.server.getPrimaryService(FREQUENCY_SWEEP_SERVICE_UUID)
       
       // Get all characteristics from Tesla Coil service
-      const teslaCoilChars = ['VBUS', 'CURRENT_TRANSFORMER', 'THERM1', 'THERM2', 'TOGGLE', 'BURST_LENGTH', 'BPS', 'BURST_ENABLED', 'PHASE_LEAD', 'REVERSE_BURST_PHASE', 'MIDI_UPLOAD', 'PLAY_MIDI', 'MIDI_OCTAVE', 'CHORD_SWAP_TIME']
+      const teslaCoilChars = ['VBUS', 'CURRENT_TRANSFORMER', 'THERM1', 'THERM2', 'TOGGLE', 'BURST_LENGTH', 'BPS', 'BURST_ENABLED', 'PHASE_LEAD', 'REVERSE_BURST_PHASE', 'MIDI_UPLOAD', 'PLAY_MIDI', 'MIDI_OCTAVE', 'CHORD_SWAP_TIME', 'PARAMETER_BLOCK', 'PRESET', 'LATENCY', 'OCD_TRIPS', 'AUTOTUNE']
       const teslaCoilCharPromises = teslaCoilChars.map(async (name) => {
         const uuid = CHARACTERISTIC_UUIDS[name as keyof typeof CHARACTERISTIC_UUIDS]
         try {
@@ -110,7 +185,7 @@ export class TeslaCoilBluetooth {
       })
       
       // Get all characteristics from Frequency Sweep service
-      const frequencySweepChars = ['FREQUENCY_SWEEP_DATA', 'MIN_FREQUENCY_SWEEP', 'MAX_FREQUENCY_SWEEP', 'START_FREQUENCY_SWEEP']
+      const frequencySweepChars = ['FREQUENCY_SWEEP_DATA', 'MIN_FREQUENCY_SWEEP', 'MAX_FREQUENCY_SWEEP', 'START_FREQUENCY_SWEEP', 'FREQUENCY_SWEEP_PROGRESS']
       const frequencySweepCharPromises = frequencySweepChars.map(async (name) => {
         const uuid = CHARACTERISTIC_UUIDS[name as keyof typeof CHARACTERISTIC_UUIDS]
         try {
@@ -123,6 +198,7 @@ export class TeslaCoilBluetooth {
       })
       
       await Promise.all([...teslaCoilCharPromises, ...frequencySweepCharPromises])
+      await this.readParameterBlock()
     } catch (error) {
       console.error('Failed to initialize Tesla Coil Bluetooth:', error)
       throw error
@@ -178,7 +254,85 @@ export class TeslaCoilBluetooth {
     return data
   }
 
+  private encodeParameterBlock(control: TeslaCoilControl): Uint8Array {
+    const block = new Uint8Array(PARAMETER_BLOCK_SIZE)
+    const view = new DataView(block.buffer)
+    view.setUint8(0, control.toggle ? 1 : 0)
+    // Clamped to the ranges the firmware accepts, otherwise the whole block is rejected
+    view.setUint16(1, Math.max(10, Math.min(500, control.burstLength)), true)
+    view.setUint16(3, Math.max(1, control.bps), true)
+    view.setUint16(5, Math.max(0, Math.min(1250, control.phaseLead)), true)
+    view.setUint8(7, control.reverseBurstPhase ? 1 : 0)
+    view.setUint8(8, control.burstEnabled ? 1 : 0)
+    view.setInt8(10, this.midiOctave)
+    view.setUint8(11, this.chordSwapTime)
+    return block
+  }
+
+  // The coil's current MIDI settings, so the first block written doesn't reset them to this class's defaults
+  private async readParameterBlock(): Promise<void> {
+    const parameterBlockChar = this.characteristics.get('PARAMETER_BLOCK')
+    if (!parameterBlockChar || !parameterBlockChar.properties.read) return
+    try {
+      const value = await parameterBlockChar.readValue()
+      if (value.byteLength < PARAMETER_BLOCK_SIZE) return
+      this.midiOctave = value.getInt8(10)
+      this.chordSwapTime = value.getUint8(11)
+      this.lastControlState = this.decodeParameterBlock(value)
+    } catch (error) {
+      console.warn('⚠ Failed to read parameter block:', error)
+    }
+  }
+
+  private decodeParameterBlock(value: DataView): TeslaCoilControl {
+    return {
+      toggle: value.getUint8(0) !== 0,
+      burstLength: value.getUint16(1, true),
+      bps: value.getUint16(3, true),
+      phaseLead: value.getUint16(5, true),
+      reverseBurstPhase: value.getUint8(7) !== 0,
+      burstEnabled: value.getUint8(8) !== 0,
+    }
+  }
+
+  // The firmware notifies every connected client whenever any of them (or MIDI playback) changes a parameter
+  async startControlNotifications(onControl: (control: TeslaCoilControl) => void): Promise<void> {
+    const parameterBlockChar = this.characteristics.get('PARAMETER_BLOCK')
+    if (parameterBlockChar && parameterBlockChar.properties.notify) {
+      try {
+        await parameterBlockChar.startNotifications()
+        parameterBlockChar.addEventListener('characteristicvaluechanged', (event) => {
+          const characteristic = event.target as BluetoothRemoteGATTCharacteristic
+          const value = characteristic.value
+          if (!value || value.byteLength < PARAMETER_BLOCK_SIZE) return
+          const control = this.decodeParameterBlock(value)
+          this.midiOctave = value.getInt8(10)
+          this.chordSwapTime = value.getUint8(11)
+          this.lastControlState = { ...control }
+          onControl(control)
+        })
+        console.log('✓ Parameter block notifications started')
+      } catch (error) {
+        console.warn('⚠ Failed to start parameter block notifications:', error)
+      }
+    }
+  }
+
   async writeControlData(control: TeslaCoilControl): Promise<void> {
+    // Prefer a single atomic write so the coil never runs a half-applied configuration
+    const parameterBlockChar = this.characteristics.get('PARAMETER_BLOCK')
+    if (parameterBlockChar) {
+      try {
+        await parameterBlockChar.writeValue(this.encodeParameterBlock(control))
+        console.log('Parameter block:', control)
+        this.lastControlState = { ...control }
+      } catch (error) {
+        console.error('Error writing parameter block:', error)
+        throw error
+      }
+      return
+    }
+
     try {
       // Only write values that have changed
       // Write Toggle only if changed
@@ -374,11 +528,21 @@ export class TeslaCoilBluetooth {
     }
   }
 
-  async startFrequencySweep(): Promise<void> {
+  async startFrequencySweep(options?: FrequencySweepOptions): Promise<void> {
     try {
       const startChar = this.characteristics.get('START_FREQUENCY_SWEEP')
       if (startChar) {
-        const startValue = new Uint8Array([1]) // Trigger start
+        const startValue = new Uint8Array(options ? 8 : 1)
+        startValue[0] = SWEEP_COMMANDS.start
+        if (options) {
+          const view = new DataView(startValue.buffer)
+          view.setUint8(1, options.adaptive ? 1 : 0)
+          view.setUint8(2, options.coarseStepKHz)
+          view.setUint8(3, options.settleCycles)
+          view.setUint8(4, options.dwellMs)
+          view.setUint16(5, options.fineStepHz, true)
+          view.setUint8(7, options.refinePeaks)
+        }
         await startChar.writeValue(startValue)
         console.log('Frequency sweep started')
       }
@@ -388,39 +552,69 @@ export class TeslaCoilBluetooth {
     }
   }
 
-  async readFrequencySweepData(): Promise<FrequencySweepData | undefined> {
+  // Takes effect between points, a cancelled sweep still sends its completion batch
+  async controlFrequencySweep(command: 'cancel' | 'pause' | 'resume'): Promise<void> {
+    const startChar = this.characteristics.get('START_FREQUENCY_SWEEP')
+    if (!startChar) return
+    await startChar.writeValue(new Uint8Array([SWEEP_COMMANDS[command]]))
+  }
+
+  async startFrequencySweepProgressNotifications(onProgress: (progress: FrequencySweepProgress) => void): Promise<void> {
+    const progressChar = this.characteristics.get('FREQUENCY_SWEEP_PROGRESS')
+    if (!progressChar || !progressChar.properties.notify) return
     try {
-      const dataChar = this.characteristics.get('FREQUENCY_SWEEP_DATA')
-      if (dataChar) {
-        const value = await dataChar.readValue()
-        if (value.byteLength >= 4) {
-          // First 16 bits are frequency, last 16 bits are value
-          const frequency = value.getUint16(0, true) // little-endian
-          const dataValue = value.getUint16(2, true) // little-endian
-          return { frequency, value: dataValue }
-        }
-      }
+      await progressChar.startNotifications()
+      progressChar.addEventListener('characteristicvaluechanged', (event) => {
+        const value = (event.target as BluetoothRemoteGATTCharacteristic).value
+        if (!value || value.byteLength < 10) return
+        onProgress({
+          state: SWEEP_STATES[value.getUint8(0)] ?? 'idle',
+          refining: value.getUint8(1) === 1,
+          pointsDone: value.getUint16(2, true),
+          pointsTotal: value.getUint16(4, true),
+          frequencyHz: value.getUint32(6, true),
+        })
+      })
     } catch (error) {
-      console.error('Error reading frequency sweep data:', error)
-      return undefined
+      console.warn('⚠ Failed to start frequency sweep progress notifications:', error)
     }
-    return undefined
   }
 
+  // Sweep results arrive in batches: u16 sequence, u8 count, u8 flags, then count x (u32 frequency Hz, u16 value, i16 error Hz)
   async startFrequencySweepNotifications(
-    onData: (data: FrequencySweepData) => void
+    onData: (data: FrequencySweepData) => void,
+    onComplete?: () => void
   ): Promise<void> {
     const dataChar = this.characteristics.get('FREQUENCY_SWEEP_DATA')
     if (dataChar && dataChar.properties.notify) {
       try {
         await dataChar.startNotifications()
+        let expectedSequence = 0
         dataChar.addEventListener('characteristicvaluechanged', (event) => {
           const characteristic = event.target as BluetoothRemoteGATTCharacteristic
           const value = characteristic.value
-          if (value && value.byteLength >= 4) {
-            const frequency = value.getUint16(2, true) // little-endian
-            const dataValue = value.getUint16(0, true) // little-endian
-            onData({ frequency, value: dataValue })
+          if (!value || value.byteLength < SWEEP_BATCH_HEADER_SIZE) return
+
+          const sequence = value.getUint16(0, true)
+          const count = value.getUint8(2)
+          const flags = value.getUint8(3)
+          if (sequence !== expectedSequence) {
+            console.warn(`⚠ Frequency sweep batch ${expectedSequence} expected, got ${sequence}`)
+          }
+          expectedSequence = sequence + 1
+
+          for (let i = 0; i < count; i++) {
+            const offset = SWEEP_BATCH_HEADER_SIZE + i * SWEEP_SAMPLE_SIZE
+            if (offset + SWEEP_SAMPLE_SIZE > value.byteLength) break
+            const frequency = value.getUint32(offset, true) / 1000 // Hz to kHz
+            const dataValue = value.getUint16(offset + 4, true)
+            const errorHz = value.getInt16(offset + 6, true)
+            onData({ frequency, value: dataValue, errorHz })
+          }
+
+          if (flags & SWEEP_BATCH_FLAG_COMPLETE) {
+            expectedSequence = 0
+            onComplete?.()
           }
         })
         console.log('✓ Frequency sweep data notifications started')
@@ -442,6 +636,88 @@ export class TeslaCoilBluetooth {
     }
   }
 
+  // Echo the firmware's latency pings straight back so it can measure the round trip
+  async startLatencyEcho(): Promise<void> {
+    const latencyChar = this.characteristics.get('LATENCY')
+    if (latencyChar && latencyChar.properties.notify) {
+      try {
+        await latencyChar.startNotifications()
+        latencyChar.addEventListener('characteristicvaluechanged', (event) => {
+          const characteristic = event.target as BluetoothRemoteGATTCharacteristic
+          const value = characteristic.value
+          if (value && value.byteLength >= 4) {
+            const token = new Uint8Array(value.buffer.slice(value.byteOffset, value.byteOffset + 4))
+            latencyChar.writeValueWithoutResponse(token).catch((error) => {
+              console.warn('⚠ Failed to echo latency ping:', error)
+            })
+          }
+        })
+        console.log('✓ Latency echo started')
+      } catch (error) {
+        console.warn('⚠ Failed to start latency echo:', error)
+      }
+    }
+  }
+
+  async readLatencyStats(): Promise<LatencyStats | undefined> {
+    const latencyChar = this.characteristics.get('LATENCY')
+    if (!latencyChar) return undefined
+    const value = await latencyChar.readValue()
+    if (value.byteLength < 20) return undefined
+    return {
+      last: value.getUint32(4, true),
+      min: value.getUint32(8, true),
+      max: value.getUint32(12, true),
+      average: value.getUint32(16, true),
+    }
+  }
+
+  private decodeOcdTrip(value: DataView, offset: number): OcdTrip {
+    const sources = ['comparator', 'adcThreshold', 'burstPeak'] as const
+    return {
+      bootCount: value.getUint32(offset, true),
+      uptimeMillis: value.getUint32(offset + 4, true),
+      peakCurrent: value.getUint16(offset + 8, true),
+      burstLength: value.getUint16(offset + 10, true),
+      tripAfterMicros: value.getUint16(offset + 12, true),
+      source: sources[value.getUint8(offset + 14)] ?? 'burstPeak',
+    }
+  }
+
+  // The coil has to be enabled with bursts off, progress comes back through readAutoTuneResult
+  async startAutoTune(start = true): Promise<void> {
+    const autoTuneChar = this.characteristics.get('AUTOTUNE')
+    if (!autoTuneChar) return
+    await autoTuneChar.writeValue(new Uint8Array([start ? 1 : 0]))
+  }
+
+  async readAutoTuneResult(): Promise<AutoTuneResult | undefined> {
+    const autoTuneChar = this.characteristics.get('AUTOTUNE')
+    if (!autoTuneChar) return undefined
+    const value = await autoTuneChar.readValue()
+    if (value.byteLength < 14) return undefined
+    const statuses = ['idle', 'sweeping', 'tuningPhase', 'done', 'failed'] as const
+    return {
+      status: statuses[value.getUint8(0)] ?? 'failed',
+      phaseLead: value.getUint16(2, true),
+      resonanceHz: value.getUint32(4, true),
+      secondResonanceHz: value.getUint32(8, true),
+      peakMilliVolts: value.getUint16(12, true),
+    }
+  }
+
+  // Trips survive resets but not power cycles, oldest first
+  async readOcdTrips(): Promise<OcdTrip[]> {
+    const ocdChar = this.characteristics.get('OCD_TRIPS')
+    if (!ocdChar) return []
+    const value = await ocdChar.readValue()
+    const trips: OcdTrip[] = []
+    for (let offset = 0; offset + OCD_TRIP_SIZE <= value.byteLength; offset += OCD_TRIP_SIZE) {
+      trips.push(this.decodeOcdTrip(value, offset))
+    }
+    return trips
+  }
+
   async disconnect(): Promise<void> {
     try {
       // Stop all notifications
@@ -530,6 +806,7 @@ export class TeslaCoilBluetooth {
         const octaveValue = new Int8Array([clampedOctave])
         await midiOctaveChar.writeValue(octaveValue)
         console.log('MIDI Octave:', clampedOctave)
+        this.midiOctave = clampedOctave
       }
     } catch (error) {
       console.error('Error writing MIDI octave:', error)
@@ -547,10 +824,58 @@ export class TeslaCoilBluetooth {
         const timeValue = new Uint8Array([clampedTime])
         await chordSwapTimeChar.writeValue(timeValue)
         console.log('Chord Swap Time:', clampedTime)
+        this.chordSwapTime = clampedTime
       }
     } catch (error) {
       console.error('Error writing chord swap time:', error)
       throw error
     }
   }
+
+  private async writePreset(op: number, index: number, name = ''): Promise<void> {
+    const presetChar = this.characteristics.get('PRESET')
+    if (!presetChar) {
+      throw new Error('PRESET characteristic not available')
+    }
+    const nameBytes = new TextEncoder().encode(name).slice(0, PRESET_NAME_LENGTH)
+    const value = new Uint8Array(2 + nameBytes.length)
+    value[0] = op
+    value[1] = index
+    value.set(nameBytes, 2)
+    await presetChar.writeValue(value)
+  }
+
+  async savePreset(index: number, name: string): Promise<void> {
+    await this.writePreset(PRESET_OP_SAVE, index, name)
+    console.log('Preset saved:', index, name)
+  }
+
+  async recallPreset(index: number): Promise<void> {
+    await this.writePreset(PRESET_OP_RECALL, index)
+    console.log('Preset recalled:', index)
+  }
+
+  async deletePreset(index: number): Promise<void> {
+    await this.writePreset(PRESET_OP_DELETE, index)
+    console.log('Preset deleted:', index)
+  }
+
+  // Returns one entry per slot, empty string for unused slots
+  async readPresetNames(): Promise<string[]> {
+    const presetChar = this.characteristics.get('PRESET')
+    if (!presetChar) {
+      return []
+    }
+    const value = await presetChar.readValue()
+    const decoder = new TextDecoder()
+    const names: string[] = []
+    for (let i = 0; i < MAX_PRESETS; i++) {
+      const offset = i * PRESET_NAME_LENGTH
+      if (offset + PRESET_NAME_LENGTH > value.byteLength) break
+      const bytes = new Uint8Array(value.buffer, value.byteOffset + offset, PRESET_NAME_LENGTH)
+      const end = bytes.indexOf(0)
+      names.push(decoder.decode(end === -1 ? bytes : bytes.slice(0, end)))
+    }
+    return names
+  }
 }